@@ -3,6 +3,7 @@
 #endif
 #include <lib/collectors/aws/src/aws.h>
 #include <lib/collectors/cgroup/src/cgroup.h>
+#include <lib/collectors/cgroup/src/cgroup_host.h>
 #include <lib/collectors/cpu_freq/src/cpu_freq.h>
 #include <lib/collectors/dcgm/src/dcgm_stats.h>
 #include <lib/collectors/disk/src/disk.h>
@@ -19,17 +20,21 @@
 #include "backward.hpp"
 #include <condition_variable>
 #include <csignal>
+#include <cstring>
 #include <fmt/chrono.h>
 #include <getopt.h>
 #include <random>
 
+using atlasagent::env_flag_enabled;
 using atlasagent::GetLogger;
 using atlasagent::Logger;
 using atlasagent::Nvml;
+using atlasagent::PerfEventsConstants;
 
 using atlasagent::TaggingRegistry;
 using Aws = atlasagent::Aws<>;
 using CGroup = atlasagent::CGroup<>;
+using CgroupHost = atlasagent::CgroupHost<>;
 using CpuFreq = atlasagent::CpuFreq<>;
 using Disk = atlasagent::Disk<>;
 using Ethtool = atlasagent::Ethtool<>;
@@ -51,15 +56,27 @@ std::unique_ptr<GpuMetrics> init_gpu(TaggingRegistry* registry, std::unique_ptr<
   return {};
 }
 
+// extra PMU metrics, from the *.perf-events files in the config directory
+static std::vector<atlasagent::PerfMetricConfig> perf_events_config() {
+  auto config = atlasagent::parse_perf_events_config_directory(PerfEventsConstants::ConfigPath);
+  return config.value_or(std::vector<atlasagent::PerfMetricConfig>{});
+}
+
 #if defined(TITUS_SYSTEM_SERVICE)
-static void gather_peak_titus_metrics(CGroup* cGroup) { cGroup->cpu_peak_stats(); }
+static void gather_peak_titus_metrics(CGroup* cGroup, PressureStall* cgroupPressure) {
+  cGroup->cpu_peak_stats();
+  cgroupPressure->trigger_stats();
+}
 
-static void gather_slow_titus_metrics(CGroup* cGroup, Proc* proc, Disk* disk, Aws* aws) {
+static void gather_slow_titus_metrics(CGroup* cGroup, CgroupHost* cgroupHost, Proc* proc,
+                                      Disk* disk, Aws* aws) {
   aws->update_stats();
   cGroup->cpu_stats();
-  cGroup->memory_stats_v2();
-  cGroup->memory_stats_std_v2();
+  cGroup->memory_stats();
   cGroup->network_stats();
+  if (cgroupHost != nullptr) {
+    cgroupHost->update_stats();
+  }
   disk->titus_disk_stats();
   proc->netstat_stats();
   proc->network_stats();
@@ -67,8 +84,21 @@ static void gather_slow_titus_metrics(CGroup* cGroup, Proc* proc, Disk* disk, Aw
   proc->snmp_stats();
   proc->uptime_stats();
 }
+
 #else
-static void gather_peak_system_metrics(Proc* proc) { proc->peak_cpu_stats(); }
+static void gather_peak_system_metrics(Proc* proc, PressureStall* pressureStall, Disk* disk,
+                                       bool per_core) {
+  proc->peak_cpu_stats();
+  proc->softnet_stats();
+  pressureStall->peak_stats();
+  pressureStall->trigger_stats();
+  if (per_core) {
+    proc->peak_core_stats();
+  }
+  if (disk != nullptr) {
+    disk->peak_stats();
+  }
+}
 
 static void gather_scaling_metrics(CpuFreq* cpufreq) { cpufreq->Stats(); }
 
@@ -81,6 +111,8 @@ static void gather_slow_system_metrics(Proc* proc, Disk* disk, Ethtool* ethtool,
   pressureStall->update_stats();
   proc->arp_stats();
   proc->cpu_stats();
+  proc->interrupt_stats();
+  proc->softirq_stats();
   proc->loadavg_stats();
   proc->memory_stats();
   proc->netstat_stats();
@@ -182,19 +214,36 @@ void collect_titus_metrics(TaggingRegistry* registry, std::unique_ptr<atlasagent
 
   Aws aws{registry};
   CGroup cGroup{registry};
+  std::optional<CgroupHost> cgroupHost{};
+  // a single agent running on the host collects the cgroup metrics for all the containers,
+  // instead of one agent per container
+  if (env_flag_enabled("ATLAS_TITUS_HOST_MODE", "Metrics for all containers")) {
+    cgroupHost.emplace(registry);
+  }
+  auto cgroupHostPtr = cgroupHost.has_value() ? &cgroupHost.value() : nullptr;
+  // only used for the PSI triggers, the cumulative totals are not collected per container
+  PressureStall cgroupPressure{registry, "/sys/fs/cgroup"};
+  // PSI triggers need a kernel that allows setting them
+  if (env_flag_enabled("ATLAS_ENABLE_PSI_TRIGGERS", "PSI triggers")) {
+    cgroupPressure.enable_triggers(".pressure");
+  }
   Disk disk{registry, ""};
-  PerfMetrics perf_metrics{registry, ""};
+  // only count the tasks in the container, not everything running on the host. In host mode
+  // /sys/fs/cgroup is the host's root cgroup, so count system-wide instead
+  const char* perf_cgroup = cgroupHost.has_value() ? "" : "/sys/fs/cgroup";
+  PerfMetrics perf_metrics{registry, "", perf_cgroup, perf_events_config()};
   Proc proc{registry, std::move(net_tags)};
+  atlasagent::ProcStat procStat;
 
   auto gpu = init_gpu(registry, std::move(nvidia_lib));
 
   // TODO: DCGM & ServiceMonitor have Dynamic metric collection. During each iteration we have to
   // check if these optionals have a set value. lets improve how we handle this
   std::optional<ServiceMonitor<TaggingRegistry> > serviceMetrics{};
-  std::optional<std::vector<std::regex> > serviceConfig{
+  std::optional<std::vector<std::string> > serviceConfig{
       parse_service_monitor_config_directory(ServiceMonitorConstants::ConfigPath)};
   if (serviceConfig.has_value()) {
-    serviceMetrics.emplace(registry, serviceConfig.value(), max_monitored_services);
+    serviceMetrics.emplace(registry, serviceConfig.value(), max_monitored_services, &procStat);
   }
   else{
     Logger()->info("Service Monitoring is disabled.");
@@ -209,7 +258,7 @@ void collect_titus_metrics(TaggingRegistry* registry, std::unique_ptr<atlasagent
 
   // the first call to this gather function takes ~100ms, so it must be
   // done before we start calculating times to wait for peak metrics
-  gather_slow_titus_metrics(&cGroup, &proc, &disk, &aws);
+  gather_slow_titus_metrics(&cGroup, cgroupHostPtr, &proc, &disk, &aws);
   Logger()->info("Published slow Titus metrics (first iteration)");
 
   auto now = system_clock::now();
@@ -219,10 +268,12 @@ void collect_titus_metrics(TaggingRegistry* registry, std::unique_ptr<atlasagent
 
   do {
     auto start = system_clock::now();
-    gather_peak_titus_metrics(&cGroup);
+    gather_peak_titus_metrics(&cGroup, &cgroupPressure);
+    perf_metrics.handle_cpu_hotplug();
 
     if (start >= next_slow_run) {
-      gather_slow_titus_metrics(&cGroup, &proc, &disk, &aws);
+      procStat.refresh();
+      gather_slow_titus_metrics(&cGroup, cgroupHostPtr, &proc, &disk, &aws);
       perf_metrics.collect();
       if (gpu) {
         gpu->gpu_metrics();
@@ -252,9 +303,22 @@ void collect_system_metrics(TaggingRegistry* registry, std::unique_ptr<atlasagen
   Disk disk{registry, ""};
   Ethtool ethtool{registry, net_tags};
   Ntp ntp{registry};
-  PerfMetrics perf_metrics{registry, ""};
+  PerfMetrics perf_metrics{registry, "", "", perf_events_config()};
   PressureStall pressureStall{registry};
+  // PSI triggers need a kernel that allows setting them
+  if (env_flag_enabled("ATLAS_ENABLE_PSI_TRIGGERS", "PSI triggers")) {
+    pressureStall.enable_triggers();
+  }
   Proc proc{registry, net_tags};
+  // /proc/stat is parsed once per tick and shared by every consumer
+  atlasagent::ProcStat procStat;
+  proc.use_shared_stat(&procStat);
+  // mostly useful to find single threaded hot spots
+  auto per_core_peak =
+      env_flag_enabled("ATLAS_ENABLE_CORE_PEAK_METRICS", "Per-core peak metrics");
+  // reads a stat file per block device every second
+  auto diskPeak =
+      env_flag_enabled("ATLAS_ENABLE_DISK_PEAK_METRICS", "Disk peak metrics") ? &disk : nullptr;
 
   auto gpu = init_gpu(registry, std::move(nvidia_lib));
 
@@ -268,9 +332,9 @@ void collect_system_metrics(TaggingRegistry* registry, std::unique_ptr<atlasagen
   
   // Create a ServiceMonitor object to monitor Systemd services if any configs are valid
   std::optional<ServiceMonitor<TaggingRegistry> > serviceMetrics{};
-  std::optional<std::vector<std::regex> > serviceConfig{parse_service_monitor_config_directory(ServiceMonitorConstants::ConfigPath)};
+  std::optional<std::vector<std::string> > serviceConfig{parse_service_monitor_config_directory(ServiceMonitorConstants::ConfigPath)};
   if (serviceConfig.has_value()) {
-    serviceMetrics.emplace(registry, serviceConfig.value(), max_monitored_services);
+    serviceMetrics.emplace(registry, serviceConfig.value(), max_monitored_services, &procStat);
   }
   else{
     Logger()->info("Service Monitoring is disabled.");
@@ -302,6 +366,7 @@ void collect_system_metrics(TaggingRegistry* registry, std::unique_ptr<atlasagen
 
   // the first call to this gather function takes ~100ms, so it must be
   // done before we start calculating times to wait for peak metrics
+  procStat.refresh();
   gather_slow_system_metrics(&proc, &disk, &ethtool, &ntp, &pressureStall, &aws);
   Logger()->info("Published slow system metrics (first iteration)");
 
@@ -312,8 +377,10 @@ void collect_system_metrics(TaggingRegistry* registry, std::unique_ptr<atlasagen
 
   do {
     auto start = system_clock::now();
-    gather_peak_system_metrics(&proc);
+    procStat.refresh();
+    gather_peak_system_metrics(&proc, &pressureStall, diskPeak, per_core_peak);
     gather_scaling_metrics(&cpufreq);
+    perf_metrics.handle_cpu_hotplug();
 
     if (start >= next_slow_run) {
       gather_slow_system_metrics(&proc, &disk, &ethtool, &ntp, &pressureStall, &aws);
@@ -66,56 +66,48 @@ void CGroup<Reg>::pressure_stall() noexcept {
 
 template <typename Reg>
 void CGroup<Reg>::cpu_throttle_v2() noexcept {
-  std::unordered_map<std::string, int64_t> stats;
-  parse_kv_from_file(path_prefix_, "cpu.stat", &stats);
-
-  static auto throttled_time = registry_->GetCounter("cgroup.cpu.throttledTime");
-  static auto prev_throttled_time = static_cast<int64_t>(-1);
-  auto cur_throttled_time = stats["throttled_usec"];
-  if (prev_throttled_time >= 0) {
-    auto seconds = (cur_throttled_time - prev_throttled_time) / MICROS;
-    throttled_time->Add(seconds);
+  const auto& stats = snapshot_.cpu();
+
+  auto cur_throttled_time = stats.throttled_usec;
+  if (prev_throttled_time_ >= 0) {
+    auto seconds = (cur_throttled_time - prev_throttled_time_) / MICROS;
+    throttled_time_->Add(seconds);
   }
-  prev_throttled_time = cur_throttled_time;
+  prev_throttled_time_ = cur_throttled_time;
 
-  static auto nr_throttled = registry_->GetMonotonicCounter("cgroup.cpu.numThrottled");
-  nr_throttled->Set(stats["nr_throttled"]);
+  nr_throttled_->Set(stats.nr_throttled);
 }
 
 template <typename Reg>
 void CGroup<Reg>::cpu_time_v2() noexcept {
-  std::unordered_map<std::string, int64_t> stats;
-  parse_kv_from_file(path_prefix_, "cpu.stat", &stats);
-
-  static auto proc_time = registry_->GetCounter("cgroup.cpu.processingTime");
-  static auto prev_proc_time = static_cast<int64_t>(-1);
-  if (prev_proc_time >= 0) {
-    auto secs = (stats["usage_usec"] - prev_proc_time) / MICROS;
-    proc_time->Add(secs);
+  const auto& stats = snapshot_.cpu();
+
+  if (prev_proc_time_ >= 0) {
+    auto secs = (stats.usage_usec - prev_proc_time_) / MICROS;
+    proc_time_->Add(secs);
   }
-  prev_proc_time = stats["usage_usec"];
+  prev_proc_time_ = stats.usage_usec;
 
-  static auto system_usage = registry_->GetCounter("cgroup.cpu.usageTime", {{"id", "system"}});
-  static auto prev_sys_usage = static_cast<int64_t>(-1);
-  if (prev_sys_usage >= 0) {
-    auto secs = (stats["system_usec"] - prev_sys_usage) / MICROS;
-    system_usage->Add(secs);
+  if (prev_sys_usage_ >= 0) {
+    auto secs = (stats.system_usec - prev_sys_usage_) / MICROS;
+    system_usage_->Add(secs);
   }
-  prev_sys_usage = stats["system_usec"];
+  prev_sys_usage_ = stats.system_usec;
 
-  static auto user_usage = registry_->GetCounter("cgroup.cpu.usageTime", {{"id", "user"}});
-  static auto prev_user_usage = static_cast<int64_t>(-1);
-  if (prev_user_usage >= 0) {
-    auto secs = (stats["user_usec"] - prev_user_usage) / MICROS;
-    user_usage->Add(secs);
+  if (prev_user_usage_ >= 0) {
+    auto secs = (stats.user_usec - prev_user_usage_) / MICROS;
+    user_usage_->Add(secs);
   }
-  prev_user_usage = stats["user_usec"];
+  prev_user_usage_ = stats.user_usec;
 }
 
 template <typename Reg>
-double CGroup<Reg>::get_avail_cpu_time(double delta_t, double num_cpu) noexcept {
-  auto cpu_max = read_num_vector_from_file(path_prefix_, "cpu.max");
-  auto cfs_period = cpu_max[1];
+double CGroup<Reg>::get_avail_cpu_time(double delta_t, double num_cpu) const noexcept {
+  // cpu.max is only read on the slower cpu_stats cycle
+  auto cfs_period = static_cast<double>(snapshot_.cpu().max_period);
+  if (cfs_period <= 0) {
+    return delta_t * num_cpu;
+  }
   auto cfs_quota = cfs_period * num_cpu;
   return (delta_t / cfs_period) * cfs_quota;
 }
@@ -132,154 +124,137 @@ double CGroup<Reg>::get_num_cpu() noexcept {
 
 template <typename Reg>
 void CGroup<Reg>::cpu_utilization_v2(absl::Time now) noexcept {
-  static absl::Time last_updated;
-  if (last_updated == absl::UnixEpoch()) {
+  if (last_updated_ == absl::UnixEpoch()) {
     // ensure cgroup.cpu.processingCapacity has a consistent value after one sample
-    last_updated = now - update_interval_;
+    last_updated_ = now - update_interval_;
   }
-  auto delta_t = absl::ToDoubleSeconds(now - last_updated);
-  last_updated = now;
+  auto delta_t = absl::ToDoubleSeconds(now - last_updated_);
+  last_updated_ = now;
 
-  auto weight = read_num_from_file(path_prefix_, "cpu.weight");
+  auto weight = snapshot_.cpu().weight;
   if (weight >= 0) {
-    registry_->GetGauge("cgroup.cpu.weight")->Set(weight);
+    weight_->Set(weight);
   }
 
   auto num_cpu = get_num_cpu();
   auto avail_cpu_time = get_avail_cpu_time(delta_t, num_cpu);
 
-  registry_->GetCounter("cgroup.cpu.processingCapacity")->Add(delta_t * num_cpu);
-  registry_->GetGauge("sys.cpu.numProcessors")->Set(num_cpu);
-  registry_->GetGauge("titus.cpu.requested")->Set(num_cpu);
+  processing_capacity_->Add(delta_t * num_cpu);
+  num_processors_->Set(num_cpu);
+  cpu_requested_->Set(num_cpu);
 
-  std::unordered_map<std::string, int64_t> stats;
-  parse_kv_from_file(path_prefix_, "cpu.stat", &stats);
+  const auto& stats = snapshot_.cpu();
 
-  static auto cpu_system = registry_->GetGauge("sys.cpu.utilization", {{"id", "system"}});
-  static auto prev_system_time = static_cast<int64_t>(-1);
-  if (prev_system_time >= 0) {
-    auto secs = (stats["system_usec"] - prev_system_time) / MICROS;
-    cpu_system->Set((secs / avail_cpu_time) * 100);
+  if (prev_system_time_ >= 0) {
+    auto secs = (stats.system_usec - prev_system_time_) / MICROS;
+    cpu_system_->Set((secs / avail_cpu_time) * 100);
   }
-  prev_system_time = stats["system_usec"];
+  prev_system_time_ = stats.system_usec;
 
-  static auto cpu_user = registry_->GetGauge("sys.cpu.utilization", {{"id", "user"}});
-  static auto prev_user_time = static_cast<int64_t>(-1);
-  if (prev_user_time >= 0) {
-    auto secs = (stats["user_usec"] - prev_user_time) / MICROS;
-    cpu_user->Set((secs / avail_cpu_time) * 100);
+  if (prev_user_time_ >= 0) {
+    auto secs = (stats.user_usec - prev_user_time_) / MICROS;
+    cpu_user_->Set((secs / avail_cpu_time) * 100);
   }
-  prev_user_time = stats["user_usec"];
+  prev_user_time_ = stats.user_usec;
 }
 
 template <typename Reg>
 void CGroup<Reg>::cpu_peak_utilization_v2(absl::Time now) noexcept {
-  static absl::Time last_updated;
-  auto delta_t = absl::ToDoubleSeconds(now - last_updated);
-  last_updated = now;
+  auto delta_t = absl::ToDoubleSeconds(now - last_peak_updated_);
+  last_peak_updated_ = now;
 
   auto num_cpu = get_num_cpu();
   auto avail_cpu_time = get_avail_cpu_time(delta_t, num_cpu);
+  const auto& stats = snapshot_.cpu();
 
-  std::unordered_map<std::string, int64_t> stats;
-  parse_kv_from_file(path_prefix_, "cpu.stat", &stats);
-
-  static auto cpu_system = registry_->GetMaxGauge("sys.cpu.peakUtilization", {{"id", "system"}});
-  static auto prev_system_time = static_cast<int64_t>(-1);
-  if (prev_system_time >= 0) {
-    auto secs = (stats["system_usec"] - prev_system_time) / MICROS;
-    cpu_system->Set((secs / avail_cpu_time) * 100);
+  if (prev_peak_system_time_ >= 0) {
+    auto secs = (stats.system_usec - prev_peak_system_time_) / MICROS;
+    peak_cpu_system_->Set((secs / avail_cpu_time) * 100);
   }
-  prev_system_time = stats["system_usec"];
+  prev_peak_system_time_ = stats.system_usec;
 
-  static auto cpu_user = registry_->GetMaxGauge("sys.cpu.peakUtilization", {{"id", "user"}});
-  static auto prev_user_time = static_cast<int64_t>(-1);
-  if (prev_user_time >= 0) {
-    auto secs = (stats["user_usec"] - prev_user_time) / MICROS;
-    cpu_user->Set((secs / avail_cpu_time) * 100);
+  if (prev_peak_user_time_ >= 0) {
+    auto secs = (stats.user_usec - prev_peak_user_time_) / MICROS;
+    peak_cpu_user_->Set((secs / avail_cpu_time) * 100);
   }
-  prev_user_time = stats["user_usec"];
+  prev_peak_user_time_ = stats.user_usec;
 }
 
 template <typename Reg>
-void CGroup<Reg>::memory_stats_v2() noexcept {
-  auto usage_bytes = read_num_from_file(path_prefix_, "memory.current");
+void CGroup<Reg>::report_memory_v2() noexcept {
+  const auto& mem = snapshot_.memory();
+
+  auto usage_bytes = mem.current;
   if (usage_bytes >= 0) {
     registry_->GetGauge("cgroup.mem.used")->Set(usage_bytes);
   }
 
-  auto limit_bytes = read_num_from_file(path_prefix_, "memory.max");
+  auto limit_bytes = mem.max;
   if (limit_bytes >= 0) {
     registry_->GetGauge("cgroup.mem.limit")->Set(limit_bytes);
   }
 
-  static auto mem_fail_cnt = registry_->GetMonotonicCounter("cgroup.mem.failures");
-  std::unordered_map<std::string, int64_t> events;
-  parse_kv_from_file(path_prefix_, "memory.events", &events);
-  auto mem_fail = events["max"];
+  auto mem_fail_cnt = registry_->GetMonotonicCounter("cgroup.mem.failures");
+  auto mem_fail = mem.events_max;
   if (mem_fail >= 0) {
     mem_fail_cnt->Set(mem_fail);
   }
 
   // kmem_stats not available for v2
 
-  std::unordered_map<std::string, int64_t> stats;
-  parse_kv_from_file(path_prefix_, "memory.stat", &stats);
-
-  static auto usage_cache_gauge = registry_->GetGauge("cgroup.mem.processUsage", {{"id", "cache"}});
-  usage_cache_gauge->Set(stats["file"]);
+  auto usage_cache_gauge = registry_->GetGauge("cgroup.mem.processUsage", {{"id", "cache"}});
+  usage_cache_gauge->Set(mem.file);
 
-  static auto usage_rss_gauge = registry_->GetGauge("cgroup.mem.processUsage", {{"id", "rss"}});
-  usage_rss_gauge->Set(stats["anon"]);
+  auto usage_rss_gauge = registry_->GetGauge("cgroup.mem.processUsage", {{"id", "rss"}});
+  usage_rss_gauge->Set(mem.anon);
 
-  static auto usage_rss_huge_gauge = registry_->GetGauge("cgroup.mem.processUsage", {{"id", "rss_huge"}});
-  usage_rss_huge_gauge->Set(stats["anon_thp"]);
+  auto usage_rss_huge_gauge = registry_->GetGauge("cgroup.mem.processUsage", {{"id", "rss_huge"}});
+  usage_rss_huge_gauge->Set(mem.anon_thp);
 
-  static auto usage_mapped_file_gauge = registry_->GetGauge("cgroup.mem.processUsage", {{"id", "mapped_file"}});
-  usage_mapped_file_gauge->Set(stats["file_mapped"]);
+  auto usage_mapped_file_gauge = registry_->GetGauge("cgroup.mem.processUsage", {{"id", "mapped_file"}});
+  usage_mapped_file_gauge->Set(mem.file_mapped);
 
-  static auto minor_page_faults = registry_->GetMonotonicCounter("cgroup.mem.pageFaults", {{"id", "minor"}});
-  minor_page_faults->Set(stats["pgfault"]);
+  auto minor_page_faults = registry_->GetMonotonicCounter("cgroup.mem.pageFaults", {{"id", "minor"}});
+  minor_page_faults->Set(mem.pgfault);
 
-  static auto major_page_faults = registry_->GetMonotonicCounter("cgroup.mem.pageFaults", {{"id", "major"}});
-  major_page_faults->Set(stats["pgmajfault"]);
+  auto major_page_faults = registry_->GetMonotonicCounter("cgroup.mem.pageFaults", {{"id", "major"}});
+  major_page_faults->Set(mem.pgmajfault);
 }
 
 template <typename Reg>
-void CGroup<Reg>::memory_stats_std_v2() noexcept {
-  auto mem_limit = read_num_from_file(path_prefix_, "memory.max");
-  auto mem_usage = read_num_from_file(path_prefix_, "memory.current");
-  auto memsw_limit = read_num_from_file(path_prefix_, "memory.swap.max");
-  auto memsw_usage = read_num_from_file(path_prefix_, "memory.swap.current");
+void CGroup<Reg>::report_memory_std_v2() noexcept {
+  const auto& mem = snapshot_.memory();
 
-  std::unordered_map<std::string, int64_t> stats;
-  parse_kv_from_file(path_prefix_, "memory.stat", &stats);
+  auto mem_limit = mem.max;
+  auto mem_usage = mem.current;
+  auto memsw_limit = mem.swap_max;
+  auto memsw_usage = mem.swap_current;
 
-  static auto cached = registry_->GetGauge("mem.cached");
-  auto cache = stats["file"];
+  auto cached = registry_->GetGauge("mem.cached");
+  auto cache = mem.file;
   cached->Set(cache);
 
-  static auto shared = registry_->GetGauge("mem.shared");
-  auto shmem = stats["shmem"];
+  auto shared = registry_->GetGauge("mem.shared");
+  auto shmem = mem.shmem;
   shared->Set(shmem);
 
-  static auto avail_real = registry_->GetGauge("mem.availReal");
-  static auto free_real = registry_->GetGauge("mem.freeReal");
-  static auto total_real = registry_->GetGauge("mem.totalReal");
+  auto avail_real = registry_->GetGauge("mem.availReal");
+  auto free_real = registry_->GetGauge("mem.freeReal");
+  auto total_real = registry_->GetGauge("mem.totalReal");
   if (mem_limit >= 0 && mem_usage >= 0) {
     avail_real->Set(mem_limit - mem_usage + cache);
     free_real->Set(mem_limit - mem_usage);
     total_real->Set(mem_limit);
   }
 
-  static auto avail_swap = registry_->GetGauge("mem.availSwap");
-  static auto total_swap = registry_->GetGauge("mem.totalSwap");
+  auto avail_swap = registry_->GetGauge("mem.availSwap");
+  auto total_swap = registry_->GetGauge("mem.totalSwap");
   if (memsw_limit >= 0 && memsw_usage >= 0) {
     avail_swap->Set(memsw_limit - memsw_usage);
     total_swap->Set(memsw_limit);
   }
 
-  static auto total_free = registry_->GetGauge("mem.totalFree");
+  auto total_free = registry_->GetGauge("mem.totalFree");
   if (mem_limit >= 0 && mem_usage >= 0 && memsw_limit >= 0 && memsw_usage >= 0) {
     total_free->Set((mem_limit - mem_usage) + (memsw_limit - memsw_usage) + cache);
   }
@@ -287,6 +262,7 @@ void CGroup<Reg>::memory_stats_std_v2() noexcept {
 
 template <typename Reg>
 void CGroup<Reg>::do_cpu_stats(absl::Time now) noexcept {
+  snapshot_.refresh_cpu();
   cpu_throttle_v2();
   cpu_time_v2();
   cpu_utilization_v2(now);
@@ -294,6 +270,7 @@ void CGroup<Reg>::do_cpu_stats(absl::Time now) noexcept {
 
 template <typename Reg>
 void CGroup<Reg>::do_cpu_peak_stats(absl::Time now) noexcept {
+  snapshot_.refresh_cpu_stat();
   cpu_peak_utilization_v2(now);
 }
 
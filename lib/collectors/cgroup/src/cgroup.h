@@ -1,5 +1,6 @@
 #pragma once
 
+#include "cgroup_snapshot.h"
 #include <lib/tagging/src/tagging_registry.h>
 
 namespace atlasagent {
@@ -11,26 +12,87 @@ class CGroup {
                   absl::Duration update_interval = absl::Seconds(60)) noexcept
       : registry_(registry),
         path_prefix_(std::move(path_prefix)),
-        update_interval_{update_interval} {}
+        update_interval_{update_interval},
+        snapshot_{path_prefix_},
+        throttled_time_{registry->GetCounter("cgroup.cpu.throttledTime")},
+        nr_throttled_{registry->GetMonotonicCounter("cgroup.cpu.numThrottled")},
+        proc_time_{registry->GetCounter("cgroup.cpu.processingTime")},
+        system_usage_{registry->GetCounter("cgroup.cpu.usageTime", {{"id", "system"}})},
+        user_usage_{registry->GetCounter("cgroup.cpu.usageTime", {{"id", "user"}})},
+        weight_{registry->GetGauge("cgroup.cpu.weight")},
+        processing_capacity_{registry->GetCounter("cgroup.cpu.processingCapacity")},
+        num_processors_{registry->GetGauge("sys.cpu.numProcessors")},
+        cpu_requested_{registry->GetGauge("titus.cpu.requested")},
+        cpu_system_{registry->GetGauge("sys.cpu.utilization", {{"id", "system"}})},
+        cpu_user_{registry->GetGauge("sys.cpu.utilization", {{"id", "user"}})},
+        peak_cpu_system_{registry->GetMaxGauge("sys.cpu.peakUtilization", {{"id", "system"}})},
+        peak_cpu_user_{registry->GetMaxGauge("sys.cpu.peakUtilization", {{"id", "user"}})} {}
 
   void cpu_stats() noexcept { do_cpu_stats(absl::Now()); }
   void cpu_peak_stats() noexcept { do_cpu_peak_stats(absl::Now()); }
-  void memory_stats_v2() noexcept;
-  void memory_stats_std_v2() noexcept;
+  // both sets of memory metrics, reading the memory controller files once
+  void memory_stats() noexcept {
+    snapshot_.refresh_memory();
+    report_memory_v2();
+    report_memory_std_v2();
+  }
+  void memory_stats_v2() noexcept {
+    snapshot_.refresh_memory();
+    report_memory_v2();
+  }
+  void memory_stats_std_v2() noexcept {
+    snapshot_.refresh_memory();
+    report_memory_std_v2();
+  }
   void network_stats() noexcept;
   void pressure_stall() noexcept;
-  void set_prefix(std::string new_prefix) noexcept { path_prefix_ = std::move(new_prefix); }
+  void set_prefix(std::string new_prefix) noexcept {
+    snapshot_.set_prefix(new_prefix);
+    path_prefix_ = std::move(new_prefix);
+  }
 
  private:
   Reg* registry_;
   std::string path_prefix_;
   absl::Duration update_interval_;
+  // controller files read once per cycle and shared by the metrics derived from them
+  CgroupSnapshot snapshot_;
+
+  // previous values from cpu.stat, -1 until the first sample has been taken
+  int64_t prev_throttled_time_{-1};
+  int64_t prev_proc_time_{-1};
+  int64_t prev_sys_usage_{-1};
+  int64_t prev_user_usage_{-1};
+  absl::Time last_updated_;
+  int64_t prev_system_time_{-1};
+  int64_t prev_user_time_{-1};
+  absl::Time last_peak_updated_;
+  int64_t prev_peak_system_time_{-1};
+  int64_t prev_peak_user_time_{-1};
+
+  // cpu meters are looked up once, the peak ones are updated every second
+  typename Reg::counter_ptr throttled_time_;
+  typename Reg::monotonic_counter_ptr nr_throttled_;
+  typename Reg::counter_ptr proc_time_;
+  typename Reg::counter_ptr system_usage_;
+  typename Reg::counter_ptr user_usage_;
+  typename Reg::gauge_ptr weight_;
+  typename Reg::counter_ptr processing_capacity_;
+  typename Reg::gauge_ptr num_processors_;
+  typename Reg::gauge_ptr cpu_requested_;
+  typename Reg::gauge_ptr cpu_system_;
+  typename Reg::gauge_ptr cpu_user_;
+  typename Reg::max_gauge_ptr peak_cpu_system_;
+  typename Reg::max_gauge_ptr peak_cpu_user_;
 
   void cpu_throttle_v2() noexcept;
   void cpu_time_v2() noexcept;
   void cpu_utilization_v2(absl::Time now) noexcept;
   void cpu_peak_utilization_v2(absl::Time now) noexcept;
-  double get_avail_cpu_time(double delta_t, double num_cpu) noexcept;
+  // report from the memory snapshot, which must have been refreshed
+  void report_memory_v2() noexcept;
+  void report_memory_std_v2() noexcept;
+  double get_avail_cpu_time(double delta_t, double num_cpu) const noexcept;
   double get_num_cpu() noexcept;
 
  protected:
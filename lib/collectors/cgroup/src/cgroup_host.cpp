@@ -0,0 +1,229 @@
+#include "cgroup_host.h"
+#include <algorithm>
+
+namespace atlasagent {
+
+namespace {
+constexpr auto MICROS = 1000 * 1000.0;
+
+// containers are found a few levels down, for example
+// system.slice/docker-<id>.scope or kubepods.slice/kubepods-burstable.slice/<pod>/<id>
+constexpr int kMaxDepth = 4;
+
+constexpr std::string_view kIdPrefixes[] = {"docker-", "cri-containerd-", "crio-", "libpod-"};
+constexpr std::string_view kScopeSuffix = ".scope";
+
+inline bool is_hex(char c) noexcept {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+inline bool is_uuid(std::string_view s) noexcept {
+  if (s.size() != 36) {
+    return false;
+  }
+  for (size_t i = 0; i < s.size(); ++i) {
+    auto dash = i == 8 || i == 13 || i == 18 || i == 23;
+    if (dash ? s[i] != '-' : !is_hex(s[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+template class CgroupHost<atlasagent::TaggingRegistry>;
+template class CgroupHost<spectator::TestRegistry>;
+
+template <typename Reg>
+std::string_view CgroupHost<Reg>::container_id(std::string_view name) noexcept {
+  for (auto prefix : kIdPrefixes) {
+    if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0) {
+      name.remove_prefix(prefix.size());
+      break;
+    }
+  }
+  if (name.size() > kScopeSuffix.size() &&
+      name.compare(name.size() - kScopeSuffix.size(), kScopeSuffix.size(), kScopeSuffix) == 0) {
+    name.remove_suffix(kScopeSuffix.size());
+  }
+
+  if (name.size() == 64 && std::all_of(name.begin(), name.end(), is_hex)) {
+    return name;
+  }
+  if (is_uuid(name)) {
+    return name;
+  }
+  return {};
+}
+
+template <typename Reg>
+CgroupHost<Reg>::Meters::Meters(Reg* registry, const std::string& id) noexcept
+    : processing_time{registry->GetCounter("cgroup.cpu.processingTime", {{"container", id}})},
+      system_time{
+          registry->GetCounter("cgroup.cpu.usageTime", {{"container", id}, {"id", "system"}})},
+      user_time{registry->GetCounter("cgroup.cpu.usageTime", {{"container", id}, {"id", "user"}})},
+      throttled_time{registry->GetCounter("cgroup.cpu.throttledTime", {{"container", id}})},
+      num_throttled{registry->GetMonotonicCounter("cgroup.cpu.numThrottled", {{"container", id}})},
+      mem_used{registry->GetGauge("cgroup.mem.used", {{"container", id}})},
+      mem_limit{registry->GetGauge("cgroup.mem.limit", {{"container", id}})},
+      mem_failures{registry->GetMonotonicCounter("cgroup.mem.failures", {{"container", id}})},
+      mem_cache{
+          registry->GetGauge("cgroup.mem.processUsage", {{"container", id}, {"id", "cache"}})},
+      mem_rss{registry->GetGauge("cgroup.mem.processUsage", {{"container", id}, {"id", "rss"}})},
+      minor_faults{registry->GetMonotonicCounter("cgroup.mem.pageFaults",
+                                                 {{"container", id}, {"id", "minor"}})},
+      major_faults{registry->GetMonotonicCounter("cgroup.mem.pageFaults",
+                                                 {{"container", id}, {"id", "major"}})},
+      read_bytes{
+          registry->GetMonotonicCounter("cgroup.io.bytes", {{"container", id}, {"id", "read"}})},
+      write_bytes{
+          registry->GetMonotonicCounter("cgroup.io.bytes", {{"container", id}, {"id", "write"}})},
+      read_ops{
+          registry->GetMonotonicCounter("cgroup.io.ops", {{"container", id}, {"id", "read"}})},
+      write_ops{
+          registry->GetMonotonicCounter("cgroup.io.ops", {{"container", id}, {"id", "write"}})},
+      cpu_pressure_some{
+          registry->GetMonotonicCounter("sys.pressure.some", {{"container", id}, {"id", "cpu"}})},
+      cpu_pressure_full{registry->GetMonotonicCounter("sys.pressure.full",
+                                                      {{"container", id}, {"id", "cpu"}})} {}
+
+template <typename Reg>
+void CgroupHost<Reg>::set_root(std::string new_root) noexcept {
+  root_ = std::move(new_root);
+  // the descriptors refer to the old hierarchy, they are opened again on the next walk while
+  // keeping the previous values
+  root_fd_.reset();
+  for (auto& entry : containers_) {
+    entry.second.dir.reset();
+  }
+}
+
+template <typename Reg>
+void CgroupHost<Reg>::walk(int fd, int depth) noexcept {
+  DirHandle dh{fd};
+  if (dh == nullptr) {
+    return;
+  }
+  auto dir_fd = dirfd(dh);
+  auto prefix_len = rel_path_.size();
+  struct dirent* entry;
+  while ((entry = readdir(dh)) != nullptr) {
+    if (entry->d_type != DT_DIR || entry->d_name[0] == '.') {
+      continue;
+    }
+    rel_path_.resize(prefix_len);
+    if (prefix_len > 0) {
+      rel_path_.push_back('/');
+    }
+    rel_path_.append(entry->d_name);
+
+    auto id = container_id(entry->d_name);
+    if (id.empty()) {
+      if (depth + 1 < kMaxDepth) {
+        walk(openat(dir_fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC), depth + 1);
+      }
+      continue;
+    }
+
+    // cgroups below a container belong to it, so there is no need to walk them
+    auto& container = containers_[rel_path_];
+    if (container.id.empty()) {
+      container.id.assign(id.data(), id.size());
+      container.meters.emplace(registry_, container.id);
+    }
+    if (container.dir < 0) {
+      container.dir.reset(openat(dir_fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    }
+    container.generation = generation_;
+  }
+  rel_path_.resize(prefix_len);
+}
+
+template <typename Reg>
+void CgroupHost<Reg>::discover() noexcept {
+  ++generation_;
+  if (root_fd_ < 0) {
+    root_fd_.reset(open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (root_fd_ < 0) {
+      Logger()->warn("Unable to open cgroup root {}: {}", root_, strerror(errno));
+    }
+  }
+  if (root_fd_ >= 0) {
+    // readdir needs its own descriptor, which is closed when done
+    rel_path_.clear();
+    walk(openat(root_fd_, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC), 0);
+  }
+
+  // drop the containers that were not seen in this walk
+  for (auto it = containers_.begin(); it != containers_.end();) {
+    if (it->second.generation != generation_) {
+      it = containers_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+template <typename Reg>
+void CgroupHost<Reg>::update_container(Container* container) noexcept {
+  if (container->dir < 0) {
+    return;
+  }
+  reader_.set_dir(container->dir);
+  reader_.refresh_cpu_stat();
+  reader_.refresh_memory();
+  reader_.refresh_io();
+  reader_.refresh_cpu_pressure();
+  auto& meters = *container->meters;
+
+  auto add_seconds = [](typename Reg::counter_t* counter, int64_t cur, int64_t* prev) {
+    if (*prev >= 0 && cur >= *prev) {
+      counter->Add((cur - *prev) / MICROS);
+    }
+    *prev = cur;
+  };
+  const auto& cpu = reader_.cpu();
+  add_seconds(meters.processing_time.get(), cpu.usage_usec, &container->prev_usage_usec);
+  add_seconds(meters.system_time.get(), cpu.system_usec, &container->prev_system_usec);
+  add_seconds(meters.user_time.get(), cpu.user_usec, &container->prev_user_usec);
+  add_seconds(meters.throttled_time.get(), cpu.throttled_usec, &container->prev_throttled_usec);
+  meters.num_throttled->Set(cpu.nr_throttled);
+
+  const auto& mem = reader_.memory();
+  if (mem.current >= 0) {
+    meters.mem_used->Set(mem.current);
+  }
+  if (mem.max >= 0) {
+    meters.mem_limit->Set(mem.max);
+  }
+  meters.mem_failures->Set(mem.events_max);
+  meters.mem_cache->Set(mem.file);
+  meters.mem_rss->Set(mem.anon);
+  meters.minor_faults->Set(mem.pgfault);
+  meters.major_faults->Set(mem.pgmajfault);
+
+  const auto& io = reader_.io();
+  meters.read_bytes->Set(io.rbytes);
+  meters.write_bytes->Set(io.wbytes);
+  meters.read_ops->Set(io.rios);
+  meters.write_ops->Set(io.wios);
+
+  const auto& pressure = reader_.cpu_pressure();
+  if (pressure.some_usec >= 0) {
+    meters.cpu_pressure_some->Set(pressure.some_usec / MICROS);
+  }
+  if (pressure.full_usec >= 0) {
+    meters.cpu_pressure_full->Set(pressure.full_usec / MICROS);
+  }
+}
+
+template <typename Reg>
+void CgroupHost<Reg>::update_stats() noexcept {
+  discover();
+  for (auto& entry : containers_) {
+    update_container(&entry.second);
+  }
+  reader_.set_dir(-1);
+}
+
+}  // namespace atlasagent
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "cgroup_snapshot.h"
+#include <lib/files/src/files.h>
+#include <lib/tagging/src/tagging_registry.h>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+namespace atlasagent {
+
+/// Collects the cgroup metrics for every container on the host from a single agent, instead of
+/// running one agent inside each container.
+///
+/// The cgroup v2 hierarchy is walked from the root looking for directories named after a
+/// container (docker-<id>.scope, a 64 character id, or a Titus task uuid), without descending
+/// into the containers themselves. A descriptor for each container directory is kept open
+/// while the container exists, so the controller files can be read with openat without
+/// resolving their full paths again, and the state for containers that went away is dropped
+/// on the next walk. Metrics are tagged with the container id.
+template <typename Reg = TaggingRegistry>
+class CgroupHost {
+ public:
+  explicit CgroupHost(Reg* registry, std::string root = "/sys/fs/cgroup") noexcept
+      : registry_{registry}, root_{std::move(root)} {}
+
+  void update_stats() noexcept;
+  void set_root(std::string new_root) noexcept;
+
+  [[nodiscard]] size_t num_containers() const noexcept { return containers_.size(); }
+
+  // container id for a cgroup directory name, or empty if it is not a container
+  static std::string_view container_id(std::string_view name) noexcept;
+
+ private:
+  // the meters of a container, tagged with its id, looked up once when it is discovered
+  struct Meters {
+    Meters(Reg* registry, const std::string& id) noexcept;
+    typename Reg::counter_ptr processing_time;
+    typename Reg::counter_ptr system_time;
+    typename Reg::counter_ptr user_time;
+    typename Reg::counter_ptr throttled_time;
+    typename Reg::monotonic_counter_ptr num_throttled;
+    typename Reg::gauge_ptr mem_used;
+    typename Reg::gauge_ptr mem_limit;
+    typename Reg::monotonic_counter_ptr mem_failures;
+    typename Reg::gauge_ptr mem_cache;
+    typename Reg::gauge_ptr mem_rss;
+    typename Reg::monotonic_counter_ptr minor_faults;
+    typename Reg::monotonic_counter_ptr major_faults;
+    typename Reg::monotonic_counter_ptr read_bytes;
+    typename Reg::monotonic_counter_ptr write_bytes;
+    typename Reg::monotonic_counter_ptr read_ops;
+    typename Reg::monotonic_counter_ptr write_ops;
+    typename Reg::monotonic_counter_ptr cpu_pressure_some;
+    typename Reg::monotonic_counter_ptr cpu_pressure_full;
+  };
+
+  struct Container {
+    std::string id;
+    std::optional<Meters> meters;
+    UnixFile dir{-1};
+    uint32_t generation{0};
+    // previous values from cpu.stat, -1 until the first sample has been taken
+    int64_t prev_usage_usec{-1};
+    int64_t prev_user_usec{-1};
+    int64_t prev_system_usec{-1};
+    int64_t prev_throttled_usec{-1};
+  };
+
+  Reg* registry_;
+  std::string root_;
+  UnixFile root_fd_{-1};
+  uint32_t generation_{0};
+  // keyed by the path relative to the root, which doesn't change during the life of a container
+  std::unordered_map<std::string, Container> containers_;
+  // shared by all containers, only one of them is read at a time
+  CgroupSnapshot reader_;
+  std::string rel_path_;
+
+  void discover() noexcept;
+  void walk(int dir_fd, int depth) noexcept;
+  void update_container(Container* container) noexcept;
+};
+
+}  // namespace atlasagent
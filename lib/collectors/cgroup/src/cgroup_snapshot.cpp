@@ -0,0 +1,221 @@
+#include "cgroup_snapshot.h"
+#include <lib/files/src/files.h>
+#include <cstring>
+#include <string_view>
+
+namespace atlasagent {
+
+namespace {
+template <typename T>
+struct KvField {
+  std::string_view key;
+  int64_t T::*member;
+};
+
+constexpr KvField<CgroupCpu> kCpuStatFields[] = {
+    {"usage_usec", &CgroupCpu::usage_usec},
+    {"user_usec", &CgroupCpu::user_usec},
+    {"system_usec", &CgroupCpu::system_usec},
+    {"nr_throttled", &CgroupCpu::nr_throttled},
+    {"throttled_usec", &CgroupCpu::throttled_usec},
+};
+
+constexpr KvField<CgroupMemory> kMemoryEventsFields[] = {
+    {"max", &CgroupMemory::events_max},
+};
+
+constexpr KvField<CgroupMemory> kMemoryStatFields[] = {
+    {"file", &CgroupMemory::file},
+    {"anon", &CgroupMemory::anon},
+    {"anon_thp", &CgroupMemory::anon_thp},
+    {"file_mapped", &CgroupMemory::file_mapped},
+    {"shmem", &CgroupMemory::shmem},
+    {"pgfault", &CgroupMemory::pgfault},
+    {"pgmajfault", &CgroupMemory::pgmajfault},
+};
+
+constexpr KvField<CgroupIo> kIoStatFields[] = {
+    {"rbytes", &CgroupIo::rbytes},
+    {"wbytes", &CgroupIo::wbytes},
+    {"rios", &CgroupIo::rios},
+    {"wios", &CgroupIo::wios},
+};
+
+inline bool is_space(char c) noexcept { return c == ' ' || c == '\t' || c == '\n'; }
+
+// parse a non-negative number at the start of [p, end), skipping leading spaces. Returns -1 if
+// there is no number, for example for a limit of "max"
+inline int64_t parse_num(const char* p, const char* end, const char** next) noexcept {
+  while (p < end && is_space(*p)) {
+    ++p;
+  }
+  auto start = p;
+  int64_t n = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+    n = n * 10 + (*p - '0');
+  }
+  *next = p;
+  return p == start ? -1 : n;
+}
+
+// lines of the form "key value". Keys not in the table are skipped, the fields for keys not
+// present in the file are set to 0
+template <typename T, size_t N>
+void parse_kv(const char* begin, const char* end, const KvField<T> (&fields)[N], T* out) noexcept {
+  for (const auto& field : fields) {
+    out->*field.member = 0;
+  }
+  for (auto p = begin; p < end;) {
+    auto nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+    auto line_end = nl == nullptr ? end : nl;
+    auto sp = static_cast<const char*>(memchr(p, ' ', static_cast<size_t>(line_end - p)));
+    if (sp != nullptr) {
+      std::string_view key{p, static_cast<size_t>(sp - p)};
+      for (const auto& field : fields) {
+        if (field.key == key) {
+          const char* next;
+          auto value = parse_num(sp, line_end, &next);
+          out->*field.member = value < 0 ? 0 : value;
+          break;
+        }
+      }
+    }
+    p = line_end + 1;
+  }
+}
+
+// value of the first key=number token in [p, end) with the given key, or -1
+inline int64_t find_value(const char* p, const char* end, std::string_view key) noexcept {
+  while (p < end) {
+    while (p < end && is_space(*p)) {
+      ++p;
+    }
+    auto token_end = p;
+    while (token_end < end && !is_space(*token_end)) {
+      ++token_end;
+    }
+    auto eq = static_cast<const char*>(memchr(p, '=', static_cast<size_t>(token_end - p)));
+    if (eq != nullptr && std::string_view{p, static_cast<size_t>(eq - p)} == key) {
+      const char* next;
+      return parse_num(eq + 1, token_end, &next);
+    }
+    p = token_end;
+  }
+  return -1;
+}
+}  // namespace
+
+ssize_t CgroupSnapshot::read_file(const char* name) noexcept {
+  if (dir_fd_ >= 0) {
+    // controllers that are not enabled for a cgroup do not have their files, so this is not
+    // worth a warning
+    UnixFile fd{openat(dir_fd_, name, O_RDONLY | O_CLOEXEC)};
+    if (fd < 0) {
+      return -1;
+    }
+    return read_all(fd, &buf_);
+  }
+
+  path_.assign(path_prefix_);
+  path_.push_back('/');
+  path_.append(name);
+  UnixFile fd{path_.c_str()};
+  if (fd < 0) {
+    return -1;
+  }
+  auto len = read_all(fd, &buf_);
+  if (len < 0) {
+    Logger()->warn("Unable to read {}: {}", path_, strerror(errno));
+  }
+  return len;
+}
+
+int64_t CgroupSnapshot::read_num(const char* name) noexcept {
+  auto len = read_file(name);
+  if (len < 0) {
+    return -1;
+  }
+  const char* next;
+  return parse_num(buf_.data(), buf_.data() + len, &next);
+}
+
+void CgroupSnapshot::refresh_cpu_stat() noexcept {
+  auto len = read_file("cpu.stat");
+  parse_kv(buf_.data(), buf_.data() + (len < 0 ? 0 : len), kCpuStatFields, &cpu_);
+}
+
+void CgroupSnapshot::refresh_cpu() noexcept {
+  refresh_cpu_stat();
+
+  // cpu.max has the quota (or "max") followed by the period
+  cpu_.max_quota = cpu_.max_period = -1;
+  auto len = read_file("cpu.max");
+  if (len >= 0) {
+    auto end = buf_.data() + len;
+    auto p = buf_.data();
+    while (p < end && is_space(*p)) {
+      ++p;
+    }
+    auto sp = static_cast<const char*>(memchr(p, ' ', static_cast<size_t>(end - p)));
+    if (sp != nullptr) {
+      const char* next;
+      cpu_.max_quota = parse_num(p, sp, &next);
+      cpu_.max_period = parse_num(sp, end, &next);
+    }
+  }
+
+  cpu_.weight = read_num("cpu.weight");
+}
+
+void CgroupSnapshot::refresh_memory() noexcept {
+  memory_.current = read_num("memory.current");
+  memory_.max = read_num("memory.max");
+  memory_.swap_current = read_num("memory.swap.current");
+  memory_.swap_max = read_num("memory.swap.max");
+
+  auto len = read_file("memory.events");
+  parse_kv(buf_.data(), buf_.data() + (len < 0 ? 0 : len), kMemoryEventsFields, &memory_);
+  len = read_file("memory.stat");
+  parse_kv(buf_.data(), buf_.data() + (len < 0 ? 0 : len), kMemoryStatFields, &memory_);
+}
+
+void CgroupSnapshot::refresh_memory_usage() noexcept {
+  memory_.current = read_num("memory.current");
+  auto len = read_file("memory.stat");
+  parse_kv(buf_.data(), buf_.data() + (len < 0 ? 0 : len), kMemoryStatFields, &memory_);
+}
+
+void CgroupSnapshot::refresh_pids() noexcept { pids_current_ = read_num("pids.current"); }
+
+void CgroupSnapshot::refresh_io() noexcept {
+  io_ = CgroupIo{};
+  auto len = read_file("io.stat");
+  if (len <= 0) {
+    return;
+  }
+
+  // one line per device: 259:0 rbytes=1 wbytes=2 rios=3 wios=4 dbytes=0 dios=0
+  auto end = buf_.data() + len;
+  for (const char* p = buf_.data(); p < end;) {
+    auto nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+    auto line_end = nl == nullptr ? end : nl;
+    for (const auto& field : kIoStatFields) {
+      auto n = find_value(p, line_end, field.key);
+      if (n > 0) {
+        io_.*field.member += n;
+      }
+    }
+    p = line_end + 1;
+  }
+}
+
+void CgroupSnapshot::refresh_cpu_pressure() noexcept {
+  auto len = read_file("cpu.pressure");
+  if (len <= 0) {
+    cpu_pressure_ = PressureTotals{};
+    return;
+  }
+  cpu_pressure_ = parse_pressure(buf_.data(), buf_.data() + len);
+}
+
+}  // namespace atlasagent
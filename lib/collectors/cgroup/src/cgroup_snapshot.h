@@ -0,0 +1,103 @@
+#pragma once
+
+#include <lib/collectors/pressure_stall/src/pressure_file.h>
+#include <sys/types.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace atlasagent {
+
+// Values from cpu.stat, cpu.max and cpu.weight. Keys missing from cpu.stat are reported as 0,
+// files that can't be read (or a limit of "max") as -1
+struct CgroupCpu {
+  int64_t usage_usec{0};
+  int64_t user_usec{0};
+  int64_t system_usec{0};
+  int64_t nr_throttled{0};
+  int64_t throttled_usec{0};
+  int64_t max_quota{-1};
+  int64_t max_period{-1};
+  int64_t weight{-1};
+};
+
+// Values from the memory controller. Keys missing from memory.stat or memory.events are
+// reported as 0, files that can't be read (or a limit of "max") as -1
+struct CgroupMemory {
+  int64_t current{-1};
+  int64_t max{-1};
+  int64_t swap_current{-1};
+  int64_t swap_max{-1};
+  // memory.events
+  int64_t events_max{0};
+  // memory.stat
+  int64_t file{0};
+  int64_t anon{0};
+  int64_t anon_thp{0};
+  int64_t file_mapped{0};
+  int64_t shmem{0};
+  int64_t pgfault{0};
+  int64_t pgmajfault{0};
+};
+
+// io.stat, added up across devices
+struct CgroupIo {
+  int64_t rbytes{0};
+  int64_t wbytes{0};
+  int64_t rios{0};
+  int64_t wios{0};
+};
+
+/// Typed view of the cgroup v2 controller files used by the CGroup collector. Each file is read
+/// once per refresh into a reusable buffer, and only the keys we report are kept, so the
+/// different metrics derived from cpu.stat or memory.stat in a cycle share a single read.
+class CgroupSnapshot {
+ public:
+  explicit CgroupSnapshot(std::string path_prefix = "/sys/fs/cgroup") noexcept
+      : path_prefix_{std::move(path_prefix)} {}
+
+  void set_prefix(std::string new_prefix) noexcept { path_prefix_ = std::move(new_prefix); }
+  // read the files relative to an open cgroup directory instead of the prefix, avoiding a path
+  // lookup for each file. The descriptor is not owned, pass -1 to go back to the prefix
+  void set_dir(int dir_fd) noexcept { dir_fd_ = dir_fd; }
+
+  // read cpu.stat, cpu.max and cpu.weight
+  void refresh_cpu() noexcept;
+  // read only cpu.stat, keeping the last cpu.max and cpu.weight. Used for the peak
+  // utilization, which is sampled every second
+  void refresh_cpu_stat() noexcept;
+  // read memory.current, memory.max, memory.swap.*, memory.events and memory.stat
+  void refresh_memory() noexcept;
+  // read only memory.current and memory.stat, for cgroups where the limits are not reported
+  void refresh_memory_usage() noexcept;
+  // read pids.current
+  void refresh_pids() noexcept;
+  // read io.stat
+  void refresh_io() noexcept;
+  // read cpu.pressure
+  void refresh_cpu_pressure() noexcept;
+
+  [[nodiscard]] const CgroupCpu& cpu() const noexcept { return cpu_; }
+  [[nodiscard]] const CgroupMemory& memory() const noexcept { return memory_; }
+  [[nodiscard]] const CgroupIo& io() const noexcept { return io_; }
+  [[nodiscard]] const PressureTotals& cpu_pressure() const noexcept { return cpu_pressure_; }
+  // number of tasks in the cgroup, -1 if not available
+  [[nodiscard]] int64_t pids_current() const noexcept { return pids_current_; }
+
+ private:
+  std::string path_prefix_;
+  int dir_fd_{-1};
+  std::string path_;
+  std::vector<char> buf_;
+  CgroupCpu cpu_;
+  CgroupMemory memory_;
+  CgroupIo io_;
+  PressureTotals cpu_pressure_;
+  int64_t pids_current_{-1};
+
+  // reads the file into buf_, returning its length or -1
+  ssize_t read_file(const char* name) noexcept;
+  int64_t read_num(const char* name) noexcept;
+};
+
+}  // namespace atlasagent
@@ -1,4 +1,5 @@
 #include <lib/collectors/cgroup/src/cgroup.h>
+#include <lib/collectors/cgroup/src/cgroup_host.h>
 #include <lib/measurement_utils/src/measurement_utils.h>
 #include <gtest/gtest.h>
 
@@ -101,6 +102,88 @@ TEST(CGroup, ParseCpuV2) {
   EXPECT_TRUE(map.empty());
 }
 
+TEST(CGroup, IndependentInstances) {
+  Registry registry;
+  CGroupTest cGroup{&registry, "testdata/resources", absl::Seconds(30)};
+  Registry other_registry;
+  CGroupTest other{&other_registry, "testdata/resources2", absl::Seconds(30)};
+
+  auto now = absl::Now();
+  setenv("TITUS_NUM_CPU", "1", 1);
+  cGroup.cpu_stats(now);
+  cGroup.set_prefix("testdata/resources2");
+  cGroup.cpu_stats(now + absl::Seconds(5));
+  auto ms = my_measurements(&registry);
+  auto map = measurements_to_map(ms, "proto");
+  EXPECT_EQ(map.count("cgroup.cpu.processingTime|count"), 1);
+
+  // the first sample of another instance must not be computed against the previous one
+  other.cpu_stats(now + absl::Seconds(5));
+  auto other_ms = my_measurements(&other_registry);
+  auto other_map = measurements_to_map(other_ms, "proto");
+  EXPECT_EQ(other_map.count("cgroup.cpu.processingTime|count"), 0);
+  EXPECT_EQ(other_map.count("sys.cpu.utilization|gauge|user"), 0);
+  expect_value(&other_map, "cgroup.cpu.processingCapacity|count", 30);
+}
+
+TEST(CGroup, Snapshot) {
+  atlasagent::CgroupSnapshot snapshot{"testdata/resources"};
+  snapshot.refresh_cpu();
+  const auto& cpu = snapshot.cpu();
+  EXPECT_EQ(cpu.usage_usec, 1000000);
+  EXPECT_EQ(cpu.nr_throttled, 2);
+  EXPECT_EQ(cpu.throttled_usec, 1000000);
+  EXPECT_EQ(cpu.max_quota, -1);  // max
+  EXPECT_EQ(cpu.max_period, 100000);
+  EXPECT_EQ(cpu.weight, 100);
+
+  snapshot.set_prefix("testdata/resources2");
+  snapshot.refresh_cpu_stat();
+  EXPECT_EQ(snapshot.cpu().usage_usec, 31000000);
+  // not re-read by refresh_cpu_stat
+  EXPECT_EQ(snapshot.cpu().max_period, 100000);
+
+  snapshot.refresh_memory();
+  const auto& mem = snapshot.memory();
+  EXPECT_EQ(mem.current, 7841374208);
+  EXPECT_EQ(mem.max, 8589934592);
+  EXPECT_EQ(mem.swap_max, 536870912);
+  EXPECT_EQ(mem.swap_current, 0);
+  EXPECT_EQ(mem.events_max, 2);
+  EXPECT_EQ(mem.file, 11218944);
+  EXPECT_EQ(mem.shmem, 135168);
+  EXPECT_EQ(mem.pgmajfault, 10);
+
+  // missing files
+  snapshot.set_prefix("testdata/nonexistent");
+  snapshot.refresh_cpu();
+  snapshot.refresh_memory();
+  EXPECT_EQ(snapshot.cpu().usage_usec, 0);
+  EXPECT_EQ(snapshot.cpu().max_period, -1);
+  EXPECT_EQ(snapshot.cpu().weight, -1);
+  EXPECT_EQ(snapshot.memory().max, -1);
+  EXPECT_EQ(snapshot.memory().file, 0);
+}
+
+TEST(CGroup, SnapshotUsage) {
+  atlasagent::CgroupSnapshot snapshot{
+      "testdata/resources2/service_monitor/cgroup/system.slice/nginx.service"};
+  snapshot.refresh_memory_usage();
+  snapshot.refresh_pids();
+  EXPECT_EQ(snapshot.memory().current, 52428800);
+  EXPECT_EQ(snapshot.memory().anon, 20971520);
+  EXPECT_EQ(snapshot.memory().file_mapped, 8388608);
+  // limits are not read
+  EXPECT_EQ(snapshot.memory().max, -1);
+  EXPECT_EQ(snapshot.pids_current(), 5);
+
+  snapshot.set_prefix("testdata/nonexistent");
+  snapshot.refresh_memory_usage();
+  snapshot.refresh_pids();
+  EXPECT_EQ(snapshot.memory().current, -1);
+  EXPECT_EQ(snapshot.pids_current(), -1);
+}
+
 TEST(CGroup, ParseMemoryV2) {
   Registry registry;
   CGroupTest cGroup{&registry, "testdata/resources"};
@@ -134,4 +217,73 @@ TEST(CGroup, ParseMemoryV2) {
   expect_value(&values, "mem.totalSwap|gauge", 536870912);
   EXPECT_TRUE(values.empty());
 }
+
+TEST(CGroup, MemoryStats) {
+  Registry registry;
+  CGroupTest cGroup{&registry, "testdata/resources2"};
+
+  // both sets of metrics from a single read of the memory files
+  cGroup.memory_stats();
+  auto values = measurements_to_map(my_measurements(&registry), "");
+  EXPECT_EQ(values.size(), 14);
+  expect_value(&values, "cgroup.mem.used|gauge", 7841374208);
+  expect_value(&values, "mem.totalReal|gauge", 8589934592);
+}
+
+TEST(CGroup, ContainerId) {
+  using CgroupHost = atlasagent::CgroupHost<Registry>;
+  const std::string id(64, 'a');
+  EXPECT_EQ(CgroupHost::container_id(id), id);
+  EXPECT_EQ(CgroupHost::container_id("docker-" + id + ".scope"), id);
+  EXPECT_EQ(CgroupHost::container_id("cri-containerd-" + id + ".scope"), id);
+  EXPECT_EQ(CgroupHost::container_id("3c0e5f2a-7d4b-4e8a-9f1c-2b6d8e0a4c11"),
+            "3c0e5f2a-7d4b-4e8a-9f1c-2b6d8e0a4c11");
+  EXPECT_TRUE(CgroupHost::container_id("system.slice").empty());
+  EXPECT_TRUE(CgroupHost::container_id("init.scope").empty());
+  EXPECT_TRUE(CgroupHost::container_id("docker-" + id.substr(1) + ".scope").empty());
+}
+
+TEST(CGroup, HostContainers) {
+  Registry registry;
+  atlasagent::CgroupHost<Registry> host{&registry, "testdata/resources/cgroup-host"};
+  host.update_stats();
+  // the nested init.scope and the sshd service are not containers
+  EXPECT_EQ(host.num_containers(), 2);
+  auto initial = measurements_to_map(my_measurements(&registry), "container");
+  const std::string docker = "|0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
+  const std::string titus = "|3c0e5f2a-7d4b-4e8a-9f1c-2b6d8e0a4c11";
+  expect_value(&initial, ("cgroup.mem.used|gauge" + docker).c_str(), 1073741824);
+  expect_value(&initial, ("cgroup.mem.used|gauge" + titus).c_str(), 4096);
+  // memory.max is "max"
+  EXPECT_EQ(initial.count("cgroup.mem.limit|gauge" + titus), 0);
+
+  // the titus container went away
+  host.set_root("testdata/resources2/cgroup-host");
+  host.update_stats();
+  EXPECT_EQ(host.num_containers(), 1);
+  auto map = measurements_to_map(my_measurements(&registry), "container");
+  expect_value(&map, ("cgroup.cpu.processingTime|count" + docker).c_str(), 30);
+  expect_value(&map, ("cgroup.cpu.usageTime|count|system" + docker).c_str(), 10);
+  expect_value(&map, ("cgroup.cpu.usageTime|count|user" + docker).c_str(), 20);
+  expect_value(&map, ("cgroup.cpu.throttledTime|count" + docker).c_str(), 1);
+  expect_value(&map, ("cgroup.cpu.numThrottled|count" + docker).c_str(), 2);
+  expect_value(&map, ("cgroup.mem.used|gauge" + docker).c_str(), 1073741824);
+  expect_value(&map, ("cgroup.mem.limit|gauge" + docker).c_str(), 2147483648);
+  expect_value(&map, ("cgroup.mem.failures|count" + docker).c_str(), 2);
+  expect_value(&map, ("cgroup.mem.processUsage|gauge|cache" + docker).c_str(), 268435456);
+  expect_value(&map, ("cgroup.mem.processUsage|gauge|rss" + docker).c_str(), 536870912);
+  expect_value(&map, ("cgroup.mem.pageFaults|count|minor" + docker).c_str(), 2000);
+  expect_value(&map, ("cgroup.mem.pageFaults|count|major" + docker).c_str(), 5);
+  expect_value(&map, ("cgroup.io.bytes|count|read" + docker).c_str(), 3000);
+  expect_value(&map, ("cgroup.io.bytes|count|write" + docker).c_str(), 4000);
+  expect_value(&map, ("cgroup.io.ops|count|read" + docker).c_str(), 25);
+  expect_value(&map, ("cgroup.io.ops|count|write" + docker).c_str(), 40);
+  expect_value(&map, ("sys.pressure.some|count|cpu" + docker).c_str(), 2);
+  expect_value(&map, ("sys.pressure.full|count|cpu" + docker).c_str(), 1);
+  // the gauges of the removed container are left for the registry to expire
+  for (auto it = map.begin(); it != map.end();) {
+    it = it->first.find(titus) != std::string::npos ? map.erase(it) : std::next(it);
+  }
+  EXPECT_TRUE(map.empty());
+}
 }  // namespace
@@ -0,0 +1,77 @@
+#include "block_stat.h"
+#include <cstring>
+
+namespace atlasagent {
+
+namespace {
+// positions of the fields in the stat file
+enum Field {
+  kReadIos = 0,
+  kReadTicks = 3,
+  kWriteIos = 4,
+  kWriteTicks = 7,
+  kInFlight = 8,
+  kIoTicks = 9,
+  kTimeInQueue = 10,
+  kNumFields
+};
+}  // namespace
+
+bool parse_block_stat(const char* begin, const char* end, BlockStat* stat) noexcept {
+  uint64_t fields[kNumFields];
+  auto p = begin;
+  for (auto& field : fields) {
+    while (p < end && *p == ' ') {
+      ++p;
+    }
+    if (p == end || *p < '0' || *p > '9') {
+      return false;
+    }
+    uint64_t n = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+      n = n * 10 + static_cast<uint64_t>(*p - '0');
+    }
+    field = n;
+  }
+
+  stat->read_ios = fields[kReadIos];
+  stat->read_ticks = fields[kReadTicks];
+  stat->write_ios = fields[kWriteIos];
+  stat->write_ticks = fields[kWriteTicks];
+  stat->in_flight = fields[kInFlight];
+  stat->io_ticks = fields[kIoTicks];
+  stat->time_in_queue = fields[kTimeInQueue];
+  return true;
+}
+
+void BlockStatFile::set_path(std::string path) noexcept {
+  path_ = std::move(path);
+  // force the file to be opened again
+  fd_.reset();
+  open_failed_ = false;
+}
+
+bool BlockStatFile::read(BlockStat* stat) noexcept {
+  if (fd_ < 0) {
+    if (open_failed_) {
+      return false;
+    }
+    fd_.open(path_.c_str());
+    if (fd_ < 0) {
+      // do not keep trying (and logging) every second
+      open_failed_ = true;
+      return false;
+    }
+  }
+
+  // 17 counters of at most 20 digits
+  char buf[512];
+  auto len = pread(fd_, buf, sizeof buf, 0);
+  if (len < 0) {
+    Logger()->warn("Unable to read {}: {}", path_, strerror(errno));
+    return false;
+  }
+  return parse_block_stat(buf, buf + len, stat);
+}
+
+}  // namespace atlasagent
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <lib/files/src/files.h>
+#include <cstdint>
+#include <string>
+
+namespace atlasagent {
+
+// the fields of /sys/class/block/<dev>/stat used for the peak metrics, times are in ms
+struct BlockStat {
+  uint64_t read_ios{0};
+  uint64_t read_ticks{0};
+  uint64_t write_ios{0};
+  uint64_t write_ticks{0};
+  uint64_t in_flight{0};
+  uint64_t io_ticks{0};
+  uint64_t time_in_queue{0};
+};
+
+// parse the contents of a block device stat file: one line of space separated counters in a
+// fixed order (see Documentation/block/stat.rst). Returns false if the line is truncated
+bool parse_block_stat(const char* begin, const char* end, BlockStat* stat) noexcept;
+
+/// A block device stat file kept open and re-read from the start on every sample. The file is
+/// a single short line, so a read is one pread into a stack buffer, cheap enough to sample every
+/// device every second.
+class BlockStatFile {
+ public:
+  BlockStatFile() = default;
+
+  void set_path(std::string path) noexcept;
+  // returns false if the file could not be read
+  bool read(BlockStat* stat) noexcept;
+
+ private:
+  std::string path_;
+  UnixFile fd_{-1};
+  bool open_failed_{false};
+};
+
+}  // namespace atlasagent
@@ -1,10 +1,10 @@
 #include "disk.h"
 #include <lib/util/src/util.h>
 #include <absl/strings/str_split.h>
-#include <fstream>
+#include <algorithm>
 #include <iostream>
-#include <sstream>
 #include <sys/statvfs.h>
+#include <unistd.h>
 #include <unordered_set>
 
 namespace atlasagent {
@@ -51,49 +51,29 @@ std::vector<MountPoint> Disk<Reg>::get_mount_points() const noexcept {
 #endif
 
   auto file_name = fmt::format("{}/proc/self/mountinfo", path_prefix_);
-  std::ifstream in(file_name);
   std::vector<MountPoint> res;
-
-  if (!in) {
-    Logger()->warn("Unable to open {}", file_name);
+  UnixFile fd{file_name.c_str()};
+  if (fd < 0) {
     return res;
   }
-
-  std::string slash{"/"};
-  while (in) {
-    MountPoint mp;
-    unsigned ignored;
-    std::string root;
-    char ch;
-    in >> ignored;
-    if (in.eof()) {
-      break;
-    }
-    in >> ignored;
-    in >> mp.device_major;
-    in >> ch;  // ':';
-    in >> mp.device_minor;
-    in >> root;
-    auto keep = root == slash;
-    if (keep) {
-      in >> mp.mount_point;  // relative to root, but we only concern ourselves with root = /
-      in.ignore(std::numeric_limits<std::streamsize>::max(), '-');
-      in >> mp.fs_type;
-      in >> mp.device;
-    }
-    in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-
-    // add only if the filesystem is not in our unwanted blacklist
-    if (keep && unwanted_filesystems.find(mp.fs_type) == unwanted_filesystems.end()) {
-      res.push_back(std::move(mp));
-    }
+  std::vector<char> buf;
+  auto len = read_all(fd, &buf);
+  if (len < 0) {
+    Logger()->warn("Unable to read {}: {}", file_name, strerror(errno));
+    return res;
   }
+  parse_mountinfo(std::string_view{buf.data(), static_cast<size_t>(len)}, unwanted_filesystems,
+                  &res);
   return res;
 }
 
 static constexpr int kMultipleDevice = 9;
 static constexpr int kLoopDevice = 7;
 static constexpr int kRamDevice = 1;
+static constexpr std::string_view kIgnoredMountPrefixes[] = {
+    "/dev",  "/mnt/docker", "/mnt/jenkins", "/mnt/kubelet",  "/proc",
+    "/run",  "/sys",        "/tmp/buildkit", "/var/lib",
+};
 
 template <typename Reg>
 std::vector<MountPoint> Disk<Reg>::filter_interesting_mount_points(
@@ -106,19 +86,15 @@ std::vector<MountPoint> Disk<Reg>::filter_interesting_mount_points(
       continue;
     }
 
-    if (starts_with(mp.mount_point.c_str(), "/dev") ||
-        starts_with(mp.mount_point.c_str(), "/mnt/docker") ||
-        starts_with(mp.mount_point.c_str(), "/mnt/jenkins") ||
-        starts_with(mp.mount_point.c_str(), "/mnt/kubelet") ||
-        starts_with(mp.mount_point.c_str(), "/proc") ||
-        starts_with(mp.mount_point.c_str(), "/run") ||
-        starts_with(mp.mount_point.c_str(), "/sys") ||
-        starts_with(mp.mount_point.c_str(), "/tmp/buildkit") ||
-        starts_with(mp.mount_point.c_str(), "/var/lib")) {
+    std::string_view mount_point{mp.mount_point};
+    if (std::any_of(std::begin(kIgnoredMountPrefixes), std::end(kIgnoredMountPrefixes),
+                    [mount_point](std::string_view prefix) {
+                      return mount_point.compare(0, prefix.size(), prefix) == 0;
+                    })) {
       continue;
     }
 
-    auto key = static_cast<uint64_t>(mp.device_major) << 32u | mp.device_minor;
+    auto key = device_key(mp.device_major, mp.device_minor);
     auto candidate = candidates[key];
     if (candidate != nullptr) {
       // keep the shortest path if more than one mount point refers to the same device
@@ -153,12 +129,69 @@ std::string get_dev_from_device(const std::string& device) {
   return device;
 }
 
+bool is_whole_disk(const std::string& prefix, const std::string& dev) {
+  if (dev.substr(0, 3) == "dm-") {
+    return false;
+  }
+  auto partition = fmt::format("{}/sys/class/block/{}/partition", prefix, dev);
+  return access(partition.c_str(), F_OK) != 0;
+}
+
+std::vector<std::string> disk_peak_devices() {
+  auto devices = std::getenv("ATLAS_DISK_PEAK_DEVICES");
+  if (devices == nullptr) {
+    return {};
+  }
+  std::vector<std::string> result = absl::StrSplit(devices, ',', absl::SkipWhitespace());
+  if (!result.empty()) {
+    Logger()->info("Disk peak metrics only for devices: {}", devices);
+  }
+  return result;
+}
+
+template <typename Reg>
+bool Disk<Reg>::is_peak_device(const std::string& dev) const noexcept {
+  if (peak_devices_.empty()) {
+    return is_whole_disk(path_prefix_, dev);
+  }
+  return std::find(peak_devices_.begin(), peak_devices_.end(), dev) != peak_devices_.end();
+}
+
 template <typename Reg>
 void Disk<Reg>::stats_for_interesting_mps(
-    std::function<void(Disk*, const MountPoint&)> stats_fn) noexcept {
-  auto mount_points = filter_interesting_mount_points(get_mount_points());
-  for (const auto& mp : mount_points) {
-    stats_fn(this, mp);
+    std::function<void(Disk*, const MountPoint&, const struct statvfs&)> stats_fn) noexcept {
+  if (mount_table_.changed()) {
+    interesting_mount_points_ = filter_interesting_mount_points(get_mount_points());
+  }
+  statvfs_pool_.stat_all(interesting_mount_points_, absl::Now(), &statvfs_results_);
+  for (size_t i = 0; i < interesting_mount_points_.size(); ++i) {
+    const auto& mp = interesting_mount_points_[i];
+    const auto& result = statvfs_results_[i];
+    switch (result.status) {
+      case StatvfsResult::Status::ok:
+        stats_fn(this, mp, result.st);
+        break;
+      case StatvfsResult::Status::failed:
+        // do not generate warnings for tmpfs mount points. On some systems
+        // we'll get a permission denied error (titusagents) and generate a lot
+        // of noise in the logs
+        if (mp.fs_type != "tmpfs") {
+          Logger()->warn("Unable to statvfs({}) = {}", mp.mount_point, strerror(result.error));
+        }
+        break;
+      case StatvfsResult::Status::timed_out:
+        Logger()->warn("Timed out waiting for statvfs({}), will retry later", mp.mount_point);
+        registry_->GetCounter("disk.statTimeouts",
+                              {{"id", get_id_from_mountpoint(mp.mount_point).c_str()}})
+            ->Increment();
+        break;
+      case StatvfsResult::Status::skipped:
+        Logger()->warn("No thread was available for statvfs({}), will retry later",
+                       mp.mount_point);
+        break;
+      case StatvfsResult::Status::quarantined:
+        break;
+    }
   }
 }
 
@@ -169,54 +202,34 @@ void Disk<Reg>::disk_stats() noexcept {
 
 template <typename Reg>
 void Disk<Reg>::do_disk_stats(absl::Time start) noexcept {
-  stats_for_interesting_mps([](Disk* disk, const MountPoint& mp) { disk->update_stats_for(mp); });
+  stats_for_interesting_mps([](Disk* disk, const MountPoint& mp, const struct statvfs& st) {
+    disk->update_stats_for(mp, st);
+  });
 
   diskio_stats(start);
   last_updated_ = absl::Now();
 }
 
-// parse /proc/diskstats
 template <typename Reg>
-std::vector<DiskIo> Disk<Reg>::get_disk_stats() const noexcept {
-  std::vector<DiskIo> res;
-  std::ostringstream os;
-  os << path_prefix_ << "/proc/diskstats";
-  std::string file_name = os.str();
-  std::ifstream in(file_name);
-
-  if (!in) {
-    Logger()->warn("Unable to open {}", file_name);
-    return res;
-  }
-
-  for (std::string line; std::getline(in, line);) {
-    std::vector<std::string> fields =
-        absl::StrSplit(line, absl::ByAnyChar(" \t"), absl::SkipWhitespace());
-    if (fields.size() < 14) continue;
-    int major = std::stoi(fields[0]);
-    if (major < 0) {
-      break;
+const std::vector<DiskIo>& Disk<Reg>::get_disk_stats() noexcept {
+  auto file_name = fmt::format("{}/proc/diskstats", path_prefix_);
+  if (diskstats_fd_ < 0) {
+    diskstats_fd_.reset(open(file_name.c_str(), O_RDONLY | O_CLOEXEC));
+    if (diskstats_fd_ < 0) {
+      Logger()->warn("Unable to open {}", file_name);
+      disk_io_.clear();
+      return disk_io_;
     }
+  }
 
-    DiskIo diskIo;
-    diskIo.major = major;
-    diskIo.minor = std::stoi(fields[1]);
-    diskIo.device = std::move(fields[2]);
-    diskIo.reads_completed = std::strtoul(fields[3].c_str(), nullptr, 10);
-    diskIo.reads_merged = std::strtoul(fields[4].c_str(), nullptr, 10);
-    diskIo.rsect = std::strtoul(fields[5].c_str(), nullptr, 10);
-    diskIo.ms_reading = std::strtoul(fields[6].c_str(), nullptr, 10);
-    diskIo.writes_completed = std::strtoul(fields[7].c_str(), nullptr, 10);
-    diskIo.writes_merged = std::strtoul(fields[8].c_str(), nullptr, 10);
-    diskIo.wsect = std::strtoul(fields[9].c_str(), nullptr, 10);
-    diskIo.ms_writing = std::strtoul(fields[10].c_str(), nullptr, 10);
-    diskIo.ios_in_progress = std::strtoul(fields[11].c_str(), nullptr, 10);
-    diskIo.ms_doing_io = std::strtoul(fields[12].c_str(), nullptr, 10);
-    diskIo.weighted_ms_doing_io = std::strtoul(fields[13].c_str(), nullptr, 10);
-
-    res.push_back(diskIo);
+  auto len = pread_all(diskstats_fd_, &diskstats_buf_);
+  if (len < 0) {
+    Logger()->warn("Unable to read {}: {}", file_name, strerror(errno));
+    disk_io_.clear();
+    return disk_io_;
   }
-  return res;
+  parse_diskstats(std::string_view{diskstats_buf_.data(), static_cast<size_t>(len)}, &disk_io_);
+  return disk_io_;
 }
 
 inline IdPtr id_for(const char* name, const char* id, const std::string& dev) {
@@ -225,80 +238,157 @@ inline IdPtr id_for(const char* name, const char* id, const std::string& dev) {
 
 static constexpr const char* kRead = "read";
 static constexpr const char* kWrite = "write";
+static constexpr const char* kDiscard = "discard";
+static constexpr const char* kFlush = "flush";
+
+template <typename Reg>
+Disk<Reg>::DeviceIo::DeviceIo(Reg* registry, const std::string& path_prefix, const DiskIo& io,
+                               bool sample_peaks) noexcept
+    : device{io.device},
+      read_bytes{registry->GetMonotonicCounter(id_for("disk.io.bytes", kRead, io.device))},
+      write_bytes{registry->GetMonotonicCounter(id_for("disk.io.bytes", kWrite, io.device))} {
+  if (io.has_discards) {
+    discard_bytes = registry->GetMonotonicCounter(id_for("disk.io.bytes", kDiscard, io.device));
+  }
+  if (io.major == kMultipleDevice) {
+    return;
+  }
+  read_ops.emplace(registry, *id_for("disk.io.ops", kRead, io.device));
+  write_ops.emplace(registry, *id_for("disk.io.ops", kWrite, io.device));
+  if (io.has_discards) {
+    discard_ops.emplace(registry, *id_for("disk.io.ops", kDiscard, io.device));
+  }
+  if (io.has_flushes) {
+    flush_ops.emplace(registry, *id_for("disk.io.ops", kFlush, io.device));
+  }
+  percent_busy = registry->GetGauge("disk.percentBusy", {{"dev", io.device.c_str()}});
+  stat_file.set_path(fmt::format("{}/sys/class/block/{}/stat", path_prefix, io.device));
+  if (!sample_peaks) {
+    return;
+  }
+  peak_queue_depth = registry->GetMaxGauge("disk.io.peakQueueDepth", {{"dev", io.device.c_str()}});
+  peak_service_time =
+      registry->GetMaxGauge("disk.io.peakServiceTime", {{"dev", io.device.c_str()}});
+}
 
 template <typename Reg>
 void Disk<Reg>::diskio_stats(absl::Time start) noexcept {
   const auto& stats = get_disk_stats();
+  ++devices_generation_;
 
   for (const auto& st : stats) {
     if (st.major == kLoopDevice || st.major == kRamDevice) {
       continue;  // ignore loop and ram devices
     }
 
-    registry_->GetMonotonicCounter(id_for("disk.io.bytes", kRead, st.device))->Set(st.rsect * 512);
-    registry_->GetMonotonicCounter(id_for("disk.io.bytes", kWrite, st.device))->Set(st.wsect * 512);
-
-    if (st.major == kMultipleDevice) {
-      continue;  // ignore multiple devices for disk.io.ops and disk.percentBusy - they do not provide timing stats
+    auto it = devices_.find(device_key(st.major, st.minor));
+    if (it != devices_.end() && it->second.device != st.device) {
+      // the numbers were reused for a different device
+      devices_.erase(it);
+      it = devices_.end();
     }
+    if (it == devices_.end()) {
+      it = devices_
+               .try_emplace(device_key(st.major, st.minor), registry_, path_prefix_, st,
+                            is_peak_device(st.device))
+               .first;
+    }
+    auto& dev = it->second;
+    dev.generation = devices_generation_;
 
-    auto mono_read_id = id_for("disk.io.ops", kRead, st.device);
-    auto mono_write_id = id_for("disk.io.ops", kWrite, st.device);
-    auto busy_gauge_id = spectator::Id::of("disk.percentBusy", {{"dev", st.device}});
-
-    std::shared_ptr<MonotonicTimer<Reg>> read_timer;
-    std::shared_ptr<MonotonicTimer<Reg>> write_timer;
-
-    auto it = monotonic_timers_.find(mono_read_id);
-
-    if (it != monotonic_timers_.end()) {
-      read_timer = it->second;
-      write_timer = monotonic_timers_[mono_write_id];
-    } else {
-      read_timer.reset(new MonotonicTimer<Reg>(registry_, *mono_read_id));
-      write_timer.reset(new MonotonicTimer<Reg>(registry_, *mono_write_id));
+    dev.read_bytes->Set(st.rsect * 512);
+    dev.write_bytes->Set(st.wsect * 512);
+    if (dev.discard_bytes && st.has_discards) {
+      dev.discard_bytes->Set(st.dsect * 512);
+    }
 
-      monotonic_timers_[mono_read_id] = read_timer;
-      monotonic_timers_[mono_write_id] = write_timer;
+    if (st.major == kMultipleDevice) {
+      continue;  // ignore multiple devices for disk.io.ops and disk.percentBusy - they do not provide timing stats
     }
 
     auto read_time = absl::Milliseconds(st.ms_reading);
     auto write_time = absl::Milliseconds(st.ms_writing);
-    read_timer->update(read_time, st.reads_completed + st.reads_merged);
-    write_timer->update(write_time, st.writes_completed + st.writes_merged);
+    dev.read_ops->update(read_time, st.reads_completed + st.reads_merged);
+    dev.write_ops->update(write_time, st.writes_completed + st.writes_merged);
+    if (dev.discard_ops && st.has_discards) {
+      dev.discard_ops->update(absl::Milliseconds(st.ms_discarding),
+                              st.discards_completed + st.discards_merged);
+    }
+    if (dev.flush_ops && st.has_flushes) {
+      dev.flush_ops->update(absl::Milliseconds(st.ms_flushing), st.flushes_completed);
+    }
 
-    if (last_updated_ > absl::UnixEpoch()) {
+    if (dev.has_baseline && last_updated_ > absl::UnixEpoch()) {
       auto delta_t = start - last_updated_;
       auto delta_millis = absl::ToInt64Milliseconds(delta_t);
-      auto last_time = last_ms_doing_io[st.device];
-      if (st.ms_doing_io >= last_time) {
-        auto delta_time_doing_io = st.ms_doing_io - last_time;
-        registry_->GetGauge(busy_gauge_id)->Set(100.0 * delta_time_doing_io / delta_millis);
+      if (st.ms_doing_io >= dev.last_ms_doing_io && delta_millis > 0) {
+        auto delta_time_doing_io = st.ms_doing_io - dev.last_ms_doing_io;
+        dev.percent_busy->Set(100.0 * delta_time_doing_io / delta_millis);
       }
     }
+    dev.last_ms_doing_io = st.ms_doing_io;
+    dev.has_baseline = true;
+  }
 
-    last_ms_doing_io[st.device] = st.ms_doing_io;
+  for (auto it = devices_.begin(); it != devices_.end();) {
+    if (it->second.generation != devices_generation_) {
+      it = devices_.erase(it);
+    } else {
+      ++it;
+    }
   }
 }
 
 template <typename Reg>
-void Disk<Reg>::titus_disk_stats() noexcept {
-  stats_for_interesting_mps([](Disk* disk, const MountPoint& mp) { disk->update_stats_for(mp); });
+void Disk<Reg>::peak_stats() noexcept {
+  do_peak_stats(absl::Now());
 }
 
 template <typename Reg>
-void Disk<Reg>::update_stats_for(const MountPoint& mp) noexcept {
-  struct statvfs st;
-  if (statvfs(mp.mount_point.c_str(), &st) != 0) {
-    // do not generate warnings for tmpfs mount points. On some systems
-    // we'll get a permission denied error (titusagents) and generate a lot
-    // of noise in the logs
-    if (mp.fs_type != "tmpfs") {
-      Logger()->warn("Unable to statvfs({}) = {}", mp.mount_point, strerror(errno));
+void Disk<Reg>::do_peak_stats(absl::Time now) noexcept {
+  for (auto& entry : devices_) {
+    auto& dev = entry.second;
+    if (!dev.peak_queue_depth) {
+      continue;  // md devices do not provide timing stats, partitions are not sampled
     }
-    return;
+    BlockStat cur;
+    if (!dev.stat_file.read(&cur)) {
+      continue;
+    }
+
+    const auto& prev = dev.prev_sample;
+    auto delta_ms = absl::ToDoubleMilliseconds(now - dev.prev_sample_time);
+    if (dev.prev_sample_time > absl::UnixEpoch() && delta_ms > 0) {
+      // time_in_queue grows by the number of requests in flight every ms, so its rate is the
+      // average queue depth over the interval. The requests in flight right now are a lower bound
+      if (cur.time_in_queue >= prev.time_in_queue) {
+        auto avg_depth = static_cast<double>(cur.time_in_queue - prev.time_in_queue) / delta_ms;
+        dev.peak_queue_depth->Set(std::max(avg_depth, static_cast<double>(cur.in_flight)));
+      }
+
+      auto cur_ios = cur.read_ios + cur.write_ios;
+      auto prev_ios = prev.read_ios + prev.write_ios;
+      auto cur_ticks = cur.read_ticks + cur.write_ticks;
+      auto prev_ticks = prev.read_ticks + prev.write_ticks;
+      if (cur_ios > prev_ios && cur_ticks >= prev_ticks) {
+        auto avg_ms = static_cast<double>(cur_ticks - prev_ticks) / (cur_ios - prev_ios);
+        dev.peak_service_time->Set(avg_ms / 1000.0);
+      }
+    }
+    dev.prev_sample = cur;
+    dev.prev_sample_time = now;
   }
+}
+
+template <typename Reg>
+void Disk<Reg>::titus_disk_stats() noexcept {
+  stats_for_interesting_mps([](Disk* disk, const MountPoint& mp, const struct statvfs& st) {
+    disk->update_stats_for(mp, st);
+  });
+}
 
+template <typename Reg>
+void Disk<Reg>::update_stats_for(const MountPoint& mp, const struct statvfs& st) noexcept {
   auto id = get_id_from_mountpoint(mp.mount_point);
   Tags tags{{"id", id.c_str()}, {"dev", get_dev_from_device(mp.device).c_str()}};
 
@@ -324,6 +414,12 @@ void Disk<Reg>::update_stats_for(const MountPoint& mp) noexcept {
 template <typename Reg>
 void Disk<Reg>::set_prefix(const std::string& new_prefix) noexcept {
   path_prefix_ = new_prefix;
+  mount_table_.set_file_name(fmt::format("{}/proc/self/mountinfo", path_prefix_));
+  diskstats_fd_.reset();
+  for (auto& entry : devices_) {
+    entry.second.stat_file.set_path(
+        fmt::format("{}/sys/class/block/{}/stat", path_prefix_, entry.second.device));
+  }
 }
 
 }  // namespace atlasagent
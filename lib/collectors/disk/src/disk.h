@@ -1,7 +1,12 @@
 #pragma once
 
+#include "block_stat.h"
+#include "diskstats.h"
+#include "mount_info.h"
+#include "statvfs_pool.h"
 #include <lib/monotonic_timer/src/monotonic_timer.h>
 #include <lib/tagging/src/tagging_registry.h>
+#include <optional>
 #include <string>
 #include <sys/types.h>
 #include <fmt/format.h>
@@ -10,63 +15,98 @@
 #include <unordered_set>
 
 namespace atlasagent {
-struct MountPoint {
-  unsigned device_major;
-  unsigned device_minor;
-  std::string mount_point;
-  std::string device;
-  std::string fs_type;
-};
 
-struct DiskIo {
-  int major;
-  int minor;
-  std::string device;
-  u_long reads_completed;
-  u_long reads_merged;
-  u_long rsect;
-  u_long ms_reading;
-  u_long writes_completed;
-  u_long writes_merged;
-  u_long wsect;
-  u_long ms_writing;
-  u_long ios_in_progress;
-  u_long ms_doing_io;
-  u_long weighted_ms_doing_io;
-};
+// (major, minor) identifies a block device
+inline uint64_t device_key(int major, int minor) noexcept {
+  return static_cast<uint64_t>(major) << 32u | static_cast<uint32_t>(minor);
+}
 
 // Helper functions
 std::unordered_set<std::string> get_nodev_filesystems(const std::string& prefix);
 std::string get_id_from_mountpoint(const std::string& mp);
 std::string get_dev_from_device(const std::string& device);
+// whether the block device is a whole disk, and not a partition or a device-mapper volume
+// stacked on top of one
+bool is_whole_disk(const std::string& prefix, const std::string& dev);
+// devices listed in ATLAS_DISK_PEAK_DEVICES (comma separated), empty if not set
+std::vector<std::string> disk_peak_devices();
 
 template <typename Reg = TaggingRegistry>
 class Disk {
  public:
   explicit Disk(Reg* registry, std::string path_prefix = "") noexcept
-      : registry_(registry), path_prefix_(std::move(path_prefix)) {}
+      : registry_(registry),
+        path_prefix_(std::move(path_prefix)),
+        peak_devices_{disk_peak_devices()},
+        mount_table_{fmt::format("{}/proc/self/mountinfo", path_prefix_)} {}
   void titus_disk_stats() noexcept;
   void disk_stats() noexcept;
+  // sampled every second for the devices found by disk_stats. Only whole disks are sampled,
+  // unless ATLAS_DISK_PEAK_DEVICES lists the devices to use
+  void peak_stats() noexcept;
   void set_prefix(const std::string& new_prefix) noexcept;  // for testing
  private:
   Reg* registry_;
   std::string path_prefix_;
   absl::Time last_updated_{absl::UnixEpoch()};
-  std::unordered_map<std::string, u_long> last_ms_doing_io{};
-  std::unordered_map<spectator::IdPtr, std::shared_ptr<MonotonicTimer<Reg>>> monotonic_timers_{};
+  // per device state for /proc/diskstats, with the meters looked up once per device
+  struct DeviceIo {
+    DeviceIo(Reg* registry, const std::string& path_prefix, const DiskIo& io,
+             bool sample_peaks) noexcept;
+    std::string device;
+    typename Reg::monotonic_counter_ptr read_bytes;
+    typename Reg::monotonic_counter_ptr write_bytes;
+    // not present for md devices, which do not provide timing stats
+    std::optional<MonotonicTimer<Reg>> read_ops;
+    std::optional<MonotonicTimer<Reg>> write_ops;
+    // only on kernels that report them
+    typename Reg::monotonic_counter_ptr discard_bytes;
+    std::optional<MonotonicTimer<Reg>> discard_ops;
+    std::optional<MonotonicTimer<Reg>> flush_ops;
+    typename Reg::gauge_ptr percent_busy;
+    u_long last_ms_doing_io{0};
+    bool has_baseline{false};
+    uint32_t generation{0};
+    // for peak_stats, the gauges are null for devices that are not sampled
+    BlockStatFile stat_file;
+    BlockStat prev_sample;
+    absl::Time prev_sample_time{absl::UnixEpoch()};
+    typename Reg::max_gauge_ptr peak_queue_depth;
+    typename Reg::max_gauge_ptr peak_service_time;
+  };
+  // devices come and go (EBS volumes, dm devices), the ones not present in the last
+  // /proc/diskstats are removed
+  std::unordered_map<uint64_t, DeviceIo> devices_;
+  UnixFile diskstats_fd_{-1};
+  std::vector<char> diskstats_buf_;
+  std::vector<DiskIo> disk_io_;
+  uint32_t devices_generation_{0};
+  // allow-list for peak_stats, whole disks are sampled when empty
+  std::vector<std::string> peak_devices_;
+  // the mount points are only parsed again when the mount table changes
+  MountTableWatcher mount_table_;
+  std::vector<MountPoint> interesting_mount_points_;
+  // statvfs can hang on network filesystems, so it doesn't run on the collection thread
+  StatvfsPool statvfs_pool_;
+  std::vector<StatvfsResult> statvfs_results_;
 
  protected:
   // protected for testing
   void do_disk_stats(absl::Time start) noexcept;
-  void stats_for_interesting_mps(std::function<void(Disk*, const MountPoint&)> stats_fn) noexcept;
+  void stats_for_interesting_mps(
+      std::function<void(Disk*, const MountPoint&, const struct statvfs&)> stats_fn) noexcept;
   [[nodiscard]] std::vector<MountPoint> filter_interesting_mount_points(
       const std::vector<MountPoint>& mount_points) const noexcept;
   [[nodiscard]] std::vector<MountPoint> get_mount_points() const noexcept;
-  [[nodiscard]] std::vector<DiskIo> get_disk_stats() const noexcept;
+  // parse /proc/diskstats, the result is valid until the next call
+  const std::vector<DiskIo>& get_disk_stats() noexcept;
   void update_titus_stats_for(const MountPoint& mp) noexcept;
-  void update_stats_for(const MountPoint& mp) noexcept;
+  void update_stats_for(const MountPoint& mp, const struct statvfs& st) noexcept;
 
   void diskio_stats(absl::Time start) noexcept;
+  void do_peak_stats(absl::Time now) noexcept;
+  [[nodiscard]] bool is_peak_device(const std::string& dev) const noexcept;
+  [[nodiscard]] size_t num_devices() const noexcept { return devices_.size(); }
   void set_last_updated(absl::Time updated) { last_updated_ = updated; }
 };
 
@@ -0,0 +1,90 @@
+#include "diskstats.h"
+#include <cstring>
+
+namespace atlasagent {
+
+namespace {
+constexpr size_t kMinCounters = 11;
+constexpr size_t kDiscardCounters = 15;
+constexpr size_t kFlushCounters = 17;
+
+inline void skip_spaces(const char** p, const char* end) noexcept {
+  while (*p < end && (**p == ' ' || **p == '\t')) {
+    ++*p;
+  }
+}
+
+// returns false if there's no number at *p
+inline bool parse_number(const char** p, const char* end, u_long* n) noexcept {
+  skip_spaces(p, end);
+  auto start = *p;
+  u_long value = 0;
+  for (; *p < end && **p >= '0' && **p <= '9'; ++*p) {
+    value = value * 10 + static_cast<u_long>(**p - '0');
+  }
+  *n = value;
+  return *p != start;
+}
+}  // namespace
+
+void parse_diskstats(std::string_view contents, std::vector<DiskIo>* stats) noexcept {
+  size_t num_stats = 0;
+  auto p = contents.data();
+  auto end = p + contents.size();
+  while (p < end) {
+    auto nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+    auto line_end = nl == nullptr ? end : nl;
+
+    //   202       0 xvda 18349 1 860002 124732 19234 23547 ...
+    u_long major = 0, minor = 0;
+    auto ok = parse_number(&p, line_end, &major) && parse_number(&p, line_end, &minor);
+    skip_spaces(&p, line_end);
+    auto name = p;
+    while (p < line_end && *p != ' ' && *p != '\t') {
+      ++p;
+    }
+    std::string_view device{name, static_cast<size_t>(p - name)};
+
+    u_long counters[kFlushCounters];
+    size_t num_counters = 0;
+    while (num_counters < kFlushCounters && parse_number(&p, line_end, &counters[num_counters])) {
+      ++num_counters;
+    }
+    p = line_end + 1;
+    if (!ok || device.empty() || num_counters < kMinCounters) {
+      continue;
+    }
+
+    if (num_stats == stats->size()) {
+      stats->emplace_back();
+    }
+    auto& io = (*stats)[num_stats++];
+    io.major = static_cast<int>(major);
+    io.minor = static_cast<int>(minor);
+    io.device.assign(device.data(), device.size());
+    io.reads_completed = counters[0];
+    io.reads_merged = counters[1];
+    io.rsect = counters[2];
+    io.ms_reading = counters[3];
+    io.writes_completed = counters[4];
+    io.writes_merged = counters[5];
+    io.wsect = counters[6];
+    io.ms_writing = counters[7];
+    io.ios_in_progress = counters[8];
+    io.ms_doing_io = counters[9];
+    io.weighted_ms_doing_io = counters[10];
+
+    io.has_discards = num_counters >= kDiscardCounters;
+    io.discards_completed = io.has_discards ? counters[11] : 0;
+    io.discards_merged = io.has_discards ? counters[12] : 0;
+    io.dsect = io.has_discards ? counters[13] : 0;
+    io.ms_discarding = io.has_discards ? counters[14] : 0;
+
+    io.has_flushes = num_counters >= kFlushCounters;
+    io.flushes_completed = io.has_flushes ? counters[15] : 0;
+    io.ms_flushing = io.has_flushes ? counters[16] : 0;
+  }
+  stats->resize(num_stats);
+}
+
+}  // namespace atlasagent
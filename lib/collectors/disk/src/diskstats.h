@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+namespace atlasagent {
+
+// one line of /proc/diskstats, see Documentation/admin-guide/iostats.rst
+struct DiskIo {
+  int major;
+  int minor;
+  std::string device;
+  u_long reads_completed;
+  u_long reads_merged;
+  u_long rsect;
+  u_long ms_reading;
+  u_long writes_completed;
+  u_long writes_merged;
+  u_long wsect;
+  u_long ms_writing;
+  u_long ios_in_progress;
+  u_long ms_doing_io;
+  u_long weighted_ms_doing_io;
+  // since 4.18
+  bool has_discards;
+  u_long discards_completed;
+  u_long discards_merged;
+  u_long dsect;
+  u_long ms_discarding;
+  // since 5.5
+  bool has_flushes;
+  u_long flushes_completed;
+  u_long ms_flushing;
+};
+
+// parse the contents of /proc/diskstats into stats, one entry per device. The entries are
+// reused when stats already has elements, so parsing every minute does not allocate once
+// the device names fit
+void parse_diskstats(std::string_view contents, std::vector<DiskIo>* stats) noexcept;
+
+}  // namespace atlasagent
@@ -0,0 +1,98 @@
+#include "mount_info.h"
+#include <poll.h>
+
+namespace atlasagent {
+
+namespace {
+// returns the next space separated field of line, advancing it past the field
+inline std::string_view next_field(std::string_view* line) noexcept {
+  auto start = line->find_first_not_of(' ');
+  if (start == std::string_view::npos) {
+    *line = {};
+    return {};
+  }
+  auto end = line->find(' ', start);
+  auto field = line->substr(start, end == std::string_view::npos ? end : end - start);
+  line->remove_prefix(end == std::string_view::npos ? line->size() : end);
+  return field;
+}
+
+inline unsigned to_unsigned(std::string_view s) noexcept {
+  unsigned n = 0;
+  for (auto c : s) {
+    if (c < '0' || c > '9') {
+      break;
+    }
+    n = n * 10 + static_cast<unsigned>(c - '0');
+  }
+  return n;
+}
+}  // namespace
+
+// 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+// (1)(2)(3)   (4)   (5)      (6)      (7)   (8) (9)   (10)         (11)
+// where (7) is a variable number of optional fields terminated by the separator (8)
+void parse_mountinfo(std::string_view contents, const std::unordered_set<std::string>& unwanted_fs,
+                     std::vector<MountPoint>* mount_points) noexcept {
+  while (!contents.empty()) {
+    auto nl = contents.find('\n');
+    auto line = contents.substr(0, nl);
+    contents.remove_prefix(nl == std::string_view::npos ? contents.size() : nl + 1);
+
+    next_field(&line);  // mount id
+    next_field(&line);  // parent id
+    auto dev = next_field(&line);
+    auto root = next_field(&line);
+    // we only concern ourselves with root = /
+    if (root != "/") {
+      continue;
+    }
+    auto mount_point = next_field(&line);
+    std::string_view field;
+    do {
+      field = next_field(&line);
+    } while (!field.empty() && field != "-");
+    auto fs_type = next_field(&line);
+    auto device = next_field(&line);
+    auto colon = dev.find(':');
+    if (fs_type.empty() || colon == std::string_view::npos) {
+      continue;
+    }
+
+    std::string fs{fs_type};
+    if (unwanted_fs.find(fs) != unwanted_fs.end()) {
+      continue;
+    }
+    auto& mp = mount_points->emplace_back();
+    mp.device_major = to_unsigned(dev.substr(0, colon));
+    mp.device_minor = to_unsigned(dev.substr(colon + 1));
+    mp.mount_point.assign(mount_point.data(), mount_point.size());
+    mp.device.assign(device.data(), device.size());
+    mp.fs_type = std::move(fs);
+  }
+}
+
+void MountTableWatcher::set_file_name(std::string file_name) noexcept {
+  file_name_ = std::move(file_name);
+  fd_.reset();
+}
+
+bool MountTableWatcher::changed() noexcept {
+  if (fd_ < 0) {
+    // the state of the mount table is recorded when the file is opened
+    fd_.reset(open(file_name_.c_str(), O_RDONLY | O_CLOEXEC));
+    return true;
+  }
+
+  struct pollfd pfd {};
+  pfd.fd = fd_;
+  pfd.events = POLLPRI;
+  auto n = poll(&pfd, 1, 0);
+  if (n < 0) {
+    Logger()->warn("Unable to poll {}: {}", file_name_, strerror(errno));
+    return true;
+  }
+  return n > 0 && (pfd.revents & (POLLPRI | POLLERR)) != 0;
+}
+
+}  // namespace atlasagent
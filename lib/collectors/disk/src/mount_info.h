@@ -0,0 +1,41 @@
+#pragma once
+
+#include <lib/files/src/files.h>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace atlasagent {
+struct MountPoint {
+  unsigned device_major;
+  unsigned device_minor;
+  std::string mount_point;
+  std::string device;
+  std::string fs_type;
+};
+
+// parse the contents of a mountinfo file in a single pass. Only mounts of the root of a
+// filesystem are kept, and filesystem types in unwanted_fs are skipped
+void parse_mountinfo(std::string_view contents, const std::unordered_set<std::string>& unwanted_fs,
+                     std::vector<MountPoint>* mount_points) noexcept;
+
+/// Detects changes to the mount table. The kernel flags an open mountinfo file with
+/// POLLPRI | POLLERR whenever a filesystem is mounted or unmounted in its namespace, so the
+/// file only needs to be parsed again after that happens.
+class MountTableWatcher {
+ public:
+  explicit MountTableWatcher(std::string file_name) noexcept : file_name_{std::move(file_name)} {}
+
+  void set_file_name(std::string file_name) noexcept;
+
+  // true on the first call, and when the mount table changed since the previous call. If
+  // the file can't be watched it always returns true
+  bool changed() noexcept;
+
+ private:
+  std::string file_name_;
+  UnixFile fd_{-1};
+};
+
+}  // namespace atlasagent
@@ -0,0 +1,121 @@
+#include "statvfs_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace atlasagent {
+
+StatvfsPool::StatvfsPool(absl::Duration timeout, size_t max_threads, stat_fn_t stat_fn) noexcept
+    : timeout_{timeout},
+      max_threads_{max_threads},
+      stat_fn_{stat_fn},
+      state_{std::make_shared<State>()} {}
+
+StatvfsPool::~StatvfsPool() {
+  std::lock_guard<std::mutex> lock{state_->mutex};
+  state_->stop = true;
+  state_->work_cv.notify_all();
+}
+
+void StatvfsPool::run(std::shared_ptr<State> state, stat_fn_t stat_fn) noexcept {
+  std::unique_lock<std::mutex> lock{state->mutex};
+  for (;;) {
+    state->work_cv.wait(lock, [&] { return state->stop || !state->queue.empty(); });
+    if (state->stop) {
+      --state->num_threads;
+      return;
+    }
+    auto job = std::move(state->queue.front());
+    state->queue.pop_front();
+    job->started = true;
+    ++state->num_busy;
+
+    lock.unlock();
+    struct statvfs st {};
+    auto error = stat_fn(job->path.c_str(), &st) == 0 ? 0 : errno;
+    lock.lock();
+
+    --state->num_busy;
+    if (job->abandoned) {
+      --state->num_stuck;
+    }
+    job->st = st;
+    job->error = error;
+    job->done = true;
+    state->done_cv.notify_all();
+  }
+}
+
+void StatvfsPool::stat_all(const std::vector<MountPoint>& mount_points, absl::Time now,
+                           std::vector<StatvfsResult>* results) noexcept {
+  results->assign(mount_points.size(), StatvfsResult{StatvfsResult::Status::quarantined, 0, {}});
+  jobs_.assign(mount_points.size(), nullptr);
+
+  {
+    std::lock_guard<std::mutex> lock{state_->mutex};
+    for (size_t i = 0; i < mount_points.size(); ++i) {
+      const auto& path = mount_points[i].mount_point;
+      auto it = quarantine_.find(path);
+      if (it != quarantine_.end()) {
+        // one call at a time for a quarantined mount
+        if (!it->second.pending->done || now < it->second.retry_at) {
+          continue;
+        }
+      }
+      auto job = std::make_shared<Job>();
+      job->path = path;
+      state_->queue.push_back(job);
+      jobs_[i] = std::move(job);
+    }
+
+    // threads stuck on a previous batch are busy, so more might be needed. They are not
+    // counted towards the limit, or a few hung mounts would leave none for the healthy ones
+    while (state_->num_threads - state_->num_stuck < max_threads_ &&
+           state_->num_threads - state_->num_busy < state_->queue.size()) {
+      ++state_->num_threads;
+      std::thread{run, state_, stat_fn_}.detach();
+    }
+    state_->work_cv.notify_all();
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + absl::ToChronoNanoseconds(timeout_);
+  std::unique_lock<std::mutex> lock{state_->mutex};
+  state_->done_cv.wait_until(lock, deadline, [&] {
+    return std::all_of(jobs_.begin(), jobs_.end(),
+                       [](const std::shared_ptr<Job>& job) { return !job || job->done; });
+  });
+
+  for (size_t i = 0; i < mount_points.size(); ++i) {
+    auto& job = jobs_[i];
+    if (!job) {
+      continue;
+    }
+    auto& result = (*results)[i];
+    const auto& path = mount_points[i].mount_point;
+    if (job->done) {
+      result.status = job->error == 0 ? StatvfsResult::Status::ok : StatvfsResult::Status::failed;
+      result.error = job->error;
+      result.st = job->st;
+      quarantine_.erase(path);
+      continue;
+    }
+
+    if (!job->started) {
+      // the mount was not the problem, it just did not get a thread in time
+      state_->queue.erase(std::find(state_->queue.begin(), state_->queue.end(), job));
+      result.status = StatvfsResult::Status::skipped;
+      continue;
+    }
+
+    result.status = StatvfsResult::Status::timed_out;
+    job->abandoned = true;
+    ++state_->num_stuck;
+    auto& q = quarantine_[path];
+    q.backoff = q.pending ? std::min(q.backoff * 2, kMaxBackoff) : kInitialBackoff;
+    q.retry_at = now + q.backoff;
+    q.pending = std::move(job);
+  }
+  jobs_.clear();
+}
+
+}  // namespace atlasagent
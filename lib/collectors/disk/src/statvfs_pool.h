@@ -0,0 +1,90 @@
+#pragma once
+
+#include "mount_info.h"
+#include <absl/time/time.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sys/statvfs.h>
+#include <unordered_map>
+
+namespace atlasagent {
+
+struct StatvfsResult {
+  // skipped: no thread picked it up before the deadline, it is tried again on the next batch
+  enum class Status { ok, failed, timed_out, quarantined, skipped };
+  Status status;
+  // errno when failed
+  int error;
+  struct statvfs st;
+};
+
+/// Runs statvfs for a set of mount points on helper threads, so a mount that does not respond
+/// (a hung NFS server, for example) only delays its own metrics instead of the whole agent.
+///
+/// Every batch shares a single deadline. A mount that does not answer in time is quarantined:
+/// it is skipped until its pending call returns and a backoff period has passed, which doubles
+/// every time it times out again. Threads are started on demand up to max_threads, and a
+/// thread stuck in the kernel is simply left behind, since it can't be interrupted. Those
+/// threads do not count towards max_threads, there is at most one per quarantined mount.
+class StatvfsPool {
+ public:
+  using stat_fn_t = int (*)(const char*, struct statvfs*);
+
+  explicit StatvfsPool(absl::Duration timeout = absl::Milliseconds(500), size_t max_threads = 8,
+                       stat_fn_t stat_fn = ::statvfs) noexcept;
+  StatvfsPool(const StatvfsPool&) = delete;
+  ~StatvfsPool();
+
+  // stat all the mount points, results are in the same order as mount_points
+  void stat_all(const std::vector<MountPoint>& mount_points, absl::Time now,
+                std::vector<StatvfsResult>* results) noexcept;
+
+  [[nodiscard]] size_t num_quarantined() const noexcept { return quarantine_.size(); }
+
+  static constexpr absl::Duration kInitialBackoff = absl::Minutes(1);
+  static constexpr absl::Duration kMaxBackoff = absl::Minutes(32);
+
+ private:
+  struct Job {
+    std::string path;
+    bool started{false};
+    // the batch gave up on it while its thread was in statvfs
+    bool abandoned{false};
+    bool done{false};
+    int error{0};
+    struct statvfs st {};
+  };
+
+  // shared with the threads, which can outlive the pool while stuck in statvfs
+  struct State {
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::deque<std::shared_ptr<Job>> queue;
+    size_t num_threads{0};
+    // threads in the middle of a call
+    size_t num_busy{0};
+    // busy threads whose call took longer than the timeout
+    size_t num_stuck{0};
+    bool stop{false};
+  };
+
+  struct Quarantined {
+    std::shared_ptr<Job> pending;
+    absl::Time retry_at;
+    absl::Duration backoff;
+  };
+
+  absl::Duration timeout_;
+  size_t max_threads_;
+  stat_fn_t stat_fn_;
+  std::shared_ptr<State> state_;
+  std::unordered_map<std::string, Quarantined> quarantine_;
+  std::vector<std::shared_ptr<Job>> jobs_;
+
+  static void run(std::shared_ptr<State> state, stat_fn_t stat_fn) noexcept;
+};
+
+}  // namespace atlasagent
@@ -2,6 +2,7 @@
 #include <lib/logger/src/logger.h>
 #include <lib/measurement_utils/src/measurement_utils.h>
 #include <gtest/gtest.h>
+#include <thread>
 #include <unordered_set>
 
 namespace {
@@ -28,12 +29,16 @@ class TestDisk : public atlasagent::Disk<Registry> {
 
   std::vector<MountPoint> get_mount_points() const noexcept { return Disk::get_mount_points(); }
 
-  std::vector<DiskIo> get_disk_stats() const noexcept { return Disk::get_disk_stats(); }
+  const std::vector<DiskIo>& get_disk_stats() noexcept { return Disk::get_disk_stats(); }
 
   void update_titus_stats_for(const MountPoint& mp) noexcept { Disk::update_titus_stats_for(mp); }
 
   void diskio_stats(absl::Time start) noexcept { Disk::diskio_stats(start); }
 
+  size_t num_devices() const noexcept { return Disk::num_devices(); }
+
+  void do_peak_stats(absl::Time now) noexcept { Disk::do_peak_stats(now); }
+
   void do_disk_stats(absl::Time start) noexcept { Disk::do_disk_stats(start); }
 };
 
@@ -58,6 +63,118 @@ TEST(Disk, MountPoints) {
 }
 
 
+TEST(Disk, ParseMountInfo) {
+  std::string contents =
+      "36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue\n"
+      "22 1 202:1 / / rw,relatime shared:1 master:2 - ext4 /dev/xvda1 rw\n"
+      "23 22 0:21 / /proc rw,nosuid - proc proc rw\n"
+      "24 22 259:0 / /mnt rw - xfs /dev/nvme0n1 rw\n";
+  std::vector<MountPoint> mount_points;
+  atlasagent::parse_mountinfo(contents, {"proc"}, &mount_points);
+  ASSERT_EQ(mount_points.size(), 2);
+  EXPECT_EQ(mount_points[0].device_major, 202);
+  EXPECT_EQ(mount_points[0].device_minor, 1);
+  EXPECT_EQ(mount_points[0].mount_point, "/");
+  EXPECT_EQ(mount_points[0].device, "/dev/xvda1");
+  EXPECT_EQ(mount_points[0].fs_type, "ext4");
+  EXPECT_EQ(mount_points[1].device_major, 259);
+  EXPECT_EQ(mount_points[1].mount_point, "/mnt");
+  EXPECT_EQ(mount_points[1].fs_type, "xfs");
+}
+
+TEST(Disk, MountTableWatcher) {
+  atlasagent::MountTableWatcher watcher{"testdata/resources/proc/self/mountinfo"};
+  // the first call always needs to parse the mount table
+  EXPECT_TRUE(watcher.changed());
+  // a regular file never signals changes
+  EXPECT_FALSE(watcher.changed());
+  watcher.set_file_name("testdata/resources2/proc/self/mountinfo");
+  EXPECT_TRUE(watcher.changed());
+
+  atlasagent::MountTableWatcher self{"/proc/self/mountinfo"};
+  EXPECT_TRUE(self.changed());
+  EXPECT_FALSE(self.changed());
+}
+
+// hangs on mount points under /hung for longer than the pool timeout
+int slow_statvfs(const char* path, struct statvfs* st) {
+  if (strncmp(path, "/hung", 5) == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    errno = EIO;
+    return -1;
+  }
+  memset(st, 0, sizeof *st);
+  st->f_blocks = 100;
+  return 0;
+}
+
+TEST(Disk, StatvfsPool) {
+  using Status = atlasagent::StatvfsResult::Status;
+  using atlasagent::StatvfsPool;
+  StatvfsPool pool{absl::Milliseconds(50), 4, slow_statvfs};
+  std::vector<MountPoint> mount_points(3);
+  mount_points[0].mount_point = "/";
+  mount_points[1].mount_point = "/hung/nfs";
+  mount_points[2].mount_point = "/mnt";
+
+  std::vector<atlasagent::StatvfsResult> results;
+  auto now = absl::Now();
+  pool.stat_all(mount_points, now, &results);
+  ASSERT_EQ(results.size(), 3);
+  EXPECT_EQ(results[0].status, Status::ok);
+  EXPECT_EQ(results[0].st.f_blocks, 100);
+  EXPECT_EQ(results[1].status, Status::timed_out);
+  EXPECT_EQ(results[2].status, Status::ok);
+  EXPECT_EQ(pool.num_quarantined(), 1);
+
+  // skipped until the backoff expires, without delaying the others
+  pool.stat_all(mount_points, now + absl::Seconds(30), &results);
+  EXPECT_EQ(results[0].status, Status::ok);
+  EXPECT_EQ(results[1].status, Status::quarantined);
+  EXPECT_EQ(results[2].status, Status::ok);
+
+  // retried once the pending call finished and the backoff expired
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  pool.stat_all(mount_points, now + StatvfsPool::kInitialBackoff, &results);
+  EXPECT_EQ(results[1].status, Status::timed_out);
+  EXPECT_EQ(pool.num_quarantined(), 1);
+  // the backoff doubled
+  pool.stat_all(mount_points, now + 2 * StatvfsPool::kInitialBackoff, &results);
+  EXPECT_EQ(results[1].status, Status::quarantined);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  pool.stat_all(mount_points, now + 3 * StatvfsPool::kInitialBackoff, &results);
+  EXPECT_EQ(results[1].status, Status::timed_out);
+}
+
+TEST(Disk, StatvfsPoolHungThreads) {
+  using Status = atlasagent::StatvfsResult::Status;
+  using atlasagent::StatvfsPool;
+  StatvfsPool pool{absl::Milliseconds(50), 2, slow_statvfs};
+  std::vector<MountPoint> mount_points(4);
+  mount_points[0].mount_point = "/hung/a";
+  mount_points[1].mount_point = "/hung/b";
+  mount_points[2].mount_point = "/";
+  mount_points[3].mount_point = "/mnt";
+
+  // the hung mounts take both threads, the others never start and are not quarantined
+  std::vector<atlasagent::StatvfsResult> results;
+  auto now = absl::Now();
+  pool.stat_all(mount_points, now, &results);
+  EXPECT_EQ(results[0].status, Status::timed_out);
+  EXPECT_EQ(results[1].status, Status::timed_out);
+  EXPECT_EQ(results[2].status, Status::skipped);
+  EXPECT_EQ(results[3].status, Status::skipped);
+  EXPECT_EQ(pool.num_quarantined(), 2);
+
+  // the stuck threads do not count towards the limit
+  pool.stat_all(mount_points, now + absl::Seconds(1), &results);
+  EXPECT_EQ(results[0].status, Status::quarantined);
+  EXPECT_EQ(results[1].status, Status::quarantined);
+  EXPECT_EQ(results[2].status, Status::ok);
+  EXPECT_EQ(results[3].status, Status::ok);
+}
+
 TEST(Disk, id) {
   using atlasagent::get_id_from_mountpoint;
   EXPECT_EQ(std::string("root"), get_id_from_mountpoint("/"));
@@ -181,4 +298,150 @@ TEST(Disk, diskio_stats) {
   expect_value(&values, "disk.io.ops|totalTime|write|xvdc", 0.028);
   EXPECT_TRUE(values.empty());
 }
+TEST(Disk, DevicesRemoved) {
+  Registry registry;
+  TestDisk disk(&registry);
+
+  auto start = absl::Now();
+  disk.diskio_stats(start);
+  disk.set_last_updated(start);
+  // xvda, xvdb, xvdc and md0, loop and ram devices are ignored
+  EXPECT_EQ(disk.num_devices(), 4);
+
+  // all devices went away
+  disk.set_prefix("testdata/nonexistent");
+  disk.diskio_stats(start + absl::Seconds(60));
+  EXPECT_EQ(disk.num_devices(), 0);
+  my_measurements(&registry);
+
+  // they are new again, so there's no baseline for the busy time
+  disk.set_prefix("testdata/resources2");
+  disk.diskio_stats(start + absl::Seconds(120));
+  EXPECT_EQ(disk.num_devices(), 4);
+  auto values = measurements_to_map(my_measurements(&registry), "dev");
+  for (const auto& pair : values) {
+    EXPECT_EQ(pair.first.rfind("disk.percentBusy", 0), std::string::npos) << pair.first;
+  }
+}
+TEST(Disk, ParseBlockStat) {
+  std::string line =
+      "   18349        1   860002   124732    19234    23547   670256   171656        2     1000  "
+      "   1000        0        0        0        0        0        0\n";
+  atlasagent::BlockStat stat;
+  ASSERT_TRUE(atlasagent::parse_block_stat(line.data(), line.data() + line.size(), &stat));
+  EXPECT_EQ(stat.read_ios, 18349);
+  EXPECT_EQ(stat.read_ticks, 124732);
+  EXPECT_EQ(stat.write_ios, 19234);
+  EXPECT_EQ(stat.write_ticks, 171656);
+  EXPECT_EQ(stat.in_flight, 2);
+  EXPECT_EQ(stat.io_ticks, 1000);
+  EXPECT_EQ(stat.time_in_queue, 1000);
+
+  std::string truncated = "   18349        1   860002";
+  EXPECT_FALSE(
+      atlasagent::parse_block_stat(truncated.data(), truncated.data() + truncated.size(), &stat));
+}
+
+TEST(Disk, PeakStats) {
+  Registry registry;
+  TestDisk disk(&registry);
+
+  auto start = absl::Now();
+  disk.diskio_stats(start);
+  disk.do_peak_stats(start);
+  my_measurements(&registry);
+
+  disk.set_prefix("testdata/resources2");
+  disk.do_peak_stats(start + absl::Seconds(1));
+  auto values = measurements_to_map(my_measurements(&registry), "dev");
+  // 5000ms in the queue during one second, higher than the 3 requests in flight
+  expect_value(&values, "disk.io.peakQueueDepth|max|xvda", 5);
+  // 40 requests taking 160ms
+  expect_value(&values, "disk.io.peakServiceTime|max|xvda", 0.004);
+  // no requests completed, but 7 are in flight
+  expect_value(&values, "disk.io.peakQueueDepth|max|xvdb", 7);
+  // xvdc went away
+  EXPECT_TRUE(values.empty());
+}
+
+TEST(Disk, PeakDevices) {
+  EXPECT_TRUE(atlasagent::is_whole_disk("testdata/resources", "xvda"));
+  EXPECT_FALSE(atlasagent::is_whole_disk("testdata/resources", "xvda1"));
+  EXPECT_FALSE(atlasagent::is_whole_disk("testdata/resources", "dm-0"));
+
+  setenv("ATLAS_DISK_PEAK_DEVICES", "xvdb,nvme0n1", 1);
+  Registry registry;
+  TestDisk disk(&registry);
+  unsetenv("ATLAS_DISK_PEAK_DEVICES");
+
+  auto start = absl::Now();
+  disk.diskio_stats(start);
+  disk.do_peak_stats(start);
+  my_measurements(&registry);
+
+  disk.set_prefix("testdata/resources2");
+  disk.do_peak_stats(start + absl::Seconds(1));
+  auto values = measurements_to_map(my_measurements(&registry), "dev");
+  // xvda is not in the list
+  expect_value(&values, "disk.io.peakQueueDepth|max|xvdb", 7);
+  EXPECT_TRUE(values.empty());
+}
+TEST(Disk, ParseDiskStats) {
+  std::string contents =
+      "   7       0 loop0 0 0 0 0 0 0 0 0 0 0 0\n"
+      " 259       0 nvme0n1 100 1 2000 30 200 2 4000 60 1 80 90 10 0 800 5 20 8\n"
+      " 259       1 nvme0n1p1 100 1 2000 30 200 2 4000 60 1 80 90 10 0 800 5\n"
+      " 202       0 truncated 1 2 3\n";
+  std::vector<DiskIo> stats;
+  atlasagent::parse_diskstats(contents, &stats);
+  ASSERT_EQ(stats.size(), 3);
+
+  EXPECT_EQ(stats[0].device, "loop0");
+  EXPECT_FALSE(stats[0].has_discards);
+  EXPECT_FALSE(stats[0].has_flushes);
+
+  const auto& nvme = stats[1];
+  EXPECT_EQ(nvme.major, 259);
+  EXPECT_EQ(nvme.minor, 0);
+  EXPECT_EQ(nvme.device, "nvme0n1");
+  EXPECT_EQ(nvme.reads_completed, 100);
+  EXPECT_EQ(nvme.ms_writing, 60);
+  EXPECT_EQ(nvme.weighted_ms_doing_io, 90);
+  EXPECT_TRUE(nvme.has_discards);
+  EXPECT_EQ(nvme.discards_completed, 10);
+  EXPECT_EQ(nvme.dsect, 800);
+  EXPECT_EQ(nvme.ms_discarding, 5);
+  EXPECT_TRUE(nvme.has_flushes);
+  EXPECT_EQ(nvme.flushes_completed, 20);
+  EXPECT_EQ(nvme.ms_flushing, 8);
+
+  EXPECT_EQ(stats[2].device, "nvme0n1p1");
+  EXPECT_TRUE(stats[2].has_discards);
+  EXPECT_FALSE(stats[2].has_flushes);
+
+  // parsing again reuses the entries
+  atlasagent::parse_diskstats(" 259       0 nvme0n1 1 0 0 0 0 0 0 0 0 0 0\n", &stats);
+  ASSERT_EQ(stats.size(), 1);
+  EXPECT_EQ(stats[0].reads_completed, 1);
+  EXPECT_FALSE(stats[0].has_discards);
+}
+
+TEST(Disk, DiscardAndFlushStats) {
+  Registry registry;
+  TestDisk disk(&registry);
+
+  auto start = absl::Now();
+  disk.set_prefix("testdata/resources/disk-discard/1");
+  disk.diskio_stats(start);
+  my_measurements(&registry);
+
+  disk.set_prefix("testdata/resources/disk-discard/2");
+  disk.diskio_stats(start + absl::Seconds(60));
+  auto values = measurements_to_map(my_measurements(&registry), "dev");
+  expect_value(&values, "disk.io.bytes|count|discard|nvme0n1", 512 * 2048);
+  expect_value(&values, "disk.io.ops|count|discard|nvme0n1", 12);
+  expect_value(&values, "disk.io.ops|totalTime|discard|nvme0n1", 0.03);
+  expect_value(&values, "disk.io.ops|count|flush|nvme0n1", 40);
+  expect_value(&values, "disk.io.ops|totalTime|flush|nvme0n1", 0.02);
+}
 }  // namespace
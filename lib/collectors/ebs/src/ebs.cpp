@@ -2,10 +2,13 @@
 
 #include <lib/util/src/util.h>
 
+#include <algorithm>
 #include <fcntl.h>
 #include <filesystem>
 #include <regex>
 #include <sys/ioctl.h>
+#include <system_error>
+#include <thread>
 #include <unistd.h>
 
 struct EBSMetricConstants {
@@ -106,87 +109,120 @@ std::optional<std::unordered_set<std::string>> parse_ebs_config_directory(const
 
 template <typename Reg>
 EBSCollector<Reg>::EBSCollector(Reg* registry, const std::unordered_set<std::string>& config)
-    : config{config},
-      registry_{registry} {}
+    : registry_{registry} {
+  std::vector<std::string> paths{config.begin(), config.end()};
+  std::sort(paths.begin(), paths.end());
+  devices_.resize(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i) {
+    devices_[i].path = std::move(paths[i]);
+  }
+}
 
+// Runs on its own thread for each device, so it only touches the device slot and does not log
 template <typename Reg>
-bool EBSCollector<Reg>::query_stats_from_device(const std::string& device, nvme_get_amzn_stats_logpage& stats) try {
-  nvme_admin_command admin_cmd = {};
-  admin_cmd.opcode = NVMeCommands::GetLogPage;
-  admin_cmd.addr = (uint64_t)&stats;
-  admin_cmd.alen = sizeof(stats);
-  admin_cmd.nsid = 1;
-  admin_cmd.cdw10 = NVMeCommands::StatsLogPageId | (1024 << 16);
-
-  int fd = open(device.c_str(), O_RDONLY);
-  if (fd == -1) {
-    std::error_code ec(errno, std::system_category());
-    atlasagent::Logger()->error("Failed to open device {}: {}", device, ec.message());
-    return false;
-  }
+void EBSCollector<Reg>::query_stats_from_device(DeviceSlot* device) noexcept {
+  device->ok = false;
+  device->failedCall = nullptr;
+  device->error = 0;
 
-  int ret = ioctl(fd, NVMeCommands::AdminCommand, &admin_cmd);
-  close(fd);
+  // A device that was detached and attached again needs a new descriptor, so the ioctl is
+  // retried once after opening the device again
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (device->fd < 0) {
+      device->fd.reset(open(device->path.c_str(), O_RDONLY | O_CLOEXEC));
+      if (device->fd < 0) {
+        device->failedCall = "open";
+        device->error = errno;
+        return;
+      }
+    }
 
-  if (ret < 0) {
-    std::error_code ec(errno, std::system_category());
-    atlasagent::Logger()->error("Failed to call ioctl on device {}: {}", device, ec.message());
-    return false;
-  }
+    nvme_admin_command admin_cmd = {};
+    admin_cmd.opcode = NVMeCommands::GetLogPage;
+    admin_cmd.addr = (uint64_t)&device->stats;
+    admin_cmd.alen = sizeof(device->stats);
+    admin_cmd.nsid = 1;
+    admin_cmd.cdw10 = NVMeCommands::StatsLogPageId | (1024 << 16);
 
-  if (stats._magic != NVMeCommands::StatsMagic) {
-    atlasagent::Logger()->error("Not an EBS device: {}", device);
-    return false;
+    if (ioctl(device->fd, NVMeCommands::AdminCommand, &admin_cmd) == 0) {
+      device->failedCall = nullptr;
+      device->error = 0;
+      device->ok = device->stats._magic == NVMeCommands::StatsMagic;
+      return;
+    }
+    device->failedCall = "call ioctl on";
+    device->error = errno;
+    device->fd.reset();
   }
-
-  return true;
-} catch (const std::exception& e) {
-  atlasagent::Logger()->error("Exception: {} in parse_service_monitor_config_directory", e.what());
-  return false;
 }
 
 template <typename Reg>
-bool EBSCollector<Reg>::handle_histogram(const ebs_nvme_histogram& histogram, const std::string& devicePath, const std::string& type) {
+bool EBSCollector<Reg>::handle_histogram(const ebs_nvme_histogram& histogram, const std::string& devicePath, const std::string& type,
+                                         std::vector<typename Reg::monotonic_counter_ptr>* bins) {
   if (histogram.num_bins > AtlasNamingConvention.size()) {
     atlasagent::Logger()->error("Histogram has more bins than expected: {} > {}", histogram.num_bins, AtlasNamingConvention.size());
     return false;
   }
+  if (bins->size() < histogram.num_bins) {
+    bins->resize(histogram.num_bins);
+  }
   for (uint64_t i = 0; i < histogram.num_bins; i++) {
-    ebsHistogram(registry_, EBSMC::ebsHistogram, devicePath, type, AtlasNamingConvention.at(i))->Set(histogram.bins[i].count);
+    auto& bin = (*bins)[i];
+    if (bin == nullptr) {
+      bin = ebsHistogram(registry_, EBSMC::ebsHistogram, devicePath, type, AtlasNamingConvention.at(i));
+    }
+    bin->Set(histogram.bins[i].count);
   }
   return true;
 }
 
 template <class Reg>
-bool EBSCollector<Reg>::update_metrics(const std::string &devicePath, const nvme_get_amzn_stats_logpage &stats) {
+bool EBSCollector<Reg>::update_metrics(DeviceSlot* device) {
   if (this->registry_ == nullptr) {
     return false;
   }
-  
-  ebsMonocounter(registry_, EBSMC::ebsOperations, devicePath, EBSMC::ReadOp)->Set(stats.total_read_ops);
-  ebsMonocounter(registry_, EBSMC::ebsOperations, devicePath, EBSMC::WriteOp)->Set(stats.total_write_ops);
-  
-  ebsMonocounter(registry_, EBSMC::ebsBytes, devicePath, EBSMC::ReadOp)->Set(stats.total_read_bytes);
-  ebsMonocounter(registry_, EBSMC::ebsBytes, devicePath, EBSMC::WriteOp)->Set(stats.total_write_bytes);
 
-  ebsMonocounter(registry_, EBSMC::ebsTime, devicePath, EBSMC::ReadOp)->Set(stats.total_read_time * EBSMC::ebsMicrosecondsToSeconds);
-  ebsMonocounter(registry_, EBSMC::ebsTime, devicePath, EBSMC::WriteOp)->Set(stats.total_write_time * EBSMC::ebsMicrosecondsToSeconds);
-  
-  ebsMonocounter(registry_, EBSMC::ebsIOPS, devicePath, EBSMC::Volume)->Set(stats.ebs_volume_performance_exceeded_iops * EBSMC::ebsMicrosecondsToSeconds);
-  ebsMonocounter(registry_, EBSMC::ebsIOPS, devicePath, EBSMC::Instance)->Set(stats.ec2_instance_ebs_performance_exceeded_iops * EBSMC::ebsMicrosecondsToSeconds);
+  const auto& devicePath = device->path;
+  if (device->hasMeters == false) {
+    device->readOps = ebsMonocounter(registry_, EBSMC::ebsOperations, devicePath, EBSMC::ReadOp);
+    device->writeOps = ebsMonocounter(registry_, EBSMC::ebsOperations, devicePath, EBSMC::WriteOp);
+    device->readBytes = ebsMonocounter(registry_, EBSMC::ebsBytes, devicePath, EBSMC::ReadOp);
+    device->writeBytes = ebsMonocounter(registry_, EBSMC::ebsBytes, devicePath, EBSMC::WriteOp);
+    device->readTime = ebsMonocounter(registry_, EBSMC::ebsTime, devicePath, EBSMC::ReadOp);
+    device->writeTime = ebsMonocounter(registry_, EBSMC::ebsTime, devicePath, EBSMC::WriteOp);
+    device->volumeIOPS = ebsMonocounter(registry_, EBSMC::ebsIOPS, devicePath, EBSMC::Volume);
+    device->instanceIOPS = ebsMonocounter(registry_, EBSMC::ebsIOPS, devicePath, EBSMC::Instance);
+    device->volumeTP = ebsMonocounter(registry_, EBSMC::ebsTP, devicePath, EBSMC::Volume);
+    device->instanceTP = ebsMonocounter(registry_, EBSMC::ebsTP, devicePath, EBSMC::Instance);
+    device->queueLength = ebsGauge(registry_, EBSMC::ebsQueueLength, devicePath);
+    device->hasMeters = true;
+  }
 
-  ebsMonocounter(registry_, EBSMC::ebsTP, devicePath, EBSMC::Volume)->Set(stats.ebs_volume_performance_exceeded_tp * EBSMC::ebsMicrosecondsToSeconds);
-  ebsMonocounter(registry_, EBSMC::ebsTP, devicePath, EBSMC::Instance)->Set(stats.ec2_instance_ebs_performance_exceeded_tp * EBSMC::ebsMicrosecondsToSeconds);
+  const auto& stats = device->stats;
+  device->readOps->Set(stats.total_read_ops);
+  device->writeOps->Set(stats.total_write_ops);
+
+  device->readBytes->Set(stats.total_read_bytes);
+  device->writeBytes->Set(stats.total_write_bytes);
+
+  device->readTime->Set(stats.total_read_time * EBSMC::ebsMicrosecondsToSeconds);
+  device->writeTime->Set(stats.total_write_time * EBSMC::ebsMicrosecondsToSeconds);
+
+  device->volumeIOPS->Set(stats.ebs_volume_performance_exceeded_iops * EBSMC::ebsMicrosecondsToSeconds);
+  device->instanceIOPS->Set(stats.ec2_instance_ebs_performance_exceeded_iops * EBSMC::ebsMicrosecondsToSeconds);
+
+  device->volumeTP->Set(stats.ebs_volume_performance_exceeded_tp * EBSMC::ebsMicrosecondsToSeconds);
+  device->instanceTP->Set(stats.ec2_instance_ebs_performance_exceeded_tp * EBSMC::ebsMicrosecondsToSeconds);
+
+  device->queueLength->Set(stats.volume_queue_length);
 
-  ebsGauge(registry_, EBSMC::ebsQueueLength, devicePath)->Set(stats.volume_queue_length);
-  
   bool success {true};
-  if (false == handle_histogram(stats.read_io_latency_histogram, devicePath, EBSMC::ReadOp)) {
+  if (false == handle_histogram(stats.read_io_latency_histogram, devicePath, EBSMC::ReadOp, &device->readHistogram)) {
     atlasagent::Logger()->error("Failed to handle read histogram for device {}", devicePath);
     success = false;
   }
-  
-  if (false == handle_histogram(stats.write_io_latency_histogram, devicePath, EBSMC::WriteOp)) {
+
+  if (false == handle_histogram(stats.write_io_latency_histogram, devicePath, EBSMC::WriteOp, &device->writeHistogram)) {
     atlasagent::Logger()->error("Failed to handle write histogram for device {}", devicePath);
     success = false;
   }
@@ -196,21 +232,44 @@ bool EBSCollector<Reg>::update_metrics(const std::string &devicePath, const nvme
 
 template <typename Reg>
 bool EBSCollector<Reg>::gather_metrics() {
+  if (devices_.empty()) {
+    return true;
+  }
+
+  // Query the devices concurrently, one thread per device with the first one on this thread,
+  // so a pass takes about as long as the slowest admin command instead of their sum
+  std::vector<std::thread> threads;
+  threads.reserve(devices_.size() - 1);
+  for (size_t i = 1; i < devices_.size(); ++i) {
+    try {
+      threads.emplace_back(query_stats_from_device, &devices_[i]);
+    } catch (const std::system_error&) {
+      query_stats_from_device(&devices_[i]);
+    }
+  }
+  query_stats_from_device(&devices_[0]);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
   bool success{true};
-  // Iterate through all the devices in the config
-  for (const auto& device : config) {
-    // Gather statistics for each device
-    nvme_get_amzn_stats_logpage stats {};
-    if (false == query_stats_from_device(device, stats)) {
-      atlasagent::Logger()->error("Failed to query stats from device {}", device);
+  for (auto& device : devices_) {
+    if (device.ok == false) {
+      if (device.failedCall != nullptr) {
+        std::error_code ec(device.error, std::system_category());
+        atlasagent::Logger()->error("Failed to {} device {}: {}", device.failedCall, device.path, ec.message());
+      } else {
+        atlasagent::Logger()->error("Not an EBS device: {}", device.path);
+      }
+      atlasagent::Logger()->error("Failed to query stats from device {}", device.path);
       success = false;
       continue;
     }
     // Push the metrics to spectatorD
-    if (update_metrics(device, stats) == false) {
-      atlasagent::Logger()->error("Failed to update metrics for device {}", device);
+    if (update_metrics(&device) == false) {
+      atlasagent::Logger()->error("Failed to update metrics for device {}", device.path);
       success = false;
     }
   }
   return success;
-}
\ No newline at end of file
+}
@@ -1,3 +1,4 @@
+#include <lib/files/src/files.h>
 #include <lib/tagging/src/tagging_registry.h>
 #include <lib/spectator/registry.h>
 
@@ -123,13 +124,30 @@ inline auto ebsHistogram(Reg* registry, const std::string_view name, const std::
 template <typename Reg = atlasagent::TaggingRegistry>
 class EBSCollector {
  private:
-  // TODO: Change config to a vector to improve performance
-  // PreReq: Break collect_system_metrics into more functions
-  std::unordered_set<std::string> config;
+  // A configured device. The descriptor is kept open between passes, and the meters are created
+  // the first time the device returns its stats
+  struct DeviceSlot {
+    std::string path;
+    atlasagent::UnixFile fd{-1};
+    nvme_get_amzn_stats_logpage stats{};
+    // result of the last query, with the call that failed and its errno
+    bool ok{false};
+    const char* failedCall{nullptr};
+    int error{0};
+
+    bool hasMeters{false};
+    typename Reg::monotonic_counter_ptr readOps, writeOps, readBytes, writeBytes, readTime,
+        writeTime, volumeIOPS, instanceIOPS, volumeTP, instanceTP;
+    typename Reg::gauge_ptr queueLength;
+    std::vector<typename Reg::monotonic_counter_ptr> readHistogram, writeHistogram;
+  };
+
+  std::vector<DeviceSlot> devices_;
   Reg* registry_;
-  bool query_stats_from_device(const std::string& device, nvme_get_amzn_stats_logpage& stats);
-  bool update_metrics(const std::string &devicePath, const nvme_get_amzn_stats_logpage &stats);
-  bool handle_histogram(const ebs_nvme_histogram& histogram, const std::string& devicePath, const std::string& id);
+  static void query_stats_from_device(DeviceSlot* device) noexcept;
+  bool update_metrics(DeviceSlot* device);
+  bool handle_histogram(const ebs_nvme_histogram& histogram, const std::string& devicePath, const std::string& id,
+                        std::vector<typename Reg::monotonic_counter_ptr>* bins);
 
  public:
  EBSCollector(Reg* registry, const std::unordered_set<std::string>& config);
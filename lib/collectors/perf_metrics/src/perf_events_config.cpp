@@ -0,0 +1,171 @@
+#include "perf_events_config.h"
+#include "perf_metrics.h"
+#include <lib/util/src/util.h>
+#include <filesystem>
+#include <regex>
+
+namespace atlasagent {
+
+namespace {
+struct NamedEvent {
+  std::string_view name;
+  PerfEventConfig event;
+};
+
+std::string_view trim(std::string_view s) noexcept {
+  auto begin = s.find_first_not_of(" \t\r");
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  auto end = s.find_last_not_of(" \t\r");
+  return s.substr(begin, end - begin + 1);
+}
+
+constexpr uint64_t cache_event(uint64_t cache, uint64_t op, uint64_t result) {
+  return cache | (op << 8) | (result << 16);
+}
+
+constexpr NamedEvent kEvents[] = {
+    {"cycles", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES}},
+    {"instructions", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS}},
+    {"cache-references", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES}},
+    {"cache-misses", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}},
+    {"branch-instructions", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS}},
+    {"branch-misses", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}},
+    {"bus-cycles", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BUS_CYCLES}},
+    {"stalled-cycles-frontend", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND}},
+    {"stalled-cycles-backend", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND}},
+    {"ref-cycles", {PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES}},
+
+    {"L1-dcache-loads",
+     {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_ACCESS)}},
+    {"L1-dcache-load-misses",
+     {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_MISS)}},
+    {"LLC-loads",
+     {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_ACCESS)}},
+    {"LLC-load-misses",
+     {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_MISS)}},
+    {"LLC-stores",
+     {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_WRITE,
+                                      PERF_COUNT_HW_CACHE_RESULT_ACCESS)}},
+    {"LLC-store-misses",
+     {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_WRITE,
+                                      PERF_COUNT_HW_CACHE_RESULT_MISS)}},
+    {"dTLB-loads",
+     {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_ACCESS)}},
+    {"dTLB-load-misses",
+     {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_MISS)}},
+    {"iTLB-loads",
+     {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_ITLB, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_ACCESS)}},
+    {"iTLB-load-misses",
+     {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_ITLB, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_MISS)}},
+
+    {"cpu-clock", {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK}},
+    {"task-clock", {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK}},
+    {"page-faults", {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}},
+    {"minor-faults", {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN}},
+    {"major-faults", {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ}},
+    {"context-switches", {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES}},
+    {"cpu-migrations", {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS}},
+};
+}  // namespace
+
+std::optional<PerfEventConfig> lookup_perf_event(std::string_view name) noexcept {
+  for (const auto& e : kEvents) {
+    if (e.name == name) {
+      return e.event;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<PerfMetricConfig> parse_perf_metric(std::string_view line) {
+  auto eq = line.find('=');
+  if (eq == std::string_view::npos) {
+    return std::nullopt;
+  }
+  PerfMetricConfig metric;
+  metric.name = std::string{trim(line.substr(0, eq))};
+  auto expr = line.substr(eq + 1);
+  auto slash = expr.find('/');
+  metric.numerator = std::string{trim(expr.substr(0, slash))};
+  if (slash != std::string_view::npos) {
+    metric.denominator = std::string{trim(expr.substr(slash + 1))};
+    if (!lookup_perf_event(metric.denominator).has_value()) {
+      return std::nullopt;
+    }
+  }
+  if (metric.name.empty() || !lookup_perf_event(metric.numerator).has_value()) {
+    return std::nullopt;
+  }
+  return metric;
+}
+
+std::optional<std::vector<PerfMetricConfig>> parse_perf_events_config_file(const char* configFilePath) try {
+  std::optional<std::vector<std::string>> lines = read_file(configFilePath);
+  if (lines.has_value() == false) {
+    Logger()->error("Error reading config file {}", configFilePath);
+    return std::nullopt;
+  }
+
+  // Every line must be a valid metric, blank lines and comments are skipped
+  std::vector<PerfMetricConfig> metrics{};
+  for (const auto& line : lines.value()) {
+    auto stripped = trim(line);
+    if (stripped.empty() || stripped[0] == '#') {
+      continue;
+    }
+    auto metric = parse_perf_metric(stripped);
+    if (metric.has_value() == false) {
+      Logger()->error("Invalid perf event metric: {} in config file {}", line, configFilePath);
+      return std::nullopt;
+    }
+    metrics.emplace_back(std::move(metric.value()));
+  }
+  return metrics;
+} catch (const std::exception& e) {
+  Logger()->error("Exception: {} in parse_perf_events_config_file", e.what());
+  return std::nullopt;
+}
+
+std::optional<std::vector<PerfMetricConfig>> parse_perf_events_config_directory(const char* directoryPath) try {
+  if (std::filesystem::exists(directoryPath) == false || std::filesystem::is_directory(directoryPath) == false) {
+    Logger()->debug("Invalid perf events config directory {}", directoryPath);
+    return std::nullopt;
+  }
+
+  std::regex configFileExtPattern(PerfEventsConstants::ConfigFileExtPattern);
+  std::vector<PerfMetricConfig> allMetrics{};
+  for (const auto& file : std::filesystem::recursive_directory_iterator(directoryPath)) {
+    if (std::regex_match(file.path().filename().string(), configFileExtPattern) == false) {
+      continue;
+    }
+
+    auto metrics = parse_perf_events_config_file(file.path().c_str());
+    if (metrics.has_value() == false) {
+      Logger()->error("Could not add perf events from config file {}", file.path().c_str());
+      continue;
+    }
+    for (auto& metric : metrics.value()) {
+      allMetrics.emplace_back(std::move(metric));
+    }
+  }
+
+  if (allMetrics.empty()) {
+    return std::nullopt;
+  }
+  return allMetrics;
+} catch (const std::exception& e) {
+  Logger()->error("Exception: {} in parse_perf_events_config_directory", e.what());
+  return std::nullopt;
+}
+
+}  // namespace atlasagent
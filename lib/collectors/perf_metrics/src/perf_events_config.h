@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace atlasagent {
+
+// a perf event: a perf_type_id and its config, for example PERF_TYPE_HARDWARE and one of
+// the perf_hw_id values
+struct PerfEventConfig {
+  uint32_t type;
+  uint64_t config;
+};
+
+struct PerfEventsConstants {
+  static constexpr auto ConfigPath{"/etc/atlas-system-agent/conf.d"};
+  static constexpr auto ConfigFileExtPattern = ".*\\.perf-events$";
+};
+
+// A PMU metric from the config, one per line in files named *.perf-events:
+//   sys.cpu.stalledCyclesFrontend = stalled-cycles-frontend
+//   sys.cpu.llcMissRate = LLC-load-misses / LLC-loads
+// The events use the names from perf list. A metric with a denominator records the ratio of
+// the two events for each CPU, otherwise the event count for each CPU
+struct PerfMetricConfig {
+  std::string name;
+  std::string numerator;
+  std::string denominator;
+};
+
+// find an event by its perf list name, for example context-switches or dTLB-load-misses
+std::optional<PerfEventConfig> lookup_perf_event(std::string_view name) noexcept;
+
+std::optional<PerfMetricConfig> parse_perf_metric(std::string_view line);
+std::optional<std::vector<PerfMetricConfig>> parse_perf_events_config_file(const char* configFilePath);
+std::optional<std::vector<PerfMetricConfig>> parse_perf_events_config_directory(const char* directoryPath);
+
+}  // namespace atlasagent
@@ -1,17 +1,213 @@
 #include "perf_metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
 
 namespace atlasagent {
 
 template class PerfMetrics<atlasagent::TaggingRegistry>;
 template class PerfMetrics<spectator::TestRegistry>;
 
+PerfGroup::PerfGroup(std::vector<PerfEventConfig> events) noexcept
+    : events_{std::move(events)}, deltas_(events_.size()) {}
+
+bool PerfGroup::open_events(const std::vector<bool>& online_cpus) {
+  // ensure we don't leak fds, and start from new baselines
+  close_events();
+  fds_.clear();
+  ids_.clear();
+  prev_values_.clear();
+  prev_enabled_.clear();
+  prev_running_.clear();
+  return update_cpus(online_cpus);
+}
+
+bool PerfGroup::update_cpus(const std::vector<bool>& online_cpus) {
+  auto n = num_events();
+  auto num_cpus = online_cpus.size();
+  for (auto cpu = num_cpus; cpu < prev_enabled_.size(); ++cpu) {
+    close_cpu(cpu);
+  }
+  fds_.resize(num_cpus * n, -1);
+  ids_.resize(fds_.size(), 0);
+  prev_values_.resize(fds_.size(), 0);
+  prev_enabled_.resize(num_cpus, 0);
+  prev_running_.resize(num_cpus, 0);
+  // nr, time_enabled, time_running, then a value and id for each event
+  buf_.assign(3 + 2 * n, 0);
+
+  // the CPUs that did not change keep their events and baselines
+  for (auto cpu = 0u; cpu < num_cpus; ++cpu) {
+    auto is_open = leader(cpu) >= 0;
+    if (online_cpus[cpu] && !is_open) {
+      if (!open_cpu(cpu)) {
+        return false;
+      }
+    } else if (!online_cpus[cpu] && is_open) {
+      close_cpu(cpu);
+    }
+  }
+  return true;
+}
+
+bool PerfGroup::open_cpu(size_t cpu) {
+#ifdef __linux__
+  auto n = num_events();
+  for (auto i = 0u; i < n; ++i) {
+    perf_event_attr pea;
+    memset(&pea, 0, sizeof pea);
+    pea.type = events_[i].type;
+    pea.size = sizeof pea;
+    pea.config = events_[i].config;
+    pea.exclude_guest = 1;
+    pea.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                      PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // only the leader starts disabled, the whole group is enabled with it
+    pea.disabled = i == 0 ? 1 : 0;
+    auto group_fd = i == 0 ? -1 : leader(cpu);
+    // a cgroup event takes the cgroup descriptor in place of the pid
+    auto pid = cgroup_fd_ >= 0 ? cgroup_fd_ : -1;
+    auto flags = PERF_FLAG_FD_CLOEXEC | (cgroup_fd_ >= 0 ? PERF_FLAG_PID_CGROUP : 0);
+    auto fd = perf_event_open(&pea, pid, static_cast<int>(cpu), group_fd, flags);
+    if (fd < 0) {
+      if (errno == EACCES) {
+        Logger()->warn(
+            "Unable to collect performance events - Check "
+            "/proc/sys/kernel/perf_event_paranoid");
+        return false;
+      } else if (errno == ENOENT) {
+        Logger()->warn("This system does not allow access to hardware performance counters");
+        return false;
+      }
+      Logger()->warn("Unable to perf_event_open event {}:{} on CPU {}: {}({})", events_[i].type,
+                     events_[i].config, cpu, strerror(errno), errno);
+      if (i == 0) {
+        break;  // no group on this CPU
+      }
+      continue;
+    }
+    fds_[cpu * n + i] = fd;
+    ioctl(fd, PERF_EVENT_IOC_ID, &ids_[cpu * n + i]);
+  }
+  if (leader(cpu) >= 0) {
+    ioctl(leader(cpu), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+#endif
+  return true;
+}
+
+bool PerfGroup::probe(const PerfEventConfig& event, int cpu, int cgroup_fd) noexcept {
+#ifdef __linux__
+  perf_event_attr pea;
+  memset(&pea, 0, sizeof pea);
+  pea.type = event.type;
+  pea.size = sizeof pea;
+  pea.config = event.config;
+  pea.exclude_guest = 1;
+  pea.disabled = 1;
+  auto pid = cgroup_fd >= 0 ? cgroup_fd : -1;
+  auto flags = PERF_FLAG_FD_CLOEXEC | (cgroup_fd >= 0 ? PERF_FLAG_PID_CGROUP : 0);
+  UnixFile fd{perf_event_open(&pea, pid, cpu, -1, flags)};
+  return fd >= 0;
+#else
+  return false;
+#endif
+}
+
+void PerfGroup::close_cpu(size_t cpu) noexcept {
+  auto n = num_events();
+  for (auto i = cpu * n; i < (cpu + 1) * n; ++i) {
+    if (fds_[i] >= 0) {
+      close(fds_[i]);
+      fds_[i] = -1;
+    }
+    ids_[i] = 0;
+    prev_values_[i] = 0;
+  }
+  prev_enabled_[cpu] = 0;
+  prev_running_[cpu] = 0;
+}
+
+bool PerfGroup::read_delta() {
+  auto n = num_events();
+  for (auto& d : deltas_) {
+    d.clear();
+  }
+  for (auto cpu = 0u; cpu < prev_enabled_.size(); ++cpu) {
+    auto fd = leader(cpu);
+    if (fd < 0) {
+      continue;
+    }
+    auto r = ::read(fd, buf_.data(), buf_.size() * sizeof buf_[0]);
+    if (r < static_cast<ssize_t>(3 * sizeof buf_[0])) {
+      Logger()->warn("Unable to read values from CPU {}", cpu);
+      return false;
+    }
+
+    auto nr = std::min<uint64_t>(buf_[0], n);
+    auto enabled = buf_[1] - prev_enabled_[cpu];
+    auto running = buf_[2] - prev_running_[cpu];
+    prev_enabled_[cpu] = buf_[1];
+    prev_running_[cpu] = buf_[2];
+    auto* prev = &prev_values_[cpu * n];
+    const auto* ids = &ids_[cpu * n];
+    // a group that was never scheduled has no sample for this interval, not a zero one. The
+    // values did not change, so the baselines stay valid
+    if (running == 0) {
+      continue;
+    }
+    for (auto i = 0u; i < n; ++i) {
+      auto value = prev[i];
+      // the values come in the order the events were added to the group, and events that
+      // could not be opened are missing, so match them by id
+      if (fds_[cpu * n + i] >= 0) {
+        for (auto j = 0u; j < nr; ++j) {
+          if (buf_[3 + 2 * j + 1] == ids[i]) {
+            value = buf_[3 + 2 * j];
+            break;
+          }
+        }
+      }
+      auto delta = value - prev[i];
+      prev[i] = value;
+      // scale for multiplexing, every event in the group ran for the same time
+      auto scaled =
+          static_cast<uint64_t>(static_cast<double>(delta) * enabled / (running + 0.5));
+      deltas_[i].push_back(scaled);
+    }
+  }
+  return true;
+}
+
+bool PerfGroup::read_times(size_t cpu, uint64_t* enabled, uint64_t* running) {
+  if (cpu >= prev_enabled_.size() || leader(cpu) < 0) {
+    return false;
+  }
+  auto r = ::read(leader(cpu), buf_.data(), buf_.size() * sizeof buf_[0]);
+  if (r < static_cast<ssize_t>(3 * sizeof buf_[0])) {
+    return false;
+  }
+  *enabled = buf_[1];
+  *running = buf_[2];
+  return true;
+}
+
+void PerfGroup::close_events() noexcept {
+  for (auto& fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+}
+
 template <typename Reg>
-PerfMetrics<Reg>::PerfMetrics(Reg* registry, const std::string path_prefix)
+PerfMetrics<Reg>::PerfMetrics(Reg* registry, const std::string path_prefix,
+                              const std::string& cgroup,
+                              const std::vector<PerfMetricConfig>& config)
     : registry_(registry), path_prefix_(std::move(path_prefix)) {
   static constexpr const char* kEnableEnvVar = "ATLAS_ENABLE_PMU_METRICS";
-  auto enabled_var = std::getenv(kEnableEnvVar);
-  if (enabled_var != nullptr && std::strcmp(enabled_var, "true") == 0) {
-    Logger()->info("PMU metrics have been enabled using the env variable {}", kEnableEnvVar);
+  if (env_flag_enabled(kEnableEnvVar, "PMU metrics")) {
     disabled_ = false;
   } else {
     Logger()->debug("PMU metrics have not been enabled. Set {}=true to enable collection",
@@ -27,15 +223,106 @@ PerfMetrics<Reg>::PerfMetrics(Reg* registry, const std::string path_prefix)
     return;
   }
 
+  if (!cgroup.empty()) {
+    cgroup_fd_.reset(open(cgroup.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (cgroup_fd_ < 0) {
+      Logger()->warn("Unable to open cgroup {} for perf events: {}", cgroup, strerror(errno));
+      disabled_ = true;
+      return;
+    }
+    Logger()->info("Perf events will only count the tasks in the cgroup {}", cgroup);
+    events_.set_cgroup(cgroup_fd_);
+  }
+
   // start collection
   if (!open_perf_counters_if_needed()) {
     return;
   }
+  open_uevent_socket();
 
   instructions_ds = registry_->GetDistributionSummary("sys.cpu.instructions");
   cycles_ds = registry_->GetDistributionSummary("sys.cpu.cycles");
   cache_ds = registry_->GetDistributionSummary("sys.cpu.cacheMissRate");
   branch_ds = registry_->GetDistributionSummary("sys.cpu.branchMispredictionRate");
+
+  if (!config.empty()) {
+    configure_events(config);
+  }
+}
+
+template <typename Reg>
+void PerfMetrics<Reg>::configure_events(const std::vector<PerfMetricConfig>& config) {
+  auto first_cpu = std::find(online_cpus_.begin(), online_cpus_.end(), true);
+  if (first_cpu == online_cpus_.end()) {
+    return;
+  }
+  auto cpu = static_cast<int>(first_cpu - online_cpus_.begin());
+
+  // the distinct events used by the metrics, dropping the ones the kernel does not accept
+  std::vector<std::string> names;
+  std::vector<PerfEventConfig> events;
+  std::vector<std::string> rejected;
+  auto add_event = [&](const std::string& name) -> std::optional<size_t> {
+    auto it = std::find(names.begin(), names.end(), name);
+    if (it != names.end()) {
+      return static_cast<size_t>(it - names.begin());
+    }
+    if (std::find(rejected.begin(), rejected.end(), name) != rejected.end()) {
+      return std::nullopt;
+    }
+    auto event = lookup_perf_event(name);
+    if (!event || !PerfGroup::probe(*event, cpu, cgroup_fd_)) {
+      Logger()->warn("Perf event {} is not supported on this system, dropping it", name);
+      rejected.push_back(name);
+      return std::nullopt;
+    }
+    names.push_back(name);
+    events.push_back(*event);
+    return names.size() - 1;
+  };
+
+  std::vector<ConfiguredMetric> metrics;
+  for (const auto& m : config) {
+    auto numerator = add_event(m.numerator);
+    auto denominator = m.denominator.empty() ? numerator : add_event(m.denominator);
+    if (!numerator || !denominator) {
+      Logger()->warn("Not collecting {}: its events are not available", m.name);
+      continue;
+    }
+    metrics.push_back({m.name, *numerator, *denominator, !m.denominator.empty(),
+                       registry_->GetDistributionSummary(m.name)});
+  }
+  if (metrics.empty()) {
+    return;
+  }
+
+  auto group = std::make_unique<PerfGroup>(std::move(events));
+  group->set_cgroup(cgroup_fd_);
+  if (!group->update_cpus(online_cpus_)) {
+    return;
+  }
+  // a group competing with the built-in one is rotated in by the multiplexing timer within a
+  // few ms, one that does not fit in the counters never is. Cgroup events are only enabled
+  // while the cgroup has tasks on the CPU, so an idle cgroup does not tell us anything
+  static constexpr auto kScheduleWait = std::chrono::milliseconds(100);
+  static constexpr auto kSchedulePoll = std::chrono::milliseconds(5);
+  auto deadline = std::chrono::steady_clock::now() + kScheduleWait;
+  uint64_t enabled = 0;
+  uint64_t running = 0;
+  while (group->read_times(static_cast<size_t>(cpu), &enabled, &running) && running == 0 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(kSchedulePoll);
+  }
+  if (enabled > 0 && running == 0) {
+    Logger()->warn(
+        "The {} perf events from the config can't be scheduled together on this system, not "
+        "collecting them",
+        group->num_events());
+    return;
+  }
+  Logger()->info("Collecting {} perf event metrics from the config", metrics.size());
+  config_events_ = std::move(group);
+  config_metrics_ = std::move(metrics);
 }
 
 template <typename Reg>
@@ -47,17 +334,14 @@ bool PerfMetrics<Reg>::open_perf_counters_if_needed() {
   }
   online_cpus_ = std::move(new_online_cpus);
 
-  Logger()->info("Online CPUs have changed. Reopening perf events.");
-  // if we get EACCES for these then we don't even try the rest
-  if (!instructions.open_events(online_cpus_)) {
+  Logger()->info("Online CPUs have changed. Updating perf events.");
+  if (!events_.update_cpus(online_cpus_)) {
     disabled_ = true;
     return false;
   }
-  cycles.open_events(online_cpus_);
-  cache_refs.open_events(online_cpus_);
-  cache_misses.open_events(online_cpus_);
-  branch_insts.open_events(online_cpus_);
-  branch_misses.open_events(online_cpus_);
+  if (config_events_) {
+    config_events_->update_cpus(online_cpus_);
+  }
 
   return true;
 }
@@ -87,20 +371,80 @@ void PerfMetrics<Reg>::collect() {
     return;
   }
 
-  update_ds(instructions, instructions_ds.get(), "instructions");
-  update_ds(cycles, cycles_ds.get(), "cycles");
-  update_rate(cache_misses, cache_refs, cache_ds.get(), "cache miss rate");
-  update_rate(branch_misses, branch_insts, branch_ds.get(), "branch misprediction rate");
+  if (events_.read_delta()) {
+    update_ds(events_.deltas(kInstructions), instructions_ds.get(), "instructions");
+    update_ds(events_.deltas(kCycles), cycles_ds.get(), "cycles");
+    update_rate(events_.deltas(kCacheMisses), events_.deltas(kCacheRefs), cache_ds.get(),
+                "cache miss rate");
+    update_rate(events_.deltas(kBranchMisses), events_.deltas(kBranchInsts), branch_ds.get(),
+                "branch misprediction rate");
+  }
+  if (config_events_ && config_events_->read_delta()) {
+    for (const auto& m : config_metrics_) {
+      if (m.ratio) {
+        update_rate(config_events_->deltas(m.numerator), config_events_->deltas(m.denominator),
+                    m.ds.get(), m.name.c_str());
+      } else {
+        update_ds(config_events_->deltas(m.numerator), m.ds.get(), m.name.c_str());
+      }
+    }
+  }
+
+  // without uevents, refresh online CPUs and update the perf counters so we can capture when
+  // CPUs are disabled after we started running
+  if (uevent_fd_ < 0) {
+    open_perf_counters_if_needed();
+  }
+}
+
+template <typename Reg>
+void PerfMetrics<Reg>::open_uevent_socket() {
+#ifdef __linux__
+  uevent_fd_.reset(
+      socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT));
+  if (uevent_fd_ < 0) {
+    Logger()->info("Unable to listen for CPU hotplug events ({}), checking every minute",
+                   strerror(errno));
+    return;
+  }
+  struct sockaddr_nl addr {};
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = 1;  // kernel uevents
+  if (bind(uevent_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) != 0) {
+    Logger()->info("Unable to listen for CPU hotplug events ({}), checking every minute",
+                   strerror(errno));
+    uevent_fd_.reset();
+  }
+#endif
+}
 
-  // refresh online CPUs and reopen perf counters so we can capture when CPUs are disabled
-  // after we started running
-  open_perf_counters_if_needed();
+template <typename Reg>
+void PerfMetrics<Reg>::handle_cpu_hotplug() {
+  if (disabled_ || uevent_fd_ < 0) {
+    return;
+  }
+  auto changed = false;
+  char buf[4096];
+  for (;;) {
+    auto n = recv(uevent_fd_, buf, sizeof buf, MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // the socket buffer overflowed, so an event might have been lost
+      changed |= errno == ENOBUFS;
+      break;
+    }
+    changed |= is_cpu_uevent(buf, static_cast<size_t>(n));
+  }
+  if (changed) {
+    open_perf_counters_if_needed();
+  }
 }
 
 template <typename Reg>
-void PerfMetrics<Reg>::update_ds(PerfCounter& a, typename Reg::dist_summary_t* ds,
-                                 const char* name) {
-  auto a_values = a.read_delta();
+void PerfMetrics<Reg>::update_ds(const std::vector<uint64_t>& a_values,
+                                 typename Reg::dist_summary_t* ds, const char* name) {
   // update our distribution summary with values from each CPU
   for (auto v : a_values) {
     Logger()->trace("Updating {} with {}", name, v);
@@ -109,10 +453,9 @@ void PerfMetrics<Reg>::update_ds(PerfCounter& a, typename Reg::dist_summary_t* d
 }
 
 template <typename Reg>
-void PerfMetrics<Reg>::update_rate(PerfCounter& a, PerfCounter& b, typename Reg::dist_summary_t* ds,
-                                   const char* name) {
-  auto a_values = a.read_delta();
-  auto b_values = b.read_delta();
+void PerfMetrics<Reg>::update_rate(const std::vector<uint64_t>& a_values,
+                                   const std::vector<uint64_t>& b_values,
+                                   typename Reg::dist_summary_t* ds, const char* name) {
   assert(a_values.size() == b_values.size());
 
   // compute rate for each core
@@ -1,12 +1,20 @@
 #pragma once
 
+#include "perf_events_config.h"
 #include <lib/tagging/src/tagging_registry.h>
 #include <lib/util/src/util.h>
 #include <fmt/format.h>
+#include <memory>
+#include <string_view>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 
 #ifndef __linux__
+enum perf_type_id {
+  PERF_TYPE_HARDWARE,
+  PERF_TYPE_SOFTWARE,
+};
 enum perf_hw_id {
   PERF_COUNT_HW_CPU_CYCLES,
   PERF_COUNT_HW_INSTRUCTIONS,
@@ -19,6 +27,7 @@ enum perf_hw_id {
 #include <linux/unistd.h>
 #include <linux/perf_event.h>
 #include <linux/hw_breakpoint.h>
+#include <linux/netlink.h>
 inline int perf_event_open(struct perf_event_attr* hw_event, pid_t pid, int cpu, int group_fd,
                            unsigned long flags) {
   return syscall(__NR_perf_event_open, hw_event, pid, cpu, group_fd, flags);
@@ -57,135 +66,95 @@ inline void parse_range(FILE* fp, std::vector<bool>* result) {
 
 namespace atlasagent {
 
-struct perf_count {
-  uint64_t raw_value;
-  uint64_t time_enabled;
-  uint64_t time_running;
-
-  uint64_t delta_from(const perf_count& prev) {
-    if (time_running == 0) {
-      return 0;
-    }
-    perf_count delta;
-    delta.time_running = time_running - prev.time_running;
-    delta.time_enabled = time_enabled - prev.time_enabled;
-    delta.raw_value = raw_value - prev.raw_value;
-
-    auto value = static_cast<uint64_t>(static_cast<double>(delta.raw_value) * delta.time_enabled /
-                                       (delta.time_running + 0.5));
-    return value;
-  }
-};
-
-class PerfCounter {
+/// The perf events for a set of hardware counters, opened as one event group per CPU. The
+/// kernel schedules the events of a group together, so when the PMU is multiplexed they are all
+/// counting at the same time and their ratios stay consistent. Every counter of a CPU is read
+/// with a single read() on the group leader (PERF_FORMAT_GROUP), into a buffer that is reused.
+class PerfGroup {
  public:
-  explicit PerfCounter(uint64_t config) : config_(config), pid_{-1} {}
-
-#ifdef __linux__
-  void setup_perf_event(perf_event_attr* pea) {
-    memset(pea, 0, sizeof(perf_event_attr));
-    pea->config = config_;
-    pea->exclude_guest = 1;
-    pea->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
-    pea->type = PERF_TYPE_HARDWARE;
-    pea->size = sizeof(perf_event_attr);
-    pea->inherit = 1;
+  // the first event is the group leader
+  explicit PerfGroup(std::vector<PerfEventConfig> events) noexcept;
+  PerfGroup(const PerfGroup&) = delete;
+  ~PerfGroup() { close_events(); }
+
+  // returns false if this system does not allow access to the hardware counters
+  bool open_events(const std::vector<bool>& online_cpus);
+
+  // open the events for the CPUs that came online and close the ones for the CPUs that went
+  // offline, the others keep counting from their previous values
+  bool update_cpus(const std::vector<bool>& online_cpus);
+
+  // read the counters and compute the deltas since the previous read, scaled for the time
+  // the group was not scheduled. Returns false if they could not be read
+  bool read_delta();
+
+  // the time the group on the given CPU has been enabled and running on the PMU since it was
+  // opened. The kernel accepts a group with more events than the CPU has counters, but it never
+  // runs. Returns false if there is no group on that CPU or it could not be read
+  bool read_times(size_t cpu, uint64_t* enabled, uint64_t* running);
+
+  // the deltas from the last read_delta for the event at the given index, for each CPU.
+  // CPUs without events, or where the group was not scheduled since the previous read, are not
+  // included
+  [[nodiscard]] const std::vector<uint64_t>& deltas(size_t event) const noexcept {
+    return deltas_[event];
   }
 
-  int perf_open(int cpu, unsigned long flags) {
-    perf_event_attr pea;
-    setup_perf_event(&pea);
-    return perf_event_open(&pea, pid_, cpu, -1, flags);
-  }
-#endif  // __linux__
-
-  void set_pid(int pid) { pid_ = pid; }
-
-  bool open_events(const std::vector<bool>& online_cpus) {
-    // ensure we don't leak fds
-    close_events();
-
-    fds_.assign(online_cpus.size(), -1);
-#ifdef __linux__
-    unsigned long flags = 0;
-    for (auto i = 0u; i < online_cpus.size(); ++i) {
-      if (online_cpus[i]) {
-        fds_[i] = perf_open(i, flags);
-        if (fds_[i] < 0) {
-          if (errno == EACCES) {
-            Logger()->warn(
-                "Unable to collect performance events - Check "
-                "/proc/sys/kernel/perf_event_paranoid");
-            return false;
-          } else if (errno == ENOENT) {
-            Logger()->warn("This system does not allow access to hardware performance counters");
-            return false;
-          } else {
-            Logger()->warn("Unable to perf_event_open CPU {}: {}({})", i, strerror(errno), errno);
-          }
-        }
-      }
-    }
-    prev_vals.resize(fds_.size());
-#endif
-    return true;
-  }
+  void close_events() noexcept;
 
-  std::vector<uint64_t> read_delta() {
-    std::vector<uint64_t> res;
-    res.resize(fds_.size());
-
-    // read new values
-    std::vector<perf_count> new_vals;
-    new_vals.resize(fds_.size());
-    for (auto i = 0u; i < fds_.size(); ++i) {
-      auto fd = fds_[i];
-      if (fd >= 0) {
-        memset(&new_vals[i], 0, sizeof(perf_count));
-        if (::read(fd, &new_vals[i], sizeof(perf_count)) != sizeof(perf_count)) {
-          Logger()->warn("Unable to read value from CPU {}", i);
-          return std::vector<uint64_t>();
-        }
-      }
-    }
+  [[nodiscard]] size_t num_events() const noexcept { return events_.size(); }
 
-    // compute values
-    for (auto i = 0u; i < fds_.size(); ++i) {
-      auto value = new_vals[i].delta_from(prev_vals[i]);
-      res[i] = value;
-    }
+  // count only the tasks in a cgroup, given a descriptor for its directory that must outlive
+  // the events, instead of everything running on the CPUs. Applies to the events opened after
+  // this call
+  void set_cgroup(int cgroup_fd) noexcept { cgroup_fd_ = cgroup_fd; }
 
-    // remember the values just read
-    prev_vals = std::move(new_vals);
-    return res;
-  }
-
-  void close_events() {
-    for (auto& fd : fds_) {
-      if (fd >= 0) {
-        close(fd);
-        fd = -1;
-      }
-    }
-  }
-
-  ~PerfCounter() { close_events(); }
-
-  uint64_t Config() const { return config_; }
-
-  int Pid() const { return pid_; }
+  // whether the kernel accepts the event on the given CPU, optionally for a cgroup
+  static bool probe(const PerfEventConfig& event, int cpu, int cgroup_fd) noexcept;
 
  private:
+  std::vector<PerfEventConfig> events_;
+  int cgroup_fd_{-1};
+  // events for each CPU, in events_ order: fds_[cpu * num_events() + event]
   std::vector<int> fds_;
-  uint64_t config_;
-  int pid_;
-  std::vector<perf_count> prev_vals;
+  std::vector<uint64_t> ids_;
+  // raw values from the previous read, same layout as fds_, and the group times per CPU
+  std::vector<uint64_t> prev_values_;
+  std::vector<uint64_t> prev_enabled_;
+  std::vector<uint64_t> prev_running_;
+  std::vector<std::vector<uint64_t>> deltas_;
+  std::vector<uint64_t> buf_;
+
+  [[nodiscard]] int leader(size_t cpu) const noexcept { return fds_[cpu * num_events()]; }
+  bool open_cpu(size_t cpu);
+  void close_cpu(size_t cpu) noexcept;
 };
 
+// whether a kernel uevent (ACTION@DEVPATH followed by null terminated KEY=VALUE fields) is
+// about a CPU, for example when it goes online or offline
+inline bool is_cpu_uevent(const char* buf, size_t len) noexcept {
+  static constexpr std::string_view kCpuSubsystem = "SUBSYSTEM=cpu";
+  std::string_view msg{buf, len};
+  for (size_t pos = 0; pos < msg.size();) {
+    auto end = msg.find('\0', pos);
+    if (end == std::string_view::npos) {
+      end = msg.size();
+    }
+    if (msg.substr(pos, end - pos) == kCpuSubsystem) {
+      return true;
+    }
+    pos = end + 1;
+  }
+  return false;
+}
+
 template <typename Reg = TaggingRegistry>
 class PerfMetrics {
  public:
-  PerfMetrics(Reg* registry, std::string path_prefix);
+  // with a cgroup path the events only count the tasks in that cgroup. The config adds
+  // metrics for more events, see PerfMetricConfig
+  PerfMetrics(Reg* registry, std::string path_prefix, const std::string& cgroup = "",
+              const std::vector<PerfMetricConfig>& config = {});
 
   bool open_perf_counters_if_needed();
 
@@ -194,18 +163,25 @@ class PerfMetrics {
 
   void collect();
 
+  // check for CPUs going online or offline, cheap enough to call every second
+  void handle_cpu_hotplug();
+
  private:
   bool disabled_ = true;
   Reg* registry_;
   std::string path_prefix_;
   std::vector<bool> online_cpus_;
-  UnixFile pid_{-1};
-  PerfCounter cycles{PERF_COUNT_HW_CPU_CYCLES};
-  PerfCounter instructions{PERF_COUNT_HW_INSTRUCTIONS};
-  PerfCounter cache_refs{PERF_COUNT_HW_CACHE_REFERENCES};
-  PerfCounter cache_misses{PERF_COUNT_HW_CACHE_MISSES};
-  PerfCounter branch_insts{PERF_COUNT_HW_BRANCH_INSTRUCTIONS};
-  PerfCounter branch_misses{PERF_COUNT_HW_BRANCH_MISSES};
+  UnixFile cgroup_fd_{-1};
+  // kernel uevents, to notice CPU hotplug without checking the online CPUs every minute
+  UnixFile uevent_fd_{-1};
+  // positions in events_
+  enum Event { kCycles, kInstructions, kCacheRefs, kCacheMisses, kBranchInsts, kBranchMisses };
+  PerfGroup events_{{{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+                     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+                     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+                     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}}};
 
   // instructions
   typename Reg::dist_summary_ptr instructions_ds;
@@ -218,9 +194,28 @@ class PerfMetrics {
   // branch miss rate
   typename Reg::dist_summary_ptr branch_ds;
 
-  void update_ds(PerfCounter& a, typename Reg::dist_summary_t* ds, const char* name);
+  // the metrics from the config, with their events in a separate group so they can't prevent
+  // the built-in ones from being scheduled
+  struct ConfiguredMetric {
+    std::string name;
+    size_t numerator;
+    // only used for ratios
+    size_t denominator;
+    bool ratio;
+    typename Reg::dist_summary_ptr ds;
+  };
+  std::unique_ptr<PerfGroup> config_events_;
+  std::vector<ConfiguredMetric> config_metrics_;
+
+  void configure_events(const std::vector<PerfMetricConfig>& config);
+
+  void open_uevent_socket();
+
+  static void update_ds(const std::vector<uint64_t>& a_values, typename Reg::dist_summary_t* ds,
+                        const char* name);
 
-  static void update_rate(PerfCounter& a, PerfCounter& b, typename Reg::dist_summary_t* ds,
+  static void update_rate(const std::vector<uint64_t>& a_values,
+                          const std::vector<uint64_t>& b_values, typename Reg::dist_summary_t* ds,
                           const char* name);
 };
 
@@ -1,5 +1,6 @@
 #include <lib/collectors/perf_metrics/src/perf_metrics.h>
 #include <gtest/gtest.h>
+#include <chrono>
 
 namespace {
 using Registry = spectator::TestRegistry;
@@ -41,4 +42,176 @@ TEST(PerfMetrics, ParseRangeCommas) {
   EXPECT_EQ(expected, range);
 }
 
-}  // namespace
\ No newline at end of file
+TEST(PerfMetrics, GroupRead) {
+  // software events, hardware counters are usually not available where the tests run
+  atlasagent::PerfGroup group{{{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK},
+                               {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES}}};
+  std::vector<bool> cpus{true};
+  if (!group.open_events(cpus)) {
+    GTEST_SKIP() << "perf events are not available";
+  }
+
+  ASSERT_TRUE(group.read_delta());
+  // one value per CPU for each event
+  ASSERT_EQ(group.deltas(0).size(), 1);
+  ASSERT_EQ(group.deltas(1).size(), 1);
+
+  volatile uint64_t sum = 0;
+  for (auto i = 0; i < 1000000; ++i) {
+    sum = sum + i;
+  }
+  ASSERT_TRUE(group.read_delta());
+  // the cpu clock is in ns
+  EXPECT_GT(group.deltas(0)[0], 0);
+}
+
+TEST(PerfMetrics, GroupTimes) {
+  atlasagent::PerfGroup group{{{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK}}};
+  if (!group.open_events({true})) {
+    GTEST_SKIP() << "perf events are not available";
+  }
+
+  volatile uint64_t sum = 0;
+  for (auto i = 0; i < 1000000; ++i) {
+    sum = sum + i;
+  }
+  uint64_t enabled = 0;
+  uint64_t running = 0;
+  ASSERT_TRUE(group.read_times(0, &enabled, &running));
+  // a software event is always scheduled
+  EXPECT_GT(running, 0);
+  EXPECT_GE(enabled, running);
+  // no group on a CPU that is not online
+  EXPECT_FALSE(group.read_times(1, &enabled, &running));
+}
+
+// keep the CPU busy for a while, so the cpu clock of a group opened before is well ahead of
+// the time between two reads
+void spin(std::chrono::milliseconds duration) {
+  auto end = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < end) {
+  }
+}
+
+TEST(PerfMetrics, UpdateCpus) {
+  using std::chrono::steady_clock;
+  atlasagent::PerfGroup group{{{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK}}};
+  if (!group.open_events({true})) {
+    GTEST_SKIP() << "perf events are not available";
+  }
+  spin(std::chrono::milliseconds(100));
+  auto start = steady_clock::now();
+  ASSERT_TRUE(group.read_delta());
+
+  // an offline CPU does not affect the others, which keep their baselines: the cpu clock only
+  // covers the time since the previous read, not the time since the open
+  ASSERT_TRUE(group.update_cpus({true, false}));
+  ASSERT_TRUE(group.read_delta());
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now() - start);
+  ASSERT_EQ(group.deltas(0).size(), 1);
+  EXPECT_LE(group.deltas(0)[0], static_cast<uint64_t>(elapsed.count()));
+
+  ASSERT_TRUE(group.update_cpus({false}));
+  ASSERT_TRUE(group.read_delta());
+  EXPECT_TRUE(group.deltas(0).empty());
+}
+
+TEST(PerfMetrics, OpenEventsResetsBaselines) {
+  using std::chrono::steady_clock;
+  atlasagent::PerfGroup group{{{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK}}};
+  if (!group.open_events({true})) {
+    GTEST_SKIP() << "perf events are not available";
+  }
+  spin(std::chrono::milliseconds(100));
+  ASSERT_TRUE(group.read_delta());
+
+  // the new events start from 0, the values of the old ones are not their baselines
+  auto start = steady_clock::now();
+  ASSERT_TRUE(group.open_events({true}));
+  ASSERT_TRUE(group.read_delta());
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now() - start);
+  ASSERT_EQ(group.deltas(0).size(), 1);
+  EXPECT_LE(group.deltas(0)[0], static_cast<uint64_t>(elapsed.count()));
+}
+
+TEST(PerfMetrics, CpuUevent) {
+  constexpr char kOnline[] =
+      "online@/devices/system/cpu/cpu3\0ACTION=online\0DEVPATH=/devices/system/cpu/cpu3\0"
+      "SUBSYSTEM=cpu\0SEQNUM=4321";
+  EXPECT_TRUE(atlasagent::is_cpu_uevent(kOnline, sizeof kOnline - 1));
+
+  constexpr char kBlock[] =
+      "add@/devices/virtual/block/loop0\0ACTION=add\0SUBSYSTEM=block\0DEVNAME=loop0\0"
+      "SUBSYSTEM=cpufreq";
+  EXPECT_FALSE(atlasagent::is_cpu_uevent(kBlock, sizeof kBlock - 1));
+}
+
+TEST(PerfMetrics, CgroupEvents) {
+  atlasagent::UnixFile cgroup{open("/sys/fs/cgroup", O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+  atlasagent::PerfGroup group{{{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK},
+                               {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES}}};
+  group.set_cgroup(cgroup);
+  if (cgroup < 0 || !group.open_events({true}) || !group.read_delta() ||
+      group.deltas(0).empty()) {
+    GTEST_SKIP() << "cgroup perf events are not available";
+  }
+
+  volatile uint64_t sum = 0;
+  for (auto i = 0; i < 1000000; ++i) {
+    sum = sum + i;
+  }
+  ASSERT_TRUE(group.read_delta());
+  // this test runs in the root cgroup or one of its descendants
+  EXPECT_GT(group.deltas(0)[0], 0);
+}
+
+TEST(PerfMetrics, ParseMetric) {
+  auto metric = atlasagent::parse_perf_metric("sys.cpu.llcMissRate = LLC-load-misses / LLC-loads");
+  ASSERT_TRUE(metric.has_value());
+  EXPECT_EQ(metric->name, "sys.cpu.llcMissRate");
+  EXPECT_EQ(metric->numerator, "LLC-load-misses");
+  EXPECT_EQ(metric->denominator, "LLC-loads");
+
+  metric = atlasagent::parse_perf_metric("sys.cpu.majorFaults=major-faults");
+  ASSERT_TRUE(metric.has_value());
+  EXPECT_EQ(metric->numerator, "major-faults");
+  EXPECT_TRUE(metric->denominator.empty());
+
+  EXPECT_FALSE(atlasagent::parse_perf_metric("sys.cpu.foo = foo").has_value());
+  EXPECT_FALSE(atlasagent::parse_perf_metric("sys.cpu.foo = cycles / foo").has_value());
+  EXPECT_FALSE(atlasagent::parse_perf_metric(" = cycles").has_value());
+  EXPECT_FALSE(atlasagent::parse_perf_metric("cycles").has_value());
+
+  auto event = atlasagent::lookup_perf_event("dTLB-load-misses");
+  ASSERT_TRUE(event.has_value());
+  EXPECT_EQ(event->type, PERF_TYPE_HW_CACHE);
+  EXPECT_EQ(event->config, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+}
+
+TEST(PerfMetrics, ConfigDirectory) {
+  auto config = atlasagent::parse_perf_events_config_directory("testdata/resources/perf-events");
+  ASSERT_TRUE(config.has_value());
+  // invalid.perf-events is skipped since one of its metrics is not valid
+  ASSERT_EQ(config->size(), 3);
+  std::vector<std::string> names;
+  for (const auto& m : *config) {
+    names.push_back(m.name);
+  }
+  std::sort(names.begin(), names.end());
+  EXPECT_EQ(names, (std::vector<std::string>{"sys.cpu.contextSwitches", "sys.cpu.dtlbMissRate",
+                                             "sys.cpu.stalledCyclesFrontend"}));
+
+  EXPECT_FALSE(atlasagent::parse_perf_events_config_directory("testdata/nonexistent").has_value());
+}
+
+TEST(PerfMetrics, Probe) {
+  atlasagent::PerfEventConfig context_switches{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES};
+  if (!atlasagent::PerfGroup::probe(context_switches, 0, -1)) {
+    GTEST_SKIP() << "perf events are not available";
+  }
+  atlasagent::PerfEventConfig invalid{PERF_TYPE_SOFTWARE, 1000};
+  EXPECT_FALSE(atlasagent::PerfGroup::probe(invalid, 0, -1));
+}
+
+}  // namespace
@@ -0,0 +1,74 @@
+#include "pressure_file.h"
+#include <cstring>
+
+namespace atlasagent {
+
+namespace {
+constexpr char kTotal[] = "total=";
+constexpr size_t kTotalLen = sizeof kTotal - 1;
+
+inline int64_t parse_total(const char* p, const char* end) noexcept {
+  // total= is the last field, so search backwards from the end of the line
+  for (auto q = end; q - p >= static_cast<std::ptrdiff_t>(kTotalLen); --q) {
+    auto field = q - kTotalLen;
+    if (memcmp(field, kTotal, kTotalLen) != 0) {
+      continue;
+    }
+    int64_t n = 0;
+    auto start = q;
+    for (; q < end && *q >= '0' && *q <= '9'; ++q) {
+      n = n * 10 + (*q - '0');
+    }
+    return q == start ? -1 : n;
+  }
+  return -1;
+}
+}  // namespace
+
+PressureTotals parse_pressure(const char* begin, const char* end) noexcept {
+  PressureTotals totals;
+  for (auto p = begin; p < end;) {
+    auto nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+    auto line_end = nl == nullptr ? end : nl;
+    if (line_end - p > 5 && p[4] == ' ') {
+      if (memcmp(p, "some", 4) == 0) {
+        totals.some_usec = parse_total(p + 5, line_end);
+      } else if (memcmp(p, "full", 4) == 0) {
+        totals.full_usec = parse_total(p + 5, line_end);
+      }
+    }
+    p = line_end + 1;
+  }
+  return totals;
+}
+
+void PressureFile::set_path(std::string path) noexcept {
+  path_ = std::move(path);
+  // force the file to be opened again
+  fd_.reset();
+  open_failed_ = false;
+}
+
+bool PressureFile::read(PressureTotals* totals) noexcept {
+  if (fd_ < 0) {
+    if (open_failed_) {
+      return false;
+    }
+    fd_.open(path_.c_str());
+    if (fd_ < 0) {
+      // PSI is not enabled on every kernel, do not keep trying (and logging) every second
+      open_failed_ = true;
+      return false;
+    }
+  }
+
+  auto len = pread_all(fd_, &buf_);
+  if (len < 0) {
+    Logger()->warn("Unable to read {}: {}", path_, strerror(errno));
+    return false;
+  }
+  *totals = parse_pressure(buf_.data(), buf_.data() + len);
+  return true;
+}
+
+}  // namespace atlasagent
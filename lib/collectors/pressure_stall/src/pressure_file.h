@@ -0,0 +1,38 @@
+#pragma once
+
+#include <lib/files/src/files.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace atlasagent {
+
+// cumulative stall time from the total= field of a pressure file, -1 if not present
+struct PressureTotals {
+  int64_t some_usec{-1};
+  int64_t full_usec{-1};
+};
+
+// parse the contents of a pressure file:
+//   some avg10=0.00 avg60=0.00 avg300=0.00 total=1234
+//   full avg10=0.00 avg60=0.00 avg300=0.00 total=567
+PressureTotals parse_pressure(const char* begin, const char* end) noexcept;
+
+/// A pressure file kept open and re-read from the start on every sample, so it can be sampled
+/// every second without opening it again or allocating.
+class PressureFile {
+ public:
+  PressureFile() = default;
+
+  void set_path(std::string path) noexcept;
+  // returns false if the file could not be read
+  bool read(PressureTotals* totals) noexcept;
+
+ private:
+  std::string path_;
+  UnixFile fd_{-1};
+  bool open_failed_{false};
+  std::vector<char> buf_;
+};
+
+}  // namespace atlasagent
@@ -1,4 +1,5 @@
 #include "pressure_stall.h"
+#include <fmt/format.h>
 
 namespace atlasagent {
 
@@ -7,43 +8,108 @@ template class PressureStall<spectator::TestRegistry>;
 
 template <typename Reg>
 PressureStall<Reg>::PressureStall(Reg* registry, const std::string path_prefix) noexcept
-  : registry_(registry), path_prefix_(std::move(path_prefix)) {}
+  : registry_(registry), path_prefix_(std::move(path_prefix)) {
+  set_prefix(path_prefix_);
+  for (size_t i = 0; i < kNumResources; ++i) {
+    peak_some_[i] = registry_->GetMaxGauge("sys.pressure.peak",
+                                           {{"id", kResources[i]}, {"kind", "some"}});
+    if (i > 0) {
+      peak_full_[i] = registry_->GetMaxGauge("sys.pressure.peak",
+                                             {{"id", kResources[i]}, {"kind", "full"}});
+    }
+  }
+}
 
 template <typename Reg>
 void PressureStall<Reg>::set_prefix(std::string new_prefix) noexcept {
   path_prefix_ = std::move(new_prefix);
+  for (size_t i = 0; i < kNumResources; ++i) {
+    files_[i].set_path(fmt::format("{}/{}", path_prefix_, kResources[i]));
+  }
 }
 
 template <typename Reg>
 void PressureStall<Reg>::update_stats() noexcept {
-  auto lines = read_lines_fields(path_prefix_, "cpu");
-  if (lines.size() == 2) {
-    auto some = registry_->GetMonotonicCounter(Id::of("sys.pressure.some", Tags{{"id", "cpu"}}));
-    auto usecs = std::strtoul(lines[0][4].substr(6).c_str(), nullptr, 10);
-    some->Set(usecs / MICROS);
+  for (size_t i = 0; i < kNumResources; ++i) {
+    PressureTotals totals;
+    if (!files_[i].read(&totals)) {
+      continue;
+    }
+    auto resource = kResources[i];
+    if (totals.some_usec >= 0) {
+      auto some = registry_->GetMonotonicCounter(Id::of("sys.pressure.some", Tags{{"id", resource}}));
+      some->Set(totals.some_usec / MICROS);
+    }
+    // cpu full is not defined at the system level
+    if (i > 0 && totals.full_usec >= 0) {
+      auto full = registry_->GetMonotonicCounter(Id::of("sys.pressure.full", Tags{{"id", resource}}));
+      full->Set(totals.full_usec / MICROS);
+    }
   }
+}
 
-  lines = read_lines_fields(path_prefix_, "io");
-  if (lines.size() == 2) {
-    auto some = registry_->GetMonotonicCounter(Id::of("sys.pressure.some", Tags{{"id", "io"}}));
-    auto usecs = std::strtoul(lines[0][4].substr(6).c_str(), nullptr, 10);
-    some->Set(usecs / MICROS);
+template <typename Reg>
+void PressureStall<Reg>::do_peak_stats(absl::Time now) noexcept {
+  auto delta_t = absl::ToDoubleSeconds(now - last_peak_updated_);
+  auto have_prev = last_peak_updated_ != absl::UnixEpoch() && delta_t > 0;
+  last_peak_updated_ = now;
 
-    auto full = registry_->GetMonotonicCounter(Id::of("sys.pressure.full", Tags{{"id", "io"}}));
-    usecs = std::strtoul(lines[1][4].substr(6).c_str(), nullptr, 10);
-    full->Set(usecs / MICROS);
+  auto set_peak = [&](typename Reg::max_gauge_t* gauge, int64_t cur, int64_t prev) {
+    if (have_prev && cur >= 0 && prev >= 0 && cur >= prev) {
+      auto stalled = (cur - prev) / MICROS;
+      gauge->Set(stalled / delta_t * 100);
+    }
+  };
+  for (size_t i = 0; i < kNumResources; ++i) {
+    PressureTotals totals;
+    if (!files_[i].read(&totals)) {
+      continue;
+    }
+    set_peak(peak_some_[i].get(), totals.some_usec, prev_peak_[i].some_usec);
+    if (i > 0) {
+      set_peak(peak_full_[i].get(), totals.full_usec, prev_peak_[i].full_usec);
+    }
+    prev_peak_[i] = totals;
   }
+}
 
-  lines = read_lines_fields(path_prefix_, "memory");
-  if (lines.size() == 2) {
-    auto some = registry_->GetMonotonicCounter(Id::of("sys.pressure.some", Tags{{"id", "memory"}}));
-    auto usecs = std::strtoul(lines[0][4].substr(6).c_str(), nullptr, 10);
-    some->Set(usecs / MICROS);
+template <typename Reg>
+bool PressureStall<Reg>::enable_triggers(const char* suffix, absl::Duration threshold,
+                                         absl::Duration window) noexcept {
+  triggers_ = std::make_unique<PsiTriggers>(threshold, window);
+  for (auto resource : {"cpu", "io", "memory"}) {
+    triggers_->add(fmt::format("{}/{}{}", path_prefix_, resource, suffix), resource);
+  }
+  if (triggers_->empty()) {
+    triggers_.reset();
+    return false;
+  }
+  trigger_meters_.clear();
+  for (const auto& t : triggers_->triggers()) {
+    trigger_meters_.push_back(
+        {registry_->GetCounter("sys.pressure.breaches", {{"id", t.resource}}),
+         registry_->GetTimer("sys.pressure.burstDuration", {{"id", t.resource}})});
+  }
+  return true;
+}
 
-    auto full = registry_->GetMonotonicCounter(Id::of("sys.pressure.full", Tags{{"id", "memory"}}));
-    usecs = std::strtoul(lines[1][4].substr(6).c_str(), nullptr, 10);
-    full->Set(usecs / MICROS);
+template <typename Reg>
+void PressureStall<Reg>::do_trigger_stats(absl::Time now) noexcept {
+  if (!triggers_) {
+    return;
+  }
+  triggers_->poll(now);
+  const auto& triggers = triggers_->triggers();
+  for (size_t i = 0; i < triggers.size(); ++i) {
+    const auto& t = triggers[i];
+    if (t.breaches > 0) {
+      trigger_meters_[i].breaches->Add(t.breaches);
+    }
+    for (auto duration : t.bursts) {
+      trigger_meters_[i].burst_duration->Record(duration);
+    }
   }
+  triggers_->clear();
 }
 
 }  // namespace atlasagent
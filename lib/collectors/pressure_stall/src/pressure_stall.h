@@ -1,8 +1,11 @@
 #pragma once
 
+#include "pressure_file.h"
+#include "psi_triggers.h"
 #include <absl/strings/str_split.h>
 #include <lib/tagging/src/tagging_registry.h>
 #include <lib/util/src/util.h>
+#include <array>
 
 namespace atlasagent {
 
@@ -19,9 +22,46 @@ class PressureStall {
 
   void update_stats() noexcept;
 
+  // largest share of time stalled over one second, computed from the change in the totals
+  // since the previous call. Meant to be called every second
+  void peak_stats() noexcept { do_peak_stats(absl::Now()); }
+
+  // arm PSI triggers on the cpu, io and memory pressure files under the prefix, named
+  // {prefix}/{resource}{suffix}: no suffix for /proc/pressure, .pressure for a cgroup.
+  // Returns false if no trigger could be set
+  bool enable_triggers(const char* suffix = "",
+                       absl::Duration threshold = absl::Milliseconds(150),
+                       absl::Duration window = absl::Seconds(1)) noexcept;
+
+  // report the threshold breaches and the stall bursts that ended since the last call.
+  // Meant to be called every second
+  void trigger_stats() noexcept { do_trigger_stats(absl::Now()); }
+
+ protected:
+  // for testing
+  void do_peak_stats(absl::Time now) noexcept;
+  void do_trigger_stats(absl::Time now) noexcept;
+
  private:
+  static constexpr size_t kNumResources = 3;
+  static constexpr const char* kResources[kNumResources] = {"cpu", "io", "memory"};
+
   Reg* registry_;
   std::string path_prefix_;
+  std::array<PressureFile, kNumResources> files_;
+  std::array<PressureTotals, kNumResources> prev_peak_;
+  // sys.pressure.peak for each resource, looked up once since they are updated every second.
+  // cpu has no full series at the system level
+  std::array<typename Reg::max_gauge_ptr, kNumResources> peak_some_;
+  std::array<typename Reg::max_gauge_ptr, kNumResources> peak_full_;
+  absl::Time last_peak_updated_;
+  std::unique_ptr<PsiTriggers> triggers_;
+  // the meters for each trigger, in the same order as triggers_->triggers()
+  struct TriggerMeters {
+    typename Reg::counter_ptr breaches;
+    typename Reg::timer_ptr burst_duration;
+  };
+  std::vector<TriggerMeters> trigger_meters_;
   static constexpr double MICROS = 1000 * 1000.0;
 };
 }  // namespace atlasagent
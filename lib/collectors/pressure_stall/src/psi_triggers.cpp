@@ -0,0 +1,112 @@
+#include "psi_triggers.h"
+#include <fmt/format.h>
+#include <linux/magic.h>
+#include <sys/epoll.h>
+#include <sys/vfs.h>
+
+namespace atlasagent {
+
+void PsiBurst::event(absl::Time now, absl::Duration window) noexcept {
+  if (!active) {
+    active = true;
+    start = now - window;
+  }
+  last_event = now;
+}
+
+bool PsiBurst::expire(absl::Time now, absl::Duration window, absl::Duration* duration) noexcept {
+  // allow for the events not being checked exactly once per window
+  if (!active || now - last_event <= 2 * window) {
+    return false;
+  }
+  active = false;
+  *duration = last_event - start;
+  return true;
+}
+
+PsiTriggers::PsiTriggers(absl::Duration threshold, absl::Duration window) noexcept
+    : threshold_{threshold}, window_{window}, epoll_fd_{epoll_create1(EPOLL_CLOEXEC)} {
+  if (epoll_fd_ < 0) {
+    Logger()->warn("Unable to create epoll descriptor for PSI triggers: {}", strerror(errno));
+  }
+}
+
+bool PsiTriggers::add(const std::string& file_name, std::string resource) noexcept {
+  if (epoll_fd_ < 0) {
+    return false;
+  }
+  UnixFile fd{open(file_name.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC)};
+  if (fd < 0) {
+    Logger()->info("PSI trigger not available for {}: {}", file_name, strerror(errno));
+    return false;
+  }
+  // only write the trigger to the files the kernel provides
+  struct statfs fs {};
+  if (fstatfs(fd, &fs) != 0 ||
+      (fs.f_type != PROC_SUPER_MAGIC && fs.f_type != CGROUP2_SUPER_MAGIC)) {
+    Logger()->warn("Not setting a PSI trigger on {}: not a pressure file", file_name);
+    return false;
+  }
+
+  auto trigger = fmt::format("some {} {}", absl::ToInt64Microseconds(threshold_),
+                             absl::ToInt64Microseconds(window_));
+  // the trigger is null terminated, as described in the kernel documentation
+  if (write(fd, trigger.c_str(), trigger.size() + 1) < 0) {
+    Logger()->info("Unable to set PSI trigger on {}: {}", file_name, strerror(errno));
+    return false;
+  }
+
+  struct epoll_event ev {};
+  ev.events = EPOLLPRI;
+  ev.data.u64 = triggers_.size();
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    Logger()->warn("Unable to watch PSI trigger on {}: {}", file_name, strerror(errno));
+    return false;
+  }
+
+  auto& t = triggers_.emplace_back();
+  t.resource = std::move(resource);
+  t.fd.reset(fd.release());
+  return true;
+}
+
+void PsiTriggers::poll(absl::Time now) noexcept {
+  if (triggers_.empty()) {
+    return;
+  }
+  struct epoll_event events[16];
+  constexpr int kMaxEvents = sizeof events / sizeof events[0];
+  for (int n = kMaxEvents; n == kMaxEvents;) {
+    n = epoll_wait(epoll_fd_, events, kMaxEvents, 0);
+    if (n < 0 && errno == EINTR) {
+      n = kMaxEvents;
+      continue;
+    }
+    for (int i = 0; i < n; ++i) {
+      auto& t = triggers_[events[i].data.u64];
+      if ((events[i].events & EPOLLERR) != 0) {
+        // the cgroup went away, stop watching it
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, t.fd, nullptr);
+        continue;
+      }
+      ++t.breaches;
+      t.burst.event(now, window_);
+    }
+  }
+
+  for (auto& t : triggers_) {
+    absl::Duration duration;
+    if (t.burst.expire(now, window_, &duration)) {
+      t.bursts.push_back(duration);
+    }
+  }
+}
+
+void PsiTriggers::clear() noexcept {
+  for (auto& t : triggers_) {
+    t.breaches = 0;
+    t.bursts.clear();
+  }
+}
+
+}  // namespace atlasagent
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <lib/files/src/files.h>
+#include <absl/time/time.h>
+#include <string>
+#include <vector>
+
+namespace atlasagent {
+
+/// Tracks a stall burst from the trigger events of a single pressure file. The kernel raises
+/// a trigger at most once per window while the stall lasts, so a burst ends once a couple of
+/// windows go by without an event.
+struct PsiBurst {
+  bool active{false};
+  absl::Time start;
+  absl::Time last_event;
+
+  // a trigger fired at time now: the threshold was exceeded during the previous window
+  void event(absl::Time now, absl::Duration window) noexcept;
+  // returns true, setting *duration, if an active burst has ended by time now
+  bool expire(absl::Time now, absl::Duration window, absl::Duration* duration) noexcept;
+};
+
+/// PSI triggers on a set of pressure files (/proc/pressure/* or the cgroup *.pressure files).
+/// Writing "some <threshold> <window>" to a pressure file makes the kernel raise POLLPRI on it
+/// whenever the stall time within a window exceeds the threshold. Every trigger is registered
+/// with a single epoll descriptor, so checking them is one non-blocking epoll_wait that finds
+/// nothing while the system is quiet, and short bursts that would not move the cumulative
+/// totals reported every minute are still noticed.
+class PsiTriggers {
+ public:
+  struct Trigger {
+    std::string resource;
+    UnixFile fd{-1};
+    PsiBurst burst;
+    // since the last call to clear
+    uint64_t breaches{0};
+    std::vector<absl::Duration> bursts;
+  };
+
+  PsiTriggers(absl::Duration threshold, absl::Duration window) noexcept;
+
+  // arm a trigger on a pressure file. Returns false if the file does not exist or the kernel
+  // does not allow the trigger (older kernels, or missing privileges)
+  bool add(const std::string& file_name, std::string resource) noexcept;
+
+  // check which triggers fired since the last call, without blocking
+  void poll(absl::Time now) noexcept;
+
+  [[nodiscard]] bool empty() const noexcept { return triggers_.empty(); }
+  [[nodiscard]] const std::vector<Trigger>& triggers() const noexcept { return triggers_; }
+  // reset the breaches and bursts once they have been reported
+  void clear() noexcept;
+
+ private:
+  absl::Duration threshold_;
+  absl::Duration window_;
+  UnixFile epoll_fd_;
+  std::vector<Trigger> triggers_;
+};
+
+}  // namespace atlasagent
@@ -17,6 +17,9 @@ class PressureStallTest : public PressureStall<Registry> {
   void stats() {
     PressureStall::update_stats();
   }
+
+  void peak_stats(absl::Time now) { PressureStall::do_peak_stats(now); }
+  void trigger_stats(absl::Time now) { PressureStall::do_trigger_stats(now); }
 };
 
 TEST(PressureStall, UpdateStats) {
@@ -42,4 +45,85 @@ TEST(PressureStall, UpdateStats) {
       {"sys.pressure.full|count|memory", 0.5}};
   EXPECT_EQ(map, expected);
 }
+
+TEST(PressureStall, ParsePressure) {
+  std::string contents =
+      "some avg10=1.50 avg60=0.18 avg300=0.18 total=123456\n"
+      "full avg10=0.00 avg60=0.00 avg300=0.00 total=789\n";
+  auto totals = atlasagent::parse_pressure(contents.data(), contents.data() + contents.size());
+  EXPECT_EQ(totals.some_usec, 123456);
+  EXPECT_EQ(totals.full_usec, 789);
+
+  // older kernels do not have a full line for cpu
+  contents = "some avg10=0.00 avg60=0.00 avg300=0.00 total=42";
+  totals = atlasagent::parse_pressure(contents.data(), contents.data() + contents.size());
+  EXPECT_EQ(totals.some_usec, 42);
+  EXPECT_EQ(totals.full_usec, -1);
+
+  contents = "some avg10=0.00\n";
+  totals = atlasagent::parse_pressure(contents.data(), contents.data() + contents.size());
+  EXPECT_EQ(totals.some_usec, -1);
+}
+
+TEST(PressureStall, PeakStats) {
+  Registry registry;
+  PressureStallTest pressure{&registry, "testdata/resources/proc/pressure"};
+
+  auto now = absl::Now();
+  pressure.peak_stats(now);
+  EXPECT_EQ(registry.Measurements().size(), 0);
+
+  pressure.set_prefix("testdata/resources/proc2/pressure");
+  pressure.peak_stats(now + absl::Seconds(10));
+  auto map = measurements_to_map(registry.Measurements(), "kind");
+  std::unordered_map<std::string, double> expected = {
+      {"sys.pressure.peak|max|cpu|some", 10},
+      {"sys.pressure.peak|max|io|some", 10},
+      {"sys.pressure.peak|max|memory|some", 10},
+      {"sys.pressure.peak|max|io|full", 5},
+      {"sys.pressure.peak|max|memory|full", 5}};
+  EXPECT_EQ(map, expected);
+}
+
+TEST(PressureStall, Burst) {
+  atlasagent::PsiBurst burst;
+  auto window = absl::Seconds(1);
+  auto now = absl::Now();
+  absl::Duration duration;
+  EXPECT_FALSE(burst.expire(now, window, &duration));
+
+  // a trigger fired on three consecutive checks
+  burst.event(now, window);
+  burst.event(now + absl::Seconds(1), window);
+  burst.event(now + absl::Seconds(2), window);
+  EXPECT_FALSE(burst.expire(now + absl::Seconds(3), window, &duration));
+  EXPECT_FALSE(burst.expire(now + absl::Seconds(4), window, &duration));
+  EXPECT_TRUE(burst.expire(now + absl::Seconds(5), window, &duration));
+  EXPECT_EQ(duration, absl::Seconds(3));
+  EXPECT_FALSE(burst.active);
+
+  // a single event covers one window
+  burst.event(now + absl::Seconds(10), window);
+  EXPECT_TRUE(burst.expire(now + absl::Seconds(13), window, &duration));
+  EXPECT_EQ(duration, absl::Seconds(1));
+}
+
+TEST(PressureStall, TriggersNeedPressureFiles) {
+  Registry registry;
+  PressureStallTest pressure{&registry, "testdata/resources/proc/pressure"};
+  auto before = atlasagent::read_lines_fields("testdata/resources/proc/pressure", "cpu");
+
+  // regular files are never written to
+  EXPECT_FALSE(pressure.enable_triggers());
+  auto after = atlasagent::read_lines_fields("testdata/resources/proc/pressure", "cpu");
+  EXPECT_EQ(before, after);
+
+  // no triggers, nothing to report
+  pressure.trigger_stats(absl::Now());
+  EXPECT_EQ(registry.Measurements().size(), 0);
+
+  atlasagent::PsiTriggers triggers{absl::Milliseconds(150), absl::Seconds(1)};
+  EXPECT_FALSE(triggers.add("testdata/resources/proc/pressure/nonexistent", "cpu"));
+  EXPECT_TRUE(triggers.empty());
+}
 }  // namespace
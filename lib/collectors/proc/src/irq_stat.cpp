@@ -0,0 +1,139 @@
+#include "irq_stat.h"
+#include <lib/files/src/files.h>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace atlasagent {
+
+namespace {
+inline const char* skip_spaces(const char* p, const char* end) noexcept {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    ++p;
+  }
+  return p;
+}
+
+inline bool is_digit(char c) noexcept { return c >= '0' && c <= '9'; }
+
+// number of CPUn columns in the header
+inline size_t count_cpus(const char* p, const char* end) noexcept {
+  size_t n = 0;
+  for (p = skip_spaces(p, end); end - p > 3 && memcmp(p, "CPU", 3) == 0;) {
+    ++n;
+    p += 3;
+    while (p < end && is_digit(*p)) {
+      ++p;
+    }
+    p = skip_spaces(p, end);
+  }
+  return n;
+}
+}  // namespace
+
+bool IrqStat::refresh(const std::string& file_name) noexcept {
+  UnixFile fd{file_name.c_str()};
+  if (fd < 0) {
+    return false;
+  }
+  auto len = read_all(fd, &buf_);
+  if (len < 0) {
+    Logger()->warn("Unable to read {}: {}", file_name, strerror(errno));
+    return false;
+  }
+  parse(buf_.data(), buf_.data() + len);
+  return true;
+}
+
+IrqStat::Type* IrqStat::type_for(std::string_view name) noexcept {
+  for (auto& type : types_) {
+    if (type.name == name) {
+      return &type;
+    }
+  }
+  auto& type = types_.emplace_back();
+  type.name.assign(name.data(), name.size());
+  return &type;
+}
+
+void IrqStat::parse(const char* begin, const char* end) noexcept {
+  auto header_end = static_cast<const char*>(memchr(begin, '\n', static_cast<size_t>(end - begin)));
+  if (header_end == nullptr) {
+    return;
+  }
+  auto num_cpus = count_cpus(begin, header_end);
+  // cpus going online or offline change the columns, so the previous values can't be used
+  auto same_cpus = num_cpus == num_cpus_;
+  num_cpus_ = num_cpus;
+  for (auto& type : types_) {
+    type.prev_per_cpu.swap(type.per_cpu);
+    type.has_prev = type.present && same_cpus;
+    type.present = false;
+    type.per_cpu.assign(num_cpus, 0);
+  }
+
+  for (auto p = header_end + 1; p < end;) {
+    auto nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+    auto line_end = nl == nullptr ? end : nl;
+    auto label = skip_spaces(p, line_end);
+    auto colon = static_cast<const char*>(memchr(label, ':', static_cast<size_t>(line_end - label)));
+    p = line_end + 1;
+    if (colon == nullptr) {
+      continue;
+    }
+
+    std::string_view name{label, static_cast<size_t>(colon - label)};
+    if (group_numbered_ && !name.empty() && is_digit(name[0])) {
+      name = "device";
+    }
+    auto type = type_for(name);
+    if (type->per_cpu.size() != num_cpus) {
+      // first time this type is seen
+      type->per_cpu.assign(num_cpus, 0);
+    }
+    type->present = true;
+
+    // rows like ERR: or MIS: only have a single value, and rows end with a description
+    auto values = type->per_cpu.data();
+    auto q = colon + 1;
+    for (size_t cpu = 0; cpu < num_cpus; ++cpu) {
+      q = skip_spaces(q, line_end);
+      if (q == line_end || !is_digit(*q)) {
+        break;
+      }
+      uint64_t n = 0;
+      for (; q < line_end && is_digit(*q); ++q) {
+        n = n * 10 + static_cast<uint64_t>(*q - '0');
+      }
+      values[cpu] += n;
+    }
+  }
+}
+
+uint64_t IrqStat::total(const Type& type) noexcept {
+  return std::accumulate(type.per_cpu.begin(), type.per_cpu.end(), uint64_t{0});
+}
+
+bool IrqStat::imbalance(const Type& type, uint64_t* max_delta, double* ratio) noexcept {
+  if (!type.present || !type.has_prev || type.per_cpu.size() != type.prev_per_cpu.size()) {
+    return false;
+  }
+  uint64_t max = 0;
+  uint64_t sum = 0;
+  for (size_t i = 0; i < type.per_cpu.size(); ++i) {
+    auto cur = type.per_cpu[i];
+    auto prev = type.prev_per_cpu[i];
+    auto delta = cur > prev ? cur - prev : 0;
+    max = std::max(max, delta);
+    sum += delta;
+  }
+  if (sum == 0) {
+    return false;
+  }
+  *max_delta = max;
+  *ratio = static_cast<double>(max) * static_cast<double>(type.per_cpu.size()) /
+           static_cast<double>(sum);
+  return true;
+}
+
+}  // namespace atlasagent
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace atlasagent {
+
+/// Per-cpu counters from /proc/interrupts or /proc/softirqs. Both files start with a CPUn
+/// header followed by one row per interrupt type:
+///
+///              CPU0       CPU1
+///     NET_RX:  1234       5678
+///
+/// Rows can be several kilobytes wide on hosts with many cpus, so values are accumulated
+/// column by column into a per-cpu array for each type instead of splitting rows into tokens.
+/// When group_numbered is set, all the rows for numbered irqs (one per device queue) are
+/// added up into a single "device" type to keep the number of types bounded.
+class IrqStat {
+ public:
+  struct Type {
+    std::string name;
+    std::vector<uint64_t> per_cpu;
+    std::vector<uint64_t> prev_per_cpu;
+    bool present{false};
+    bool has_prev{false};
+  };
+
+  explicit IrqStat(bool group_numbered) noexcept : group_numbered_{group_numbered} {}
+
+  // read and parse the given file. Returns false if it could not be read
+  bool refresh(const std::string& file_name) noexcept;
+
+  // parse the contents of the file. Exposed for testing
+  void parse(const char* begin, const char* end) noexcept;
+
+  [[nodiscard]] size_t num_cpus() const noexcept { return num_cpus_; }
+  // types seen so far, check Type::present to know whether it was in the last file parsed
+  [[nodiscard]] const std::vector<Type>& types() const noexcept { return types_; }
+
+  [[nodiscard]] static uint64_t total(const Type& type) noexcept;
+  // largest per-cpu increase since the previous sample, and how it compares to the average
+  // across cpus (1 means evenly spread, num_cpus means everything landed on one cpu). Returns
+  // false if there is no previous sample or nothing happened in between
+  static bool imbalance(const Type& type, uint64_t* max_delta, double* ratio) noexcept;
+
+ private:
+  bool group_numbered_;
+  size_t num_cpus_{0};
+  std::vector<Type> types_;
+  std::vector<char> buf_;
+
+  Type* type_for(std::string_view name) noexcept;
+};
+
+}  // namespace atlasagent
@@ -3,6 +3,7 @@
 #include <absl/strings/str_split.h>
 #include <cinttypes>
 #include <cstring>
+#include <iterator>
 #include <utility>
 
 namespace atlasagent {
@@ -73,40 +74,140 @@ void Proc<Reg>::network_stats() noexcept {
   }
 }
 
-static constexpr const char* IP_STATS_LINE =
-    "Ip: %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu "
-    "%lu %lu";
-static constexpr size_t IP_STATS_PREFIX_LEN = 4;
-static constexpr const char* TCP_STATS_LINE =
-    "Tcp: %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu";
-static constexpr size_t TCP_STATS_PREFIX_LEN = 5;
-static constexpr const char* UDP_STATS_LINE = "Udp: %lu %lu %lu %lu";
-static constexpr size_t UDP_STATS_PREFIX_LEN = 5;
-static constexpr const char* LOADAVG_LINE = "%lf %lf %lf";
+namespace {
+// columns of /proc/net/snmp we report. The order must match SnmpColumn
+enum SnmpColumn : size_t {
+  kIpInReceives,
+  kIpInDiscards,
+  kIpOutRequests,
+  kIpOutDiscards,
+  kIpReasmReqds,
+  kTcpActiveOpens,
+  kTcpPassiveOpens,
+  kTcpAttemptFails,
+  kTcpEstabResets,
+  kTcpCurrEstab,
+  kTcpInSegs,
+  kTcpOutSegs,
+  kTcpRetransSegs,
+  kTcpInErrs,
+  kTcpOutRsts,
+  kUdpInDatagrams,
+  kUdpInErrors,
+  kUdpOutDatagrams,
+  kUdpRcvbufErrors,
+  kUdpSndbufErrors,
+};
+constexpr NetColumn kSnmpColumns[] = {
+    {"Ip", "InReceives"},     {"Ip", "InDiscards"},      {"Ip", "OutRequests"},
+    {"Ip", "OutDiscards"},    {"Ip", "ReasmReqds"},      {"Tcp", "ActiveOpens"},
+    {"Tcp", "PassiveOpens"},  {"Tcp", "AttemptFails"},   {"Tcp", "EstabResets"},
+    {"Tcp", "CurrEstab"},     {"Tcp", "InSegs"},         {"Tcp", "OutSegs"},
+    {"Tcp", "RetransSegs"},   {"Tcp", "InErrs"},         {"Tcp", "OutRsts"},
+    {"Udp", "InDatagrams"},   {"Udp", "InErrors"},       {"Udp", "OutDatagrams"},
+    {"Udp", "RcvbufErrors"},  {"Udp", "SndbufErrors"},
+};
+static_assert(std::size(kSnmpColumns) == kUdpSndbufErrors + 1);
 
-static constexpr int kConnStates = 12;
-void sum_tcp_states(FILE* fp, std::array<int, kConnStates>* connections) noexcept {
-  char line[2048];
-  // discard header
-  if (fgets(line, sizeof line, fp) == nullptr) {
-    return;
-  }
-  while (fgets(line, sizeof line, fp) != nullptr) {
-    std::vector<std::string> fields =
-        absl::StrSplit(line, absl::ByAnyChar("\n\t "), absl::SkipEmpty());
-    // all lines have at least 12 fields. Just being extra paranoid here:
-    if (fields.size() < 4) {
-      continue;
-    }
-    const char* st = fields[3].c_str();
-    auto state = static_cast<int>(strtol(st, nullptr, 16));
-    if (state < kConnStates) {
-      ++(*connections)[state];
-    } else {
-      Logger()->info("Ignoring connection state {} for line: {}", state, line);
-    }
-  }
-}
+// the monotonic counter reported for each SnmpColumn. CurrEstab is a gauge and has no entry
+struct SnmpMetric {
+  const char* name;
+  const char* id;
+  const char* proto;
+};
+constexpr SnmpMetric kSnmpMetrics[] = {
+    {"net.ip.datagrams", "in", "v4"},
+    {"net.ip.discards", "in", "v4"},
+    {"net.ip.datagrams", "out", "v4"},
+    {"net.ip.discards", "out", "v4"},
+    {"net.ip.reasmReqds", nullptr, "v4"},
+    {"net.tcp.opens", "active", nullptr},
+    {"net.tcp.opens", "passive", nullptr},
+    {"net.tcp.errors", "attemptFails", nullptr},
+    {"net.tcp.errors", "estabResets", nullptr},
+    {nullptr, nullptr, nullptr},
+    {"net.tcp.segments", "in", nullptr},
+    {"net.tcp.segments", "out", nullptr},
+    {"net.tcp.errors", "retransSegs", nullptr},
+    {"net.tcp.errors", "inErrs", nullptr},
+    {"net.tcp.errors", "outRsts", nullptr},
+    {"net.udp.datagrams", "in", "v4"},
+    {"net.udp.errors", "inErrors", "v4"},
+    {"net.udp.datagrams", "out", "v4"},
+    {"net.udp.errors", "rcvbufErrors", "v4"},
+    {"net.udp.errors", "sndbufErrors", "v4"},
+};
+static_assert(std::size(kSnmpMetrics) == std::size(kSnmpColumns));
+
+// the monotonic counters reported from net/snmp6, all with proto=v6
+struct Snmp6Metric {
+  const char* key;
+  const char* name;
+  const char* id;
+};
+constexpr Snmp6Metric kSnmp6Metrics[] = {
+    {"Ip6InReceives", "net.ip.datagrams", "in"},
+    {"Ip6InDiscards", "net.ip.discards", "in"},
+    {"Ip6OutRequests", "net.ip.datagrams", "out"},
+    {"Ip6OutDiscards", "net.ip.discards", "out"},
+    {"Ip6ReasmReqds", "net.ip.reasmReqds", nullptr},
+    // the ipv4 metrics for these come from net/netstat but net/snmp6 include them
+    {"Ip6InNoECTPkts", "net.ip.ectPackets", "notCapable"},
+    {"Ip6InCEPkts", "net.ip.congestedPackets", nullptr},
+    {"Udp6InDatagrams", "net.udp.datagrams", "in"},
+    {"Udp6InErrors", "net.udp.errors", "inErrors"},
+    {"Udp6OutDatagrams", "net.udp.datagrams", "out"},
+};
+
+// columns of /proc/net/netstat we report. The order must match NetstatColumn
+enum NetstatColumn : size_t {
+  kIpExtInNoECTPkts,
+  kIpExtInECT1Pkts,
+  kIpExtInECT0Pkts,
+  kIpExtInCEPkts,
+  kTcpExtListenOverflows,
+  kTcpExtListenDrops,
+  kTcpExtTCPTimeouts,
+  kTcpExtTCPBacklogDrop,
+  kTcpExtTCPRcvQDrop,
+  kTcpExtPruneCalled,
+};
+constexpr NetColumn kNetstatColumns[] = {
+    {"IpExt", "InNoECTPkts"},      {"IpExt", "InECT1Pkts"},     {"IpExt", "InECT0Pkts"},
+    {"IpExt", "InCEPkts"},         {"TcpExt", "ListenOverflows"}, {"TcpExt", "ListenDrops"},
+    {"TcpExt", "TCPTimeouts"},     {"TcpExt", "TCPBacklogDrop"}, {"TcpExt", "TCPRcvQDrop"},
+    {"TcpExt", "PruneCalled"},
+};
+static_assert(std::size(kNetstatColumns) == kTcpExtPruneCalled + 1);
+
+// the monotonic counter reported for each NetstatColumn. The IpExt columns are combined into the
+// ect counters instead
+constexpr SnmpMetric kNetstatMetrics[] = {
+    {nullptr, nullptr, nullptr},
+    {nullptr, nullptr, nullptr},
+    {nullptr, nullptr, nullptr},
+    {nullptr, nullptr, nullptr},
+    {"net.tcp.errors", "listenOverflows", nullptr},
+    {"net.tcp.errors", "listenDrops", nullptr},
+    {"net.tcp.errors", "timeouts", nullptr},
+    {"net.tcp.errors", "backlogDrops", nullptr},
+    {"net.tcp.errors", "rcvQueueDrops", nullptr},
+    {"net.tcp.errors", "pruneCalled", nullptr},
+};
+static_assert(std::size(kNetstatMetrics) == std::size(kNetstatColumns));
+
+// the metrics for each SoftnetField, in the same order
+struct SoftnetMetric {
+  const char* name;
+  const char* id;
+};
+constexpr SoftnetMetric kSoftnetMetrics[] = {
+    {"net.softnet.processed", "processed"},
+    {"net.softnet.dropped", "dropped"},
+    {"net.softnet.timeSqueeze", "timeSqueeze"},
+    {"net.softnet.receivedRps", "receivedRps"},
+};
+static_assert(std::size(kSoftnetMetrics) == kSoftnetFields);
 
 inline IdPtr create_id(const char* name, const Tags& tags, Tags extra) {
   Tags all_tags{tags};
@@ -138,265 +239,222 @@ inline auto make_tcp_gauges(Reg* registry_, const char* protocol, const Tags& ex
           tcpstate_gauge<Reg>(registry_, "closing", protocol, extra)};
 }
 
-template <typename Reg>
-inline void update_tcpstates_for_proto(
-    const std::array<typename Reg::gauge_ptr, kConnStates>& gauges, FILE* fp) {
-  std::array<int, kConnStates> connections{};
-  if (fp != nullptr) {
-    sum_tcp_states(fp, &connections);
-    for (auto i = 1; i < kConnStates; ++i) {
-      gauges[i]->Set(connections[i]);
-    }
+template <typename MonoCounter>
+inline void set_if_present(const std::unordered_map<std::string, int64_t>& stats, const char* key,
+                           MonoCounter* ctr) {
+  auto it = stats.find(key);
+  if (it != stats.end()) {
+    ctr->Set(it->second);
   }
 }
 
-template <typename Reg>
-void Proc<Reg>::parse_tcp_connections() noexcept {
-  static std::array<typename Reg::gauge_ptr, kConnStates> v4_states =
-      make_tcp_gauges(registry_, "v4", net_tags_);
-  static std::array<typename Reg::gauge_ptr, kConnStates> v6_states =
-      make_tcp_gauges(registry_, "v6", net_tags_);
-
-  update_tcpstates_for_proto<Reg>(v4_states, open_file(path_prefix_, "net/tcp"));
-  update_tcpstates_for_proto<Reg>(v6_states, open_file(path_prefix_, "net/tcp6"));
-}
-
-// replicate what snmpd is doing
-template <typename Reg>
-void Proc<Reg>::snmp_stats() noexcept {
-  auto fp = open_file(path_prefix_, "net/snmp");
-  if (fp == nullptr) {
-    return;
+template <typename Counter>
+inline void set_if_present(const ProcNetTable& table, size_t column, Counter* ctr) {
+  if (table.has(column)) {
+    ctr->Set(table.value(column));
   }
+}
+}  // namespace
 
-  char line[1024];
-  while (fgets(line, sizeof line, fp) != nullptr) {
-    if (strncmp(line, IP_STATS_LINE, IP_STATS_PREFIX_LEN) == 0) {
-      if (fgets(line, sizeof line, fp) != nullptr) {
-        parse_ip_stats(line);
-      }
-    } else if (strncmp(line, TCP_STATS_LINE, TCP_STATS_PREFIX_LEN) == 0) {
-      if (fgets(line, sizeof line, fp) != nullptr) {
-        parse_tcp_stats(line);
-      }
-    } else if (strncmp(line, UDP_STATS_LINE, UDP_STATS_PREFIX_LEN) == 0) {
-      if (fgets(line, sizeof line, fp) != nullptr) {
-        parse_udp_stats(line);
-      }
+// one counter per table entry, null for the entries without a name
+template <typename Reg, size_t N>
+auto make_counters(Reg* registry, const SnmpMetric (&metrics)[N], const Tags& net_tags)
+    -> std::vector<typename Reg::monotonic_counter_ptr> {
+  std::vector<typename Reg::monotonic_counter_ptr> counters;
+  counters.reserve(N);
+  for (const auto& metric : metrics) {
+    if (metric.name == nullptr) {
+      counters.emplace_back(nullptr);
+      continue;
+    }
+    Tags tags{net_tags};
+    if (metric.id != nullptr) {
+      tags.add("id", metric.id);
     }
+    if (metric.proto != nullptr) {
+      tags.add("proto", metric.proto);
+    }
+    counters.emplace_back(registry->GetMonotonicCounter(metric.name, tags));
   }
-
-  parse_tcp_connections();
-
-  std::unordered_map<std::string, int64_t> stats;
-  parse_kv_from_file(path_prefix_, "net/snmp6", &stats);
-  parse_ipv6_stats(stats);
-  parse_udpv6_stats(stats);
+  return counters;
 }
 
 template <typename Reg>
-void Proc<Reg>::parse_ipv6_stats(
-    const std::unordered_map<std::string, int64_t>& snmp_stats) noexcept {
-  static auto ipInReceivesCtr = registry_->GetMonotonicCounter(
-      create_id("net.ip.datagrams", {{"id", "in"}, {"proto", "v6"}}, net_tags_));
-  static auto ipInDicardsCtr = registry_->GetMonotonicCounter(
-      create_id("net.ip.discards", {{"id", "in"}, {"proto", "v6"}}, net_tags_));
-  static auto ipOutRequestsCtr = registry_->GetMonotonicCounter(
-      create_id("net.ip.datagrams", {{"id", "out"}, {"proto", "v6"}}, net_tags_));
-  static auto ipOutDiscardsCtr = registry_->GetMonotonicCounter(
-      create_id("net.ip.discards", {{"id", "out"}, {"proto", "v6"}}, net_tags_));
-  static auto ipReasmReqdsCtr =
-      registry_->GetMonotonicCounter(create_id("net.ip.reasmReqds", {{"proto", "v6"}}, net_tags_));
-
-  // the ipv4 metrics for these come from net/netstat but net/snmp6 include them
-  static auto ect_ctr = registry_->GetMonotonicCounter(
-      create_id("net.ip.ectPackets", {{"id", "capable"}, {"proto", "v6"}}, net_tags_));
-  static auto noEct_ctr = registry_->GetMonotonicCounter(
-      create_id("net.ip.ectPackets", {{"id", "notCapable"}, {"proto", "v6"}}, net_tags_));
-  static auto congested_ctr = registry_->GetMonotonicCounter(
-      create_id("net.ip.congestedPackets", {{"proto", "v6"}}, net_tags_));
-
-  auto in_receives = snmp_stats.find("Ip6InReceives");
-  auto in_discards = snmp_stats.find("Ip6InDiscards");
-  auto out_reqs = snmp_stats.find("Ip6OutRequests");
-  auto out_discards = snmp_stats.find("Ip6OutDiscards");
-  auto reassembly_reqd = snmp_stats.find("Ip6ReasmReqds");
-  auto ectCapable0 = snmp_stats.find("Ip6InECT0Pkts");
-  auto ectCapable1 = snmp_stats.find("Ip6InECT1Pkts");
-  auto noEct = snmp_stats.find("Ip6InNoECTPkts");
-  auto congested = snmp_stats.find("Ip6InCEPkts");
-
-  if (in_receives != snmp_stats.end()) {
-    ipInReceivesCtr->Set(in_receives->second);
-  }
-  if (in_discards != snmp_stats.end()) {
-    ipInDicardsCtr->Set(in_discards->second);
-  }
-  if (out_reqs != snmp_stats.end()) {
-    ipOutRequestsCtr->Set(out_reqs->second);
-  }
-  if (out_discards != snmp_stats.end()) {
-    ipOutDiscardsCtr->Set(out_discards->second);
-  }
-  if (reassembly_reqd != snmp_stats.end()) {
-    ipReasmReqdsCtr->Set(reassembly_reqd->second);
-  }
-  int64_t ectCapable = 0;
-  if (ectCapable0 != snmp_stats.end()) {
-    ectCapable += ectCapable0->second;
-  }
-  if (ectCapable1 != snmp_stats.end()) {
-    ectCapable += ectCapable1->second;
-  }
-  ect_ctr->Set(ectCapable);
-  if (noEct != snmp_stats.end()) {
-    noEct_ctr->Set(noEct->second);
-  }
-  if (congested != snmp_stats.end()) {
-    congested_ctr->Set(congested->second);
+Proc<Reg>::Proc(Reg* registry, spectator::Tags net_tags, std::string path_prefix) noexcept
+    : registry_(registry),
+      net_tags_{std::move(net_tags)},
+      path_prefix_(std::move(path_prefix)),
+      snmp_table_{kSnmpColumns},
+      netstat_table_{kNetstatColumns},
+      snmp_path_{fmt::format("{}/net/snmp", path_prefix_)},
+      netstat_path_{fmt::format("{}/net/netstat", path_prefix_)},
+      interrupts_path_{fmt::format("{}/interrupts", path_prefix_)},
+      softirqs_path_{fmt::format("{}/softirqs", path_prefix_)},
+      tcp_curr_estab_{registry->GetGauge("net.tcp.currEstab", net_tags_)},
+      ip_ect_{registry->GetMonotonicCounter(
+          create_id("net.ip.ectPackets", {{"id", "capable"}, {"proto", "v4"}}, net_tags_))},
+      ip_no_ect_{registry->GetMonotonicCounter(
+          create_id("net.ip.ectPackets", {{"id", "notCapable"}, {"proto", "v4"}}, net_tags_))},
+      ip_congested_{registry->GetMonotonicCounter(
+          create_id("net.ip.congestedPackets", {{"proto", "v4"}}, net_tags_))},
+      num_procs_{registry->GetGauge("sys.cpu.numProcessors")},
+      utilization_gauges_{registry, "sys.cpu.utilization",
+                          [](Reg* r, const char* name, const char* id) {
+                            return r->GetGauge(name, {{"id", id}});
+                          }},
+      cores_dist_summary_{registry, "sys.cpu.coreUtilization"},
+      peak_utilization_gauges_{registry, "sys.cpu.peakUtilization",
+                               [](Reg* r, const char* name, const char* id) {
+                                 return r->GetMaxGauge(name, {{"id", id}});
+                               }},
+      peak_core_{registry->GetMaxGauge("sys.cpu.peakCoreUtilization")},
+      saturated_cores_{registry->GetMaxGauge("sys.cpu.saturatedCores")},
+      ip6_ect_{registry->GetMonotonicCounter(
+          create_id("net.ip.ectPackets", {{"id", "capable"}, {"proto", "v6"}}, net_tags_))},
+      tcp_states_v4_{make_tcp_gauges(registry, "v4", net_tags_)},
+      tcp_states_v6_{make_tcp_gauges(registry, "v6", net_tags_)},
+      load_avg_1_{registry->GetGauge("sys.load.1")},
+      load_avg_5_{registry->GetGauge("sys.load.5")},
+      load_avg_15_{registry->GetGauge("sys.load.15")},
+      uptime_{registry->GetGauge("sys.uptime")},
+      procs_count_{registry->GetMonotonicCounter("vmstat.procs.count")},
+      procs_running_{registry->GetGauge("vmstat.procs", {{"id", "running"}})},
+      procs_blocked_{registry->GetGauge("vmstat.procs", {{"id", "blocked"}})},
+      page_in_{registry->GetMonotonicCounter("vmstat.paging", {{"id", "in"}})},
+      page_out_{registry->GetMonotonicCounter("vmstat.paging", {{"id", "out"}})},
+      swap_in_{registry->GetMonotonicCounter("vmstat.swapping", {{"id", "in"}})},
+      swap_out_{registry->GetMonotonicCounter("vmstat.swapping", {{"id", "out"}})},
+      fh_alloc_{registry->GetGauge("vmstat.fh.allocated")},
+      fh_max_{registry->GetGauge("vmstat.fh.max")},
+      avail_real_{registry->GetGauge("mem.availReal")},
+      free_real_{registry->GetGauge("mem.freeReal")},
+      total_real_{registry->GetGauge("mem.totalReal")},
+      avail_swap_{registry->GetGauge("mem.availSwap")},
+      total_swap_{registry->GetGauge("mem.totalSwap")},
+      buffer_{registry->GetGauge("mem.buffer")},
+      cached_{registry->GetGauge("mem.cached")},
+      shared_{registry->GetGauge("mem.shared")},
+      total_free_{registry->GetGauge("mem.totalFree")},
+      cur_pids_{registry->GetGauge("sys.currentProcesses")},
+      cur_threads_{registry->GetGauge("sys.currentThreads")},
+      tcp_memory_{registry->GetGauge("net.tcp.memory")},
+      arp_cache_size_{registry->GetGauge("net.arpCacheSize", net_tags_)} {
+  snmp_counters_ = make_counters(registry, kSnmpMetrics, net_tags_);
+  netstat_counters_ = make_counters(registry, kNetstatMetrics, net_tags_);
+  snmp6_counters_.reserve(std::size(kSnmp6Metrics));
+  for (const auto& metric : kSnmp6Metrics) {
+    Tags tags{net_tags_};
+    if (metric.id != nullptr) {
+      tags.add("id", metric.id);
+    }
+    tags.add("proto", "v6");
+    snmp6_counters_.emplace_back(registry->GetMonotonicCounter(metric.name, tags));
+  }
+  for (size_t i = 0; i < kSoftnetFields; ++i) {
+    softnet_totals_[i] = registry->GetMonotonicCounter(kSoftnetMetrics[i].name);
+    // how much of it landed on the busiest cpu, to find imbalances hidden by the total
+    softnet_per_cpu_max_[i] =
+        registry->GetMaxGauge("net.softnet.perCpuMax", {{"id", kSoftnetMetrics[i].id}});
   }
 }
 
 template <typename Reg>
-void Proc<Reg>::parse_udpv6_stats(
-    const std::unordered_map<std::string, int64_t>& snmp_stats) noexcept {
-  static auto udpInDatagramsCtr = registry_->GetMonotonicCounter(
-      create_id("net.udp.datagrams", {{"id", "in"}, {"proto", "v6"}}, net_tags_));
-  static auto udpOutDatagramsCtr = registry_->GetMonotonicCounter(
-      create_id("net.udp.datagrams", {{"id", "out"}, {"proto", "v6"}}, net_tags_));
-  static auto udpInErrorsCtr = registry_->GetMonotonicCounter(
-      create_id("net.udp.errors", {{"id", "inErrors"}, {"proto", "v6"}}, net_tags_));
-
-  auto in_datagrams = snmp_stats.find("Udp6InDatagrams");
-  auto in_errors = snmp_stats.find("Udp6InErrors");
-  auto out_datagrams = snmp_stats.find("Udp6OutDatagrams");
-
-  if (in_datagrams != snmp_stats.end()) {
-    udpInDatagramsCtr->Set(in_datagrams->second);
-  }
-  if (in_errors != snmp_stats.end()) {
-    udpInErrorsCtr->Set(in_errors->second);
+void Proc<Reg>::softnet_stats() noexcept {
+  if (!softnet_.refresh()) {
+    return;
   }
-  if (out_datagrams != snmp_stats.end()) {
-    udpOutDatagramsCtr->Set(out_datagrams->second);
+
+  for (size_t i = 0; i < kSoftnetFields; ++i) {
+    auto field = static_cast<SoftnetField>(i);
+    softnet_totals_[i]->Set(softnet_.total(field));
+    auto max_delta = softnet_.max_delta(field);
+    if (max_delta >= 0) {
+      softnet_per_cpu_max_[i]->Set(max_delta);
+    }
   }
 }
 
-template <typename Reg>
-void Proc<Reg>::parse_ip_stats(const char* buf) noexcept {
-  static auto ipInReceivesCtr = registry_->GetMonotonicCounter(
-      create_id("net.ip.datagrams", {{"id", "in"}, {"proto", "v4"}}, net_tags_));
-  static auto ipInDicardsCtr = registry_->GetMonotonicCounter(
-      create_id("net.ip.discards", {{"id", "in"}, {"proto", "v4"}}, net_tags_));
-  static auto ipOutRequestsCtr = registry_->GetMonotonicCounter(
-      create_id("net.ip.datagrams", {{"id", "out"}, {"proto", "v4"}}, net_tags_));
-  static auto ipOutDiscardsCtr = registry_->GetMonotonicCounter(
-      create_id("net.ip.discards", {{"id", "out"}, {"proto", "v4"}}, net_tags_));
-  static auto ipReasmReqdsCtr =
-      registry_->GetMonotonicCounter(create_id("net.ip.reasmReqds", {{"proto", "v4"}}, net_tags_));
-  u_long ipForwarding, ipDefaultTTL, ipInReceives, ipInHdrErrors, ipInAddrErrors, ipForwDatagrams,
-      ipInUnknownProtos, ipInDiscards, ipInDelivers, ipOutRequests, ipOutDiscards, ipOutNoRoutes,
-      ipReasmTimeout, ipReasmReqds, ipReasmOKs, ipReasmFails, ipFragOKs, ipFragFails, ipFragCreates;
-
-  if (buf == nullptr) {
+static constexpr const char* LOADAVG_LINE = "%lf %lf %lf";
+
+void sum_tcp_states(FILE* fp, std::array<int, kConnStates>* connections) noexcept {
+  char line[2048];
+  // discard header
+  if (fgets(line, sizeof line, fp) == nullptr) {
     return;
   }
-
-  sscanf(buf, IP_STATS_LINE, &ipForwarding, &ipDefaultTTL, &ipInReceives, &ipInHdrErrors,
-         &ipInAddrErrors, &ipForwDatagrams, &ipInUnknownProtos, &ipInDiscards, &ipInDelivers,
-         &ipOutRequests, &ipOutDiscards, &ipOutNoRoutes, &ipReasmTimeout, &ipReasmReqds,
-         &ipReasmOKs, &ipReasmFails, &ipFragOKs, &ipFragFails, &ipFragCreates);
-
-  ipInReceivesCtr->Set(ipInReceives);
-  ipInDicardsCtr->Set(ipInDiscards);
-  ipOutRequestsCtr->Set(ipOutRequests);
-  ipOutDiscardsCtr->Set(ipOutDiscards);
-  ipReasmReqdsCtr->Set(ipReasmReqds);
+  while (fgets(line, sizeof line, fp) != nullptr) {
+    std::vector<std::string> fields =
+        absl::StrSplit(line, absl::ByAnyChar("\n\t "), absl::SkipEmpty());
+    // all lines have at least 12 fields. Just being extra paranoid here:
+    if (fields.size() < 4) {
+      continue;
+    }
+    const char* st = fields[3].c_str();
+    auto state = static_cast<int>(strtol(st, nullptr, 16));
+    if (state < kConnStates) {
+      ++(*connections)[state];
+    } else {
+      Logger()->info("Ignoring connection state {} for line: {}", state, line);
+    }
+  }
 }
 
 template <typename Reg>
-void Proc<Reg>::parse_tcp_stats(const char* buf) noexcept {
-  static auto tcpInSegsCtr =
-      registry_->GetMonotonicCounter(create_id("net.tcp.segments", {{"id", "in"}}, net_tags_));
-  static auto tcpOutSegsCtr =
-      registry_->GetMonotonicCounter(create_id("net.tcp.segments", {{"id", "out"}}, net_tags_));
-  static auto tcpRetransSegsCtr = registry_->GetMonotonicCounter(
-      create_id("net.tcp.errors", {{"id", "retransSegs"}}, net_tags_));
-  static auto tcpInErrsCtr =
-      registry_->GetMonotonicCounter(create_id("net.tcp.errors", {{"id", "inErrs"}}, net_tags_));
-  static auto tcpOutRstsCtr =
-      registry_->GetMonotonicCounter(create_id("net.tcp.errors", {{"id", "outRsts"}}, net_tags_));
-  static auto tcpAttemptFailsCtr = registry_->GetMonotonicCounter(
-      create_id("net.tcp.errors", {{"id", "attemptFails"}}, net_tags_));
-  static auto tcpEstabResetsCtr = registry_->GetMonotonicCounter(
-      create_id("net.tcp.errors", {{"id", "estabResets"}}, net_tags_));
-  static auto tcpActiveOpensCtr =
-      registry_->GetMonotonicCounter(create_id("net.tcp.opens", {{"id", "active"}}, net_tags_));
-  static auto tcpPassiveOpensCtr =
-      registry_->GetMonotonicCounter(create_id("net.tcp.opens", {{"id", "passive"}}, net_tags_));
-  static auto tcpCurrEstabGauge = registry_->GetGauge("net.tcp.currEstab", net_tags_);
-
-  if (buf == nullptr) {
-    return;
+inline void update_tcpstates_for_proto(
+    const std::array<typename Reg::gauge_ptr, kConnStates>& gauges, FILE* fp) {
+  std::array<int, kConnStates> connections{};
+  if (fp != nullptr) {
+    sum_tcp_states(fp, &connections);
+    for (auto i = 1; i < kConnStates; ++i) {
+      gauges[i]->Set(connections[i]);
+    }
   }
+}
 
-  u_long tcpRtoAlgorithm, tcpRtoMin, tcpRtoMax, tcpMaxConn, tcpActiveOpens, tcpPassiveOpens,
-      tcpAttemptFails, tcpEstabResets, tcpCurrEstab, tcpInSegs, tcpOutSegs, tcpRetransSegs,
-      tcpInErrs, tcpOutRsts;
-  auto ret =
-      sscanf(buf, TCP_STATS_LINE, &tcpRtoAlgorithm, &tcpRtoMin, &tcpRtoMax, &tcpMaxConn,
-             &tcpActiveOpens, &tcpPassiveOpens, &tcpAttemptFails, &tcpEstabResets, &tcpCurrEstab,
-             &tcpInSegs, &tcpOutSegs, &tcpRetransSegs, &tcpInErrs, &tcpOutRsts);
-  tcpInSegsCtr->Set(tcpInSegs);
-  tcpOutSegsCtr->Set(tcpOutSegs);
-  tcpRetransSegsCtr->Set(tcpRetransSegs);
-  tcpActiveOpensCtr->Set(tcpActiveOpens);
-  tcpPassiveOpensCtr->Set(tcpPassiveOpens);
-  tcpAttemptFailsCtr->Set(tcpAttemptFails);
-  tcpEstabResetsCtr->Set(tcpEstabResets);
-  tcpCurrEstabGauge->Set(tcpCurrEstab);
-
-  if (ret > 12) {
-    tcpInErrsCtr->Set(tcpInErrs);
-  }
-  if (ret > 13) {
-    tcpOutRstsCtr->Set(tcpOutRsts);
-  }
+template <typename Reg>
+void Proc<Reg>::parse_tcp_connections() noexcept {
+  update_tcpstates_for_proto<Reg>(tcp_states_v4_, open_file(path_prefix_, "net/tcp"));
+  update_tcpstates_for_proto<Reg>(tcp_states_v6_, open_file(path_prefix_, "net/tcp6"));
 }
 
+// replicate what snmpd is doing
 template <typename Reg>
-void Proc<Reg>::parse_udp_stats(const char* buf) noexcept {
-  static auto udpInDatagramsCtr = registry_->GetMonotonicCounter(
-      create_id("net.udp.datagrams", {{"id", "in"}, {"proto", "v4"}}, net_tags_));
-  static auto udpOutDatagramsCtr = registry_->GetMonotonicCounter(
-      create_id("net.udp.datagrams", {{"id", "out"}, {"proto", "v4"}}, net_tags_));
-  static auto udpInErrorsCtr = registry_->GetMonotonicCounter(
-      create_id("net.udp.errors", {{"id", "inErrors"}, {"proto", "v4"}}, net_tags_));
-
-  if (buf == nullptr) {
+void Proc<Reg>::snmp_stats() noexcept {
+  if (!snmp_table_.refresh(snmp_path_)) {
     return;
   }
+  for (size_t i = 0; i < snmp_counters_.size(); ++i) {
+    if (snmp_counters_[i]) {
+      set_if_present(snmp_table_, i, snmp_counters_[i].get());
+    }
+  }
+  set_if_present(snmp_table_, kTcpCurrEstab, tcp_curr_estab_.get());
 
-  u_long udpInDatagrams, udpNoPorts, udpInErrors, udpOutDatagrams;
-  sscanf(buf, UDP_STATS_LINE, &udpInDatagrams, &udpNoPorts, &udpInErrors, &udpOutDatagrams);
+  parse_tcp_connections();
 
-  udpInDatagramsCtr->Set(udpInDatagrams);
-  udpInErrorsCtr->Set(udpInErrors);
-  udpOutDatagramsCtr->Set(udpOutDatagrams);
+  std::unordered_map<std::string, int64_t> stats;
+  parse_kv_from_file(path_prefix_, "net/snmp6", &stats);
+  for (size_t i = 0; i < snmp6_counters_.size(); ++i) {
+    set_if_present(stats, kSnmp6Metrics[i].key, snmp6_counters_[i].get());
+  }
+  int64_t ect_capable = 0;
+  for (const auto* key : {"Ip6InECT0Pkts", "Ip6InECT1Pkts"}) {
+    auto it = stats.find(key);
+    if (it != stats.end()) {
+      ect_capable += it->second;
+    }
+  }
+  ip6_ect_->Set(ect_capable);
 }
 
 template <typename Reg>
 void Proc<Reg>::parse_load_avg(const char* buf) noexcept {
-  static auto loadAvg1Gauge = registry_->GetGauge("sys.load.1");
-  static auto loadAvg5Gauge = registry_->GetGauge("sys.load.5");
-  static auto loadAvg15Gauge = registry_->GetGauge("sys.load.15");
-
   double loadAvg1, loadAvg5, loadAvg15;
   sscanf(buf, LOADAVG_LINE, &loadAvg1, &loadAvg5, &loadAvg15);
 
-  loadAvg1Gauge->Set(loadAvg1);
-  loadAvg5Gauge->Set(loadAvg5);
-  loadAvg15Gauge->Set(loadAvg15);
+  load_avg_1_->Set(loadAvg1);
+  load_avg_5_->Set(loadAvg5);
+  load_avg_15_->Set(loadAvg15);
 }
 
 template <typename Reg>
@@ -440,274 +498,246 @@ bool Proc<Reg>::is_container() const noexcept {
 template <typename Reg>
 void Proc<Reg>::set_prefix(const std::string& new_prefix) noexcept {
   path_prefix_ = new_prefix;
+  snmp_path_ = fmt::format("{}/net/snmp", path_prefix_);
+  netstat_path_ = fmt::format("{}/net/netstat", path_prefix_);
+  interrupts_path_ = fmt::format("{}/interrupts", path_prefix_);
+  softirqs_path_ = fmt::format("{}/softirqs", path_prefix_);
+  own_stat_.set_prefix(new_prefix);
+  softnet_.set_prefix(new_prefix);
 }
 
-namespace detail {
-struct cpu_gauge_vals {
-  double user;
-  double system;
-  double stolen;
-  double nice;
-  double wait;
-  double interrupt;
-};
-
-template <typename Reg, typename G>
-struct cpu_gauges {
-  using gauge_ptr = std::shared_ptr<G>;
-  using gauge_maker_t = std::function<gauge_ptr(Reg* registry, const char* name, const char* id)>;
-  cpu_gauges(Reg* registry, const char* name, const gauge_maker_t& gauge_maker)
-      : user_gauge(gauge_maker(registry, name, "user")),
-        system_gauge(gauge_maker(registry, name, "system")),
-        stolen_gauge(gauge_maker(registry, name, "stolen")),
-        nice_gauge(gauge_maker(registry, name, "nice")),
-        wait_gauge(gauge_maker(registry, name, "wait")),
-        interrupt_gauge(gauge_maker(registry, name, "interrupt")) {}
-
-  gauge_ptr user_gauge;
-  gauge_ptr system_gauge;
-  gauge_ptr stolen_gauge;
-  gauge_ptr nice_gauge;
-  gauge_ptr wait_gauge;
-  gauge_ptr interrupt_gauge;
-
-  void update(const cpu_gauge_vals& vals) {
-    user_gauge->Set(vals.user);
-    system_gauge->Set(vals.system);
-    stolen_gauge->Set(vals.stolen);
-    nice_gauge->Set(vals.nice);
-    wait_gauge->Set(vals.wait);
-    interrupt_gauge->Set(vals.interrupt);
-  }
-};
-
 template <typename Reg>
-struct cores_dist_summary {
-  cores_dist_summary(Reg* registry, const char* name)
-      : usage_ds(registry->GetDistributionSummary(name)) {}
-
-  typename Reg::dist_summary_ptr usage_ds;
-
-  void update(const cpu_gauge_vals& vals) {
-    auto usage = vals.user + vals.system + vals.stolen + vals.nice + vals.wait + vals.interrupt;
-    usage_ds->Record(usage);
+const ProcStat& Proc<Reg>::current_stat() noexcept {
+  if (stat_ != nullptr) {
+    return *stat_;
   }
-};
-
-struct stat_vals {
-  static constexpr const char* CPU_STATS_LINE = " %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu";
-  u_long user{0}, nice{0}, system{0}, idle{0}, iowait{0}, irq{0}, softirq{0}, steal{0}, guest{0},
-      guest_nice{0};
-  double total{NAN};
-
-  static stat_vals parse(const char* line) {
-    stat_vals result;
-    auto ret = sscanf(line, CPU_STATS_LINE, &result.user, &result.nice, &result.system,
-                      &result.idle, &result.iowait, &result.irq, &result.softirq, &result.steal,
-                      &result.guest, &result.guest_nice);
-    if (ret < 7) {
-      Logger()->info("Unable to parse cpu stats from '{}' - only {} fields were read", line, ret);
-      return result;
-    }
-    result.total = static_cast<double>(result.user) + result.nice + result.system + result.idle +
-                   result.iowait + result.irq + result.softirq;
-    if (ret > 7) {
-      result.total += result.steal + result.guest + result.guest_nice;
-    } else {
-      result.steal = result.guest = result.guest_nice = 0;
-    }
-    return result;
-  }
-
-  bool has_been_updated() const noexcept { return !std::isnan(total); }
-
-  stat_vals() = default;
+  own_stat_.refresh();
+  return own_stat_;
+}
 
-  cpu_gauge_vals compute_vals(const stat_vals& prev) const noexcept {
-    cpu_gauge_vals vals{};
-    auto delta_total = total - prev.total;
-    auto delta_user = user - prev.user;
-    auto delta_system = system - prev.system;
-    auto delta_stolen = steal - prev.steal;
-    auto delta_nice = nice - prev.nice;
-    auto delta_interrupt = (irq + softirq) - (prev.irq + prev.softirq);
-    auto delta_wait = iowait > prev.iowait ? iowait - prev.iowait : 0;
+namespace detail {
 
-    if (delta_total > 0) {
-      vals.user = 100.0 * delta_user / delta_total;
-      vals.system = 100.0 * delta_system / delta_total;
-      vals.stolen = 100.0 * delta_stolen / delta_total;
-      vals.nice = 100.0 * delta_nice / delta_total;
-      vals.wait = 100.0 * delta_wait / delta_total;
-      vals.interrupt = 100.0 * delta_interrupt / delta_total;
-    } else {
-      vals.user = vals.system = vals.stolen = vals.nice = vals.wait = vals.interrupt = 0.0;
-    }
-    return vals;
+stat_vals stat_vals::from_fields(const cpu_fields_t& fields, size_t num_fields) noexcept {
+  stat_vals result;
+  if (num_fields < 7) {
+    Logger()->info("Unable to parse cpu stats - only {} fields were read", num_fields);
+    return result;
   }
-};
+  result.user = fields[static_cast<size_t>(CpuField::user)];
+  result.nice = fields[static_cast<size_t>(CpuField::nice)];
+  result.system = fields[static_cast<size_t>(CpuField::system)];
+  result.idle = fields[static_cast<size_t>(CpuField::idle)];
+  result.iowait = fields[static_cast<size_t>(CpuField::iowait)];
+  result.irq = fields[static_cast<size_t>(CpuField::irq)];
+  result.softirq = fields[static_cast<size_t>(CpuField::softirq)];
+  result.total = static_cast<double>(result.user) + result.nice + result.system + result.idle +
+                 result.iowait + result.irq + result.softirq;
+  if (num_fields > 7) {
+    result.steal = fields[static_cast<size_t>(CpuField::steal)];
+    result.guest = fields[static_cast<size_t>(CpuField::guest)];
+    result.guest_nice = fields[static_cast<size_t>(CpuField::guest_nice)];
+    result.total += result.steal + result.guest + result.guest_nice;
+  }
+  return result;
+}
+
+stat_vals stat_vals::for_cpu(const ProcStat& proc_stat, size_t idx) noexcept {
+  cpu_fields_t fields;
+  for (auto i = 0u; i < kCpuFields; ++i) {
+    fields[i] = proc_stat.per_cpu(static_cast<CpuField>(i))[idx];
+  }
+  return from_fields(fields, proc_stat.per_cpu_num_fields());
+}
+
+cpu_gauge_vals stat_vals::compute_vals(const stat_vals& prev) const noexcept {
+  cpu_gauge_vals vals{};
+  auto delta_total = total - prev.total;
+  auto delta_user = user - prev.user;
+  auto delta_system = system - prev.system;
+  auto delta_stolen = steal - prev.steal;
+  auto delta_nice = nice - prev.nice;
+  auto delta_interrupt = (irq + softirq) - (prev.irq + prev.softirq);
+  auto delta_wait = iowait > prev.iowait ? iowait - prev.iowait : 0;
+
+  if (delta_total > 0) {
+    vals.user = 100.0 * delta_user / delta_total;
+    vals.system = 100.0 * delta_system / delta_total;
+    vals.stolen = 100.0 * delta_stolen / delta_total;
+    vals.nice = 100.0 * delta_nice / delta_total;
+    vals.wait = 100.0 * delta_wait / delta_total;
+    vals.interrupt = 100.0 * delta_interrupt / delta_total;
+  } else {
+    vals.user = vals.system = vals.stolen = vals.nice = vals.wait = vals.interrupt = 0.0;
+  }
+  return vals;
+}
 
 }  // namespace detail
 
-template <typename MonoCounter>
-inline void set_if_present(const std::unordered_map<std::string, int64_t>& stats, const char* key,
-                           MonoCounter* ctr) {
-  auto it = stats.find(key);
-  if (it != stats.end()) {
-    ctr->Set(it->second);
-  }
-}
-
 template <typename Reg>
 void Proc<Reg>::uptime_stats() noexcept {
-  static auto sys_uptime = registry_->GetGauge("sys.uptime");
   // uptime values are in seconds, reported as doubles, but given how large they will be over
   // time, the 10ths of a second will not matter for the purpose of producing this metric
   auto uptime_seconds = read_num_vector_from_file(path_prefix_, "uptime");
-  sys_uptime->Set(uptime_seconds[0]);
+  uptime_->Set(uptime_seconds[0]);
 }
 
 template <typename Reg>
 void Proc<Reg>::vmstats() noexcept {
-  static auto processes = registry_->GetMonotonicCounter("vmstat.procs.count");
-  static auto procs_running = registry_->GetGauge("vmstat.procs", {{"id", "running"}});
-  static auto procs_blocked = registry_->GetGauge("vmstat.procs", {{"id", "blocked"}});
-
-  static auto page_in = registry_->GetMonotonicCounter("vmstat.paging", {{"id", "in"}});
-  static auto page_out = registry_->GetMonotonicCounter("vmstat.paging", {{"id", "out"}});
-  static auto swap_in = registry_->GetMonotonicCounter("vmstat.swapping", {{"id", "in"}});
-  static auto swap_out = registry_->GetMonotonicCounter("vmstat.swapping", {{"id", "out"}});
-  static auto fh_alloc = registry_->GetGauge("vmstat.fh.allocated");
-  static auto fh_max = registry_->GetGauge("vmstat.fh.max");
-
-  auto fp = open_file(path_prefix_, "stat");
-  if (fp == nullptr) {
+  const auto& proc_stat = current_stat();
+  if (!proc_stat.valid()) {
     return;
   }
-
-  char line[2048];
-  while (fgets(line, sizeof line, fp) != nullptr) {
-    if (starts_with(line, "processes")) {
-      u_long n;
-      sscanf(line, "processes %lu", &n);
-      processes->Set(n);
-    } else if (starts_with(line, "procs_running")) {
-      u_long n;
-      sscanf(line, "procs_running %lu", &n);
-      procs_running->Set(n);
-    } else if (starts_with(line, "procs_blocked")) {
-      u_long n;
-      sscanf(line, "procs_blocked %lu", &n);
-      procs_blocked->Set(n);
-    }
+  if (proc_stat.processes() >= 0) {
+    procs_count_->Set(proc_stat.processes());
+  }
+  if (proc_stat.procs_running() >= 0) {
+    procs_running_->Set(proc_stat.procs_running());
+  }
+  if (proc_stat.procs_blocked() >= 0) {
+    procs_blocked_->Set(proc_stat.procs_blocked());
   }
 
   std::unordered_map<std::string, int64_t> vmstats;
   parse_kv_from_file(path_prefix_, "vmstat", &vmstats);
-  set_if_present(vmstats, "pgpgin", page_in.get());
-  set_if_present(vmstats, "pgpgout", page_out.get());
-  set_if_present(vmstats, "pswpin", swap_in.get());
-  set_if_present(vmstats, "pswpout", swap_out.get());
+  set_if_present(vmstats, "pgpgin", page_in_.get());
+  set_if_present(vmstats, "pgpgout", page_out_.get());
+  set_if_present(vmstats, "pswpin", swap_in_.get());
+  set_if_present(vmstats, "pswpout", swap_out_.get());
 
   auto fh = open_file(path_prefix_, "sys/fs/file-nr");
+  char line[1024];
   if (fgets(line, sizeof line, fh) != nullptr) {
     u_long alloc, used, max;
     if (sscanf(line, "%lu %lu %lu", &alloc, &used, &max) == 3) {
-      fh_alloc->Set(alloc);
-      fh_max->Set(max);
+      fh_alloc_->Set(alloc);
+      fh_max_->Set(max);
     }
   }
 }
 
 template <typename Reg>
 void Proc<Reg>::peak_cpu_stats() noexcept {
-  static detail::cpu_gauges<Reg, typename Reg::max_gauge_t> peakUtilizationGauges{
-      registry_, "sys.cpu.peakUtilization", [](Reg* r, const char* name, const char* id) {
-        return r->GetMaxGauge(name, {{"id", id}});
-      }};
-  static detail::stat_vals prev;
+  const auto& proc_stat = current_stat();
+  if (!proc_stat.valid()) {
+    return;
+  }
+  auto vals =
+      detail::stat_vals::from_fields(proc_stat.aggregate(), proc_stat.aggregate_num_fields());
+  if (prev_peak_vals_.has_been_updated()) {
+    auto gauge_vals = vals.compute_vals(prev_peak_vals_);
+    peak_utilization_gauges_.update(gauge_vals);
+  }
+  prev_peak_vals_ = vals;
+}
 
-  auto fp = open_file(path_prefix_, "stat");
-  if (fp == nullptr) {
+template <typename Reg>
+void Proc<Reg>::peak_core_stats() noexcept {
+  static constexpr double kSaturatedCorePct = 90.0;
+  if (core_utilization_.update(current_stat())) {
+    peak_core_->Set(core_utilization_.max_utilization());
+    saturated_cores_->Set(core_utilization_.cores_above(kSaturatedCorePct));
+  }
+}
+
+template <typename Reg>
+void Proc<Reg>::update_irq_meters(const IrqStat& stat, const char* name,
+                                  std::vector<IrqMeters>* meters) noexcept {
+  const auto& types = stat.types();
+  if (meters->size() == types.size()) {
     return;
   }
-  char line[1024];
-  auto ret = fgets(line, sizeof line, fp);
-  if (ret == nullptr) {
+  auto per_cpu_max = fmt::format("{}.perCpuMax", name);
+  auto imbalance = fmt::format("{}.imbalance", name);
+  for (auto i = meters->size(); i < types.size(); ++i) {
+    const auto& id = types[i].name;
+    meters->push_back({registry_->GetMonotonicCounter(name, {{"id", id}}),
+                       registry_->GetGauge(per_cpu_max, {{"id", id}}),
+                       registry_->GetGauge(imbalance, {{"id", id}})});
+  }
+}
+
+template <typename Reg>
+void Proc<Reg>::interrupt_stats() noexcept {
+  if (!interrupts_.refresh(interrupts_path_)) {
     return;
   }
-  detail::stat_vals vals = detail::stat_vals::parse(line + 3);  // 'cpu'
-  if (prev.has_been_updated()) {
-    auto gauge_vals = vals.compute_vals(prev);
-    peakUtilizationGauges.update(gauge_vals);
+  update_irq_meters(interrupts_, "sys.interrupts", &interrupt_meters_);
+  const auto& types = interrupts_.types();
+  for (size_t i = 0; i < types.size(); ++i) {
+    const auto& type = types[i];
+    if (!type.present) {
+      continue;
+    }
+    const auto& meters = interrupt_meters_[i];
+    meters.total->Set(IrqStat::total(type));
+
+    // device interrupts are the ones affected by irq affinity
+    uint64_t max_delta;
+    double ratio;
+    if (type.name == "device" && IrqStat::imbalance(type, &max_delta, &ratio)) {
+      meters.per_cpu_max->Set(max_delta);
+      meters.imbalance->Set(ratio);
+    }
   }
-  prev = vals;
 }
 
 template <typename Reg>
-void Proc<Reg>::cpu_stats() noexcept {
-  static auto num_procs = registry_->GetGauge("sys.cpu.numProcessors");
-  static detail::cpu_gauges<Reg, typename Reg::gauge_t> utilizationGauges{
-      registry_, "sys.cpu.utilization", [](Reg* r, const char* name, const char* id) {
-        return r->GetGauge(name, {{"id", id}});
-      }};
-  static detail::cores_dist_summary coresDistSummary{registry_, "sys.cpu.coreUtilization"};
-  static detail::stat_vals prev_vals;
-  static std::unordered_map<int, detail::stat_vals> prev_cpu_vals;
-
-  auto fp = open_file(path_prefix_, "stat");
-  if (fp == nullptr) {
+void Proc<Reg>::softirq_stats() noexcept {
+  if (!softirqs_.refresh(softirqs_path_)) {
     return;
   }
-  char line[1024];
-  auto ret = fgets(line, sizeof line, fp);
-  if (ret == nullptr) {
+  update_irq_meters(softirqs_, "sys.softirqs", &softirq_meters_);
+  const auto& types = softirqs_.types();
+  for (size_t i = 0; i < types.size(); ++i) {
+    const auto& type = types[i];
+    if (!type.present) {
+      continue;
+    }
+    const auto& meters = softirq_meters_[i];
+    meters.total->Set(IrqStat::total(type));
+    uint64_t max_delta;
+    double ratio;
+    if (IrqStat::imbalance(type, &max_delta, &ratio)) {
+      meters.per_cpu_max->Set(max_delta);
+      meters.imbalance->Set(ratio);
+    }
+  }
+}
+
+template <typename Reg>
+void Proc<Reg>::cpu_stats() noexcept {
+  const auto& proc_stat = current_stat();
+  if (!proc_stat.valid()) {
     return;
   }
-  detail::stat_vals vals = detail::stat_vals::parse(line + 3);  // 'cpu'
-  if (prev_vals.has_been_updated()) {
-    auto gauge_vals = vals.compute_vals(prev_vals);
-    utilizationGauges.update(gauge_vals);
+  auto vals =
+      detail::stat_vals::from_fields(proc_stat.aggregate(), proc_stat.aggregate_num_fields());
+  if (prev_vals_.has_been_updated()) {
+    auto gauge_vals = vals.compute_vals(prev_vals_);
+    utilization_gauges_.update(gauge_vals);
   }
-  prev_vals = vals;
+  prev_vals_ = vals;
 
   // get the per-cpu metrics
-  auto cpu_count = 0;
-  while (fgets(line, sizeof line, fp) != nullptr) {
-    if (strncmp(line, "cpu", 3) != 0) {
-      break;
-    }
-    cpu_count += 1;
-    int cpu_num;
-    sscanf(line, "cpu%d ", &cpu_num);
-    char* p = line + 4;
-    while (*p != ' ') {
-      ++p;
-    }
-    detail::stat_vals per_cpu_vals = detail::stat_vals::parse(p);
-    auto it = prev_cpu_vals.find(cpu_num);
-    if (it != prev_cpu_vals.end()) {
+  auto cpu_count = proc_stat.num_cpus();
+  const auto& cpu_ids = proc_stat.cpu_ids();
+  for (auto i = 0u; i < cpu_count; ++i) {
+    auto cpu_num = cpu_ids[i];
+    auto per_cpu_vals = detail::stat_vals::for_cpu(proc_stat, i);
+    auto it = prev_cpu_vals_.find(cpu_num);
+    if (it != prev_cpu_vals_.end()) {
       auto& prev = it->second;
       auto computed_vals = per_cpu_vals.compute_vals(prev);
-      coresDistSummary.update(computed_vals);
+      cores_dist_summary_.update(computed_vals);
     }
-    prev_cpu_vals[cpu_num] = per_cpu_vals;
+    prev_cpu_vals_[cpu_num] = per_cpu_vals;
   }
-  num_procs->Set(cpu_count);
+  num_procs_->Set(cpu_count);
 }
 
 template <typename Reg>
 void Proc<Reg>::memory_stats() noexcept {
-  static auto avail_real = registry_->GetGauge("mem.availReal");
-  static auto free_real = registry_->GetGauge("mem.freeReal");
-  static auto total_real = registry_->GetGauge("mem.totalReal");
-  static auto avail_swap = registry_->GetGauge("mem.availSwap");
-  static auto total_swap = registry_->GetGauge("mem.totalSwap");
-  static auto buffer = registry_->GetGauge("mem.buffer");
-  static auto cached = registry_->GetGauge("mem.cached");
-  static auto shared = registry_->GetGauge("mem.shared");
-  static auto total_free = registry_->GetGauge("mem.totalFree");
-
   auto fp = open_file(path_prefix_, "meminfo");
   if (fp == nullptr) {
     return;
@@ -719,40 +749,40 @@ void Proc<Reg>::memory_stats() noexcept {
     if (starts_with(line, "MemTotal:")) {
       u_long n;
       sscanf(line, "MemTotal: %lu", &n);
-      total_real->Set(n * 1024.0);
+      total_real_->Set(n * 1024.0);
     } else if (starts_with(line, "MemFree:")) {
       u_long n;
       sscanf(line, "MemFree: %lu", &n);
-      free_real->Set(n * 1024.0);
+      free_real_->Set(n * 1024.0);
       total_free_bytes += n;
     } else if (starts_with(line, "MemAvailable:")) {
       u_long n;
       sscanf(line, "MemAvailable: %lu", &n);
-      avail_real->Set(n * 1024.0);
+      avail_real_->Set(n * 1024.0);
     } else if (starts_with(line, "SwapFree:")) {
       u_long n;
       sscanf(line, "SwapFree: %lu", &n);
-      avail_swap->Set(n * 1024.0);
+      avail_swap_->Set(n * 1024.0);
       total_free_bytes += n;
     } else if (starts_with(line, "SwapTotal:")) {
       u_long n;
       sscanf(line, "SwapTotal: %lu", &n);
-      total_swap->Set(n * 1024.0);
+      total_swap_->Set(n * 1024.0);
     } else if (starts_with(line, "Buffers:")) {
       u_long n;
       sscanf(line, "Buffers: %lu", &n);
-      buffer->Set(n * 1024.0);
+      buffer_->Set(n * 1024.0);
     } else if (starts_with(line, "Cached:")) {
       u_long n;
       sscanf(line, "Cached: %lu", &n);
-      cached->Set(n * 1024.0);
+      cached_->Set(n * 1024.0);
     } else if (starts_with(line, "Shmem:")) {
       u_long n;
       sscanf(line, "Shmem: %lu", &n);
-      shared->Set(n * 1024.0);
+      shared_->Set(n * 1024.0);
     }
   }
-  total_free->Set(total_free_bytes * 1024.0);
+  total_free_->Set(total_free_bytes * 1024.0);
 }
 
 inline int64_t to_int64(const std::string& s) {
@@ -764,7 +794,6 @@ inline int64_t to_int64(const std::string& s) {
 template <typename Reg>
 void Proc<Reg>::socket_stats() noexcept {
   auto pagesize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
-  static auto tcp_memory = registry_->GetGauge("net.tcp.memory");
 
   auto fp = open_file(path_prefix_, "net/sockstat");
   if (fp == nullptr) {
@@ -779,7 +808,7 @@ void Proc<Reg>::socket_stats() noexcept {
       auto idx = 0u;
       for (const auto& value : values) {
         if (value == "mem") {
-          tcp_memory->Set(to_int64(values[idx+1]) * pagesize);
+          tcp_memory_->Set(to_int64(values[idx+1]) * pagesize);
         }
         ++idx;
       }
@@ -790,60 +819,35 @@ void Proc<Reg>::socket_stats() noexcept {
 
 template <typename Reg>
 void Proc<Reg>::netstat_stats() noexcept {
-  static auto ect_ctr = registry_->GetMonotonicCounter(
-      create_id("net.ip.ectPackets", {{"id", "capable"}, {"proto", "v4"}}, net_tags_));
-  static auto noEct_ctr = registry_->GetMonotonicCounter(
-      create_id("net.ip.ectPackets", {{"id", "notCapable"}, {"proto", "v4"}}, net_tags_));
-  static auto congested_ctr = registry_->GetMonotonicCounter(
-      create_id("net.ip.congestedPackets", {{"proto", "v4"}}, net_tags_));
-
-  auto fp = open_file(path_prefix_, "net/netstat");
-  if (fp == nullptr) {
+  if (!netstat_table_.refresh(netstat_path_)) {
     return;
   }
 
-  int64_t noEct = 0, ect = 0, congested = 0;
-  char line[1024];
-  while (fgets(line, sizeof line, fp) != nullptr) {
-    if (starts_with(line, "IpExt:")) {
-      // get header indexes
-      std::vector<std::string> headers =
-          absl::StrSplit(line, absl::ByAnyChar(" \t\n"), absl::SkipEmpty());
-      if (fgets(line, sizeof line, fp) == nullptr) {
-        Logger()->warn("Unable to parse {}/net/netstat", path_prefix_);
-        return;
-      }
-      std::vector<std::string> values =
-          absl::StrSplit(line, absl::ByAnyChar(" \t\n"), absl::SkipEmpty());
-      ;
-      assert(values.size() == headers.size());
-      auto idx = 0u;
-      for (const auto& header : headers) {
-        if (header == "InNoECTPkts") {
-          noEct = to_int64(values[idx]);
-        } else if (header == "InECT1Pkts" || header == "InECT0Pkts") {
-          ect += to_int64(values[idx]);
-        } else if (header == "InCEPkts") {
-          congested = to_int64(values[idx]);
-        }
-        ++idx;
-      }
-      break;
-    }
-  }
+  const auto& t = netstat_table_;
+  auto value_or_zero = [&t](size_t column) { return t.has(column) ? t.value(column) : 0; };
+  auto noEct = value_or_zero(kIpExtInNoECTPkts);
+  auto ect = value_or_zero(kIpExtInECT1Pkts) + value_or_zero(kIpExtInECT0Pkts);
+  auto congested = value_or_zero(kIpExtInCEPkts);
 
   // Set all the counters if we have data. We want to explicitly send a 0 value for congested to
   // distinguish known no congestion from no data
   if (ect > 0 || noEct > 0) {
-    congested_ctr->Set(congested);
-    ect_ctr->Set(ect);
-    noEct_ctr->Set(noEct);
+    ip_congested_->Set(congested);
+    ip_ect_->Set(ect);
+    ip_no_ect_->Set(noEct);
+  }
+
+  // tcp counters useful to triage latency issues: accept queue overflows, retransmission
+  // timeouts, and packets dropped because the socket was too slow to read them
+  for (size_t i = 0; i < netstat_counters_.size(); ++i) {
+    if (netstat_counters_[i]) {
+      set_if_present(t, i, netstat_counters_[i].get());
+    }
   }
 }
 
 template <typename Reg>
 void Proc<Reg>::arp_stats() noexcept {
-  static auto arpcache_size = registry_->GetGauge("net.arpCacheSize", net_tags_);
   auto fp = open_file(path_prefix_, "net/arp");
   if (fp == nullptr) {
     return;
@@ -858,7 +862,7 @@ void Proc<Reg>::arp_stats() noexcept {
       num_entries++;
     }
   }
-  arpcache_size->Set(num_entries);
+  arp_cache_size_->Set(num_entries);
 }
 
 static bool all_digits(const char* str) {
@@ -891,9 +895,6 @@ int32_t count_tasks(const std::string& dirname) {
 
 template <typename Reg>
 void Proc<Reg>::process_stats() noexcept {
-  static auto cur_pids = registry_->GetGauge("sys.currentProcesses");
-  static auto cur_threads = registry_->GetGauge("sys.currentThreads");
-
   DirHandle dir_handle{path_prefix_.c_str()};
   if (!dir_handle) {
     return;
@@ -909,8 +910,8 @@ void Proc<Reg>::process_stats() noexcept {
       tasks += count_tasks(task_dir);
     }
   }
-  cur_pids->Set(pids);
-  cur_threads->Set(tasks);
+  cur_pids_->Set(pids);
+  cur_threads_->Set(tasks);
 }
 
 }  // namespace atlasagent
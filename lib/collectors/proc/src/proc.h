@@ -1,20 +1,108 @@
 #pragma once
 
+#include "irq_stat.h"
+#include "proc_net_table.h"
+#include "proc_stat.h"
+#include "softnet_stat.h"
 #include <lib/tagging/src/tagging_registry.h>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <unordered_map>
+#include <vector>
 
 namespace atlasagent {
+
+namespace detail {
+struct cpu_gauge_vals {
+  double user;
+  double system;
+  double stolen;
+  double nice;
+  double wait;
+  double interrupt;
+};
+
+struct stat_vals {
+  u_long user{0}, nice{0}, system{0}, idle{0}, iowait{0}, irq{0}, softirq{0}, steal{0}, guest{0},
+      guest_nice{0};
+  double total{NAN};
+
+  // build the values from the columns of a cpu line. Older kernels only provide the first 7
+  static stat_vals from_fields(const cpu_fields_t& fields, size_t num_fields) noexcept;
+  static stat_vals for_cpu(const ProcStat& proc_stat, size_t idx) noexcept;
+
+  bool has_been_updated() const noexcept { return !std::isnan(total); }
+
+  stat_vals() = default;
+
+  cpu_gauge_vals compute_vals(const stat_vals& prev) const noexcept;
+};
+
+template <typename Reg, typename G>
+struct cpu_gauges {
+  using gauge_ptr = std::shared_ptr<G>;
+  using gauge_maker_t = std::function<gauge_ptr(Reg* registry, const char* name, const char* id)>;
+  cpu_gauges(Reg* registry, const char* name, const gauge_maker_t& gauge_maker)
+      : user_gauge(gauge_maker(registry, name, "user")),
+        system_gauge(gauge_maker(registry, name, "system")),
+        stolen_gauge(gauge_maker(registry, name, "stolen")),
+        nice_gauge(gauge_maker(registry, name, "nice")),
+        wait_gauge(gauge_maker(registry, name, "wait")),
+        interrupt_gauge(gauge_maker(registry, name, "interrupt")) {}
+
+  gauge_ptr user_gauge;
+  gauge_ptr system_gauge;
+  gauge_ptr stolen_gauge;
+  gauge_ptr nice_gauge;
+  gauge_ptr wait_gauge;
+  gauge_ptr interrupt_gauge;
+
+  void update(const cpu_gauge_vals& vals) {
+    user_gauge->Set(vals.user);
+    system_gauge->Set(vals.system);
+    stolen_gauge->Set(vals.stolen);
+    nice_gauge->Set(vals.nice);
+    wait_gauge->Set(vals.wait);
+    interrupt_gauge->Set(vals.interrupt);
+  }
+};
+
+template <typename Reg>
+struct cores_dist_summary {
+  cores_dist_summary(Reg* registry, const char* name)
+      : usage_ds(registry->GetDistributionSummary(name)) {}
+
+  typename Reg::dist_summary_ptr usage_ds;
+
+  void update(const cpu_gauge_vals& vals) {
+    auto usage = vals.user + vals.system + vals.stolen + vals.nice + vals.wait + vals.interrupt;
+    usage_ds->Record(usage);
+  }
+};
+}  // namespace detail
+
+// tcp connection states from net/tcp, indexed by the st column. 0 is not a valid state
+constexpr int kConnStates = 12;
+
 template <typename Reg = TaggingRegistry>
 class Proc {
  public:
-  Proc(Reg* registry, spectator::Tags net_tags, std::string path_prefix = "/proc") noexcept
-      : registry_(registry), net_tags_{std::move(net_tags)}, path_prefix_(std::move(path_prefix)) {}
+  Proc(Reg* registry, spectator::Tags net_tags, std::string path_prefix = "/proc") noexcept;
   void network_stats() noexcept;
+  // packet processing per cpu from net/softnet_stat, cheap enough to be sampled every second
+  void softnet_stats() noexcept;
   void arp_stats() noexcept;
   void snmp_stats() noexcept;
   void netstat_stats() noexcept;
   void loadavg_stats() noexcept;
   void cpu_stats() noexcept;
+  // interrupts and softirqs per type, and how evenly they are spread across cpus
+  void interrupt_stats() noexcept;
+  void softirq_stats() noexcept;
   void peak_cpu_stats() noexcept;
+  // opt-in: utilization of the busiest core and number of saturated cores
+  void peak_core_stats() noexcept;
   void memory_stats() noexcept;
   void process_stats() noexcept;
   void socket_stats() noexcept;
@@ -24,17 +112,101 @@ class Proc {
 
   void set_prefix(const std::string& new_prefix) noexcept;  // for testing
 
+  // use a /proc/stat snapshot that is shared with other collectors. The owner is responsible
+  // for refreshing it once per tick. Without one, each consumer refreshes a private snapshot
+  void use_shared_stat(ProcStat* proc_stat) noexcept { stat_ = proc_stat; }
+
  private:
   Reg* registry_;
   const spectator::Tags net_tags_;
   std::string path_prefix_;
+  ProcStat own_stat_{path_prefix_};
+  ProcStat* stat_{nullptr};
+  CoreUtilization core_utilization_;
+  ProcNetTable snmp_table_;
+  ProcNetTable netstat_table_;
+  // full paths of net/snmp and net/netstat, rebuilt when the prefix changes
+  std::string snmp_path_;
+  std::string netstat_path_;
+  SoftnetStat softnet_{path_prefix_};
+  IrqStat interrupts_{true};
+  IrqStat softirqs_{false};
+  std::string interrupts_path_;
+  std::string softirqs_path_;
+
+  // previous cpu times, used to compute utilization deltas
+  detail::stat_vals prev_peak_vals_;
+  detail::stat_vals prev_vals_;
+  std::unordered_map<int, detail::stat_vals> prev_cpu_vals_;
+
+  // meters are looked up once, the cpu and snmp collectors run every second. snmp_counters_ is
+  // indexed by the /proc/net/snmp column, and tcp_curr_estab_ is the only gauge in that file
+  std::vector<typename Reg::monotonic_counter_ptr> snmp_counters_;
+  typename Reg::gauge_ptr tcp_curr_estab_;
+  // indexed by the /proc/net/netstat column, the ect counters are computed from several columns
+  std::vector<typename Reg::monotonic_counter_ptr> netstat_counters_;
+  typename Reg::monotonic_counter_ptr ip_ect_;
+  typename Reg::monotonic_counter_ptr ip_no_ect_;
+  typename Reg::monotonic_counter_ptr ip_congested_;
+  typename Reg::gauge_ptr num_procs_;
+  detail::cpu_gauges<Reg, typename Reg::gauge_t> utilization_gauges_;
+  detail::cores_dist_summary<Reg> cores_dist_summary_;
+  detail::cpu_gauges<Reg, typename Reg::max_gauge_t> peak_utilization_gauges_;
+  typename Reg::max_gauge_ptr peak_core_;
+  typename Reg::max_gauge_ptr saturated_cores_;
+  // indexed like kSnmp6Metrics. The ipv6 ect counter is the sum of two keys
+  std::vector<typename Reg::monotonic_counter_ptr> snmp6_counters_;
+  typename Reg::monotonic_counter_ptr ip6_ect_;
+  // connections in each state from net/tcp and net/tcp6
+  std::array<typename Reg::gauge_ptr, kConnStates> tcp_states_v4_;
+  std::array<typename Reg::gauge_ptr, kConnStates> tcp_states_v6_;
+  typename Reg::gauge_ptr load_avg_1_;
+  typename Reg::gauge_ptr load_avg_5_;
+  typename Reg::gauge_ptr load_avg_15_;
+  typename Reg::gauge_ptr uptime_;
+  // vmstats
+  typename Reg::monotonic_counter_ptr procs_count_;
+  typename Reg::gauge_ptr procs_running_;
+  typename Reg::gauge_ptr procs_blocked_;
+  typename Reg::monotonic_counter_ptr page_in_;
+  typename Reg::monotonic_counter_ptr page_out_;
+  typename Reg::monotonic_counter_ptr swap_in_;
+  typename Reg::monotonic_counter_ptr swap_out_;
+  typename Reg::gauge_ptr fh_alloc_;
+  typename Reg::gauge_ptr fh_max_;
+  // meminfo
+  typename Reg::gauge_ptr avail_real_;
+  typename Reg::gauge_ptr free_real_;
+  typename Reg::gauge_ptr total_real_;
+  typename Reg::gauge_ptr avail_swap_;
+  typename Reg::gauge_ptr total_swap_;
+  typename Reg::gauge_ptr buffer_;
+  typename Reg::gauge_ptr cached_;
+  typename Reg::gauge_ptr shared_;
+  typename Reg::gauge_ptr total_free_;
+  // processes, sockets and arp
+  typename Reg::gauge_ptr cur_pids_;
+  typename Reg::gauge_ptr cur_threads_;
+  typename Reg::gauge_ptr tcp_memory_;
+  typename Reg::gauge_ptr arp_cache_size_;
+  // meters for each IrqStat type, in the same order as IrqStat::types(). Types are only ever
+  // appended, so the meters for new rows are added when the file layout changes
+  struct IrqMeters {
+    typename Reg::monotonic_counter_ptr total;
+    typename Reg::gauge_ptr per_cpu_max;
+    typename Reg::gauge_ptr imbalance;
+  };
+  std::vector<IrqMeters> interrupt_meters_;
+  std::vector<IrqMeters> softirq_meters_;
+  // indexed by SoftnetField
+  std::array<typename Reg::monotonic_counter_ptr, kSoftnetFields> softnet_totals_;
+  std::array<typename Reg::max_gauge_ptr, kSoftnetFields> softnet_per_cpu_max_;
+
+  const ProcStat& current_stat() noexcept;
 
   void handle_line(FILE* fp) noexcept;
-  void parse_ip_stats(const char* buf) noexcept;
-  void parse_tcp_stats(const char* buf) noexcept;
-  void parse_udp_stats(const char* buf) noexcept;
-  void parse_ipv6_stats(const std::unordered_map<std::string, int64_t>& snmp_stats) noexcept;
-  void parse_udpv6_stats(const std::unordered_map<std::string, int64_t>& snmp_stats) noexcept;
+  void update_irq_meters(const IrqStat& stat, const char* name,
+                         std::vector<IrqMeters>* meters) noexcept;
   void parse_load_avg(const char* buf) noexcept;
   void parse_tcp_connections() noexcept;
 };
@@ -0,0 +1,145 @@
+#include "proc_net_table.h"
+#include <lib/files/src/files.h>
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace atlasagent {
+
+namespace {
+inline const char* line_end(const char* p, const char* end) noexcept {
+  auto nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+  return nl == nullptr ? end : nl;
+}
+
+inline bool is_space(char c) noexcept { return c == ' ' || c == '\t'; }
+
+// returns the start of the next token in [p, end) and sets *token_end, or nullptr if none
+inline const char* next_token(const char* p, const char* end, const char** token_end) noexcept {
+  while (p < end && is_space(*p)) {
+    ++p;
+  }
+  if (p == end) {
+    return nullptr;
+  }
+  auto q = p;
+  while (q < end && !is_space(*q)) {
+    ++q;
+  }
+  *token_end = q;
+  return p;
+}
+
+inline int64_t parse_i64(const char* p, const char* end) noexcept {
+  bool negative = false;
+  if (p < end && *p == '-') {
+    negative = true;
+    ++p;
+  }
+  if (p == end) {
+    return ProcNetTable::kMissing;
+  }
+  int64_t n = 0;
+  for (; p < end; ++p) {
+    if (*p < '0' || *p > '9') {
+      return ProcNetTable::kMissing;
+    }
+    n = n * 10 + (*p - '0');
+  }
+  return negative ? -n : n;
+}
+}  // namespace
+
+bool ProcNetTable::refresh(const std::string& file_name) noexcept {
+  std::fill(values_.begin(), values_.end(), kMissing);
+  UnixFile fd{file_name.c_str()};
+  if (fd < 0) {
+    return false;
+  }
+  auto len = read_all(fd, &buf_);
+  if (len < 0) {
+    Logger()->warn("Unable to read {}: {}", file_name, strerror(errno));
+    return false;
+  }
+  parse(buf_.data(), buf_.data() + len);
+  return true;
+}
+
+const ProcNetTable::Layout* ProcNetTable::layout_for(const char* section, size_t section_len,
+                                                     const char* header,
+                                                     size_t header_len) noexcept {
+  auto it = std::find_if(layouts_.begin(), layouts_.end(), [&](const Layout& layout) {
+    return layout.section.size() == section_len &&
+           memcmp(layout.section.data(), section, section_len) == 0;
+  });
+  if (it != layouts_.end() && it->header.size() == header_len &&
+      memcmp(it->header.data(), header, header_len) == 0) {
+    return &*it;
+  }
+
+  // first time we see this section, or the kernel changed its columns
+  if (it == layouts_.end()) {
+    it = layouts_.emplace(layouts_.end());
+    it->section.assign(section, section_len);
+  }
+  it->header.assign(header, header_len);
+  it->slots.clear();
+  auto end = header + header_len;
+  const char* token_end;
+  for (auto p = next_token(header, end, &token_end); p != nullptr;
+       p = next_token(token_end, end, &token_end)) {
+    auto len = static_cast<size_t>(token_end - p);
+    int slot = -1;
+    for (size_t i = 0; i < num_columns_; ++i) {
+      const auto& col = columns_[i];
+      if (strlen(col.section) == section_len && memcmp(col.section, section, section_len) == 0 &&
+          strlen(col.name) == len && memcmp(col.name, p, len) == 0) {
+        slot = static_cast<int>(i);
+        break;
+      }
+    }
+    it->slots.push_back(slot);
+  }
+  return &*it;
+}
+
+void ProcNetTable::parse(const char* begin, const char* end) noexcept {
+  std::fill(values_.begin(), values_.end(), kMissing);
+  auto p = begin;
+  while (p < end) {
+    auto header_end = line_end(p, end);
+    auto colon = static_cast<const char*>(memchr(p, ':', static_cast<size_t>(header_end - p)));
+    if (colon == nullptr || header_end == end) {
+      break;
+    }
+    auto section = p;
+    auto section_len = static_cast<size_t>(colon - p);
+    auto values = header_end + 1;
+    auto values_end = line_end(values, end);
+    p = values_end == end ? end : values_end + 1;
+
+    // the value line must belong to the same section
+    if (static_cast<size_t>(values_end - values) <= section_len ||
+        memcmp(values, section, section_len) != 0 || values[section_len] != ':') {
+      Logger()->warn("Unexpected value line for section {}",
+                     std::string_view(section, section_len));
+      continue;
+    }
+
+    auto layout = layout_for(section, section_len, colon + 1,
+                             static_cast<size_t>(header_end - colon - 1));
+    const auto& slots = layout->slots;
+    auto vend = values_end;
+    const char* token_end;
+    size_t pos = 0;
+    for (auto v = next_token(values + section_len + 1, vend, &token_end);
+         v != nullptr && pos < slots.size(); v = next_token(token_end, vend, &token_end), ++pos) {
+      auto slot = slots[pos];
+      if (slot >= 0) {
+        values_[static_cast<size_t>(slot)] = parse_i64(v, token_end);
+      }
+    }
+  }
+}
+
+}  // namespace atlasagent
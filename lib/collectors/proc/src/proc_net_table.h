@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace atlasagent {
+
+// A column of interest in a /proc/net/{snmp,netstat} style file, for example {"TcpExt",
+// "ListenDrops"}
+struct NetColumn {
+  const char* section;
+  const char* name;
+};
+
+/// Parser for the files in /proc/net that are made of pairs of lines:
+///
+///   Section: Name1 Name2 ...
+///   Section: Value1 Value2 ...
+///
+/// The columns of interest are given once, and their position in the file is worked out from
+/// the header lines. The mapping is cached and only recomputed when a header changes, so newer
+/// kernels adding columns are handled without any change, and parsing the values is a
+/// positional scan that does not allocate.
+class ProcNetTable {
+ public:
+  static constexpr int64_t kMissing = INT64_MIN;
+
+  template <size_t N>
+  explicit ProcNetTable(const NetColumn (&columns)[N]) noexcept
+      : columns_{columns}, num_columns_{N}, values_(N, kMissing) {}
+
+  // read and parse the given file. Returns false if it could not be read
+  bool refresh(const std::string& file_name) noexcept;
+
+  // parse the contents of a file. Exposed for testing
+  void parse(const char* begin, const char* end) noexcept;
+
+  // value for the column at index idx in the columns given to the constructor, or kMissing
+  [[nodiscard]] int64_t value(size_t idx) const noexcept { return values_[idx]; }
+  [[nodiscard]] bool has(size_t idx) const noexcept { return values_[idx] != kMissing; }
+
+ private:
+  struct Layout {
+    std::string section;
+    std::string header;
+    // for each position in the value line, the index of the column it maps to or -1
+    std::vector<int> slots;
+  };
+
+  const NetColumn* columns_;
+  size_t num_columns_;
+  std::vector<int64_t> values_;
+  std::vector<Layout> layouts_;
+  std::vector<char> buf_;
+
+  const Layout* layout_for(const char* section, size_t section_len, const char* header,
+                           size_t header_len) noexcept;
+};
+
+}  // namespace atlasagent
@@ -0,0 +1,212 @@
+#include "proc_stat.h"
+#include <lib/files/src/files.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+
+namespace atlasagent {
+
+namespace {
+inline const char* skip_spaces(const char* p, const char* end) noexcept {
+  while (p < end && *p == ' ') {
+    ++p;
+  }
+  return p;
+}
+
+// parse an unsigned decimal number, returns nullptr if no digits were found
+inline const char* parse_u64(const char* p, const char* end, uint64_t* value) noexcept {
+  p = skip_spaces(p, end);
+  if (p == end || *p < '0' || *p > '9') {
+    return nullptr;
+  }
+  uint64_t n = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    n = n * 10 + static_cast<uint64_t>(*p - '0');
+    ++p;
+  }
+  *value = n;
+  return p;
+}
+
+inline const char* next_line(const char* p, const char* end) noexcept {
+  auto nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+  return nl == nullptr ? end : nl + 1;
+}
+
+inline bool has_prefix(const char* p, const char* end, const char* prefix, size_t len) noexcept {
+  return static_cast<size_t>(end - p) >= len && memcmp(p, prefix, len) == 0;
+}
+
+// parse up to kCpuFields columns, returns the number of columns read
+inline size_t parse_cpu_fields(const char* p, const char* end, cpu_fields_t* fields) noexcept {
+  size_t n = 0;
+  while (n < kCpuFields) {
+    p = parse_u64(p, end, &(*fields)[n]);
+    if (p == nullptr) {
+      break;
+    }
+    ++n;
+  }
+  for (auto i = n; i < kCpuFields; ++i) {
+    (*fields)[i] = 0;
+  }
+  return n;
+}
+
+inline int64_t parse_single_value(const char* p, const char* end) noexcept {
+  uint64_t value;
+  return parse_u64(p, end, &value) == nullptr ? -1 : static_cast<int64_t>(value);
+}
+}  // namespace
+
+void ProcStat::reset() noexcept {
+  valid_ = false;
+  aggregate_.fill(0);
+  aggregate_num_fields_ = 0;
+  cpu_ids_.clear();
+  for (auto& column : per_cpu_) {
+    column.clear();
+  }
+  per_cpu_num_fields_ = 0;
+  ctxt_ = intr_ = softirq_ = processes_ = procs_running_ = procs_blocked_ = -1;
+}
+
+bool ProcStat::refresh() noexcept {
+  auto file_name = fmt::format("{}/stat", path_prefix_);
+  UnixFile fd{file_name.c_str()};
+  if (fd < 0) {
+    reset();
+    return false;
+  }
+
+  // the intr line alone can be several kilobytes on hosts with many cpus,
+  // so start with a buffer that is large enough for most of them
+  if (buf_.empty()) {
+    buf_.resize(64 * 1024);
+  }
+  auto len = read_all(fd, &buf_);
+  if (len < 0) {
+    Logger()->warn("Unable to read {}: {}", file_name, strerror(errno));
+    reset();
+    return false;
+  }
+
+  parse(buf_.data(), buf_.data() + len);
+  if (valid_) {
+    ++generation_;
+  }
+  return valid_;
+}
+
+void ProcStat::parse(const char* begin, const char* end) noexcept {
+  reset();
+  auto per_cpu_num_fields = kCpuFields;
+  for (auto p = begin; p < end; p = next_line(p, end)) {
+    if (has_prefix(p, end, "cpu", 3)) {
+      if (p + 3 < end && p[3] == ' ') {
+        aggregate_num_fields_ = parse_cpu_fields(p + 3, end, &aggregate_);
+        valid_ = aggregate_num_fields_ > 0;
+        continue;
+      }
+      uint64_t cpu_num;
+      auto fields_start = parse_u64(p + 3, end, &cpu_num);
+      if (fields_start == nullptr) {
+        continue;
+      }
+      cpu_fields_t fields;
+      auto n = parse_cpu_fields(fields_start, end, &fields);
+      per_cpu_num_fields = std::min(per_cpu_num_fields, n);
+      cpu_ids_.push_back(static_cast<int>(cpu_num));
+      for (auto i = 0u; i < kCpuFields; ++i) {
+        per_cpu_[i].push_back(fields[i]);
+      }
+    } else if (has_prefix(p, end, "intr ", 5)) {
+      // only the total is needed, the rest of the line is skipped without being parsed
+      intr_ = parse_single_value(p + 5, end);
+    } else if (has_prefix(p, end, "ctxt ", 5)) {
+      ctxt_ = parse_single_value(p + 5, end);
+    } else if (has_prefix(p, end, "processes ", 10)) {
+      processes_ = parse_single_value(p + 10, end);
+    } else if (has_prefix(p, end, "procs_running ", 14)) {
+      procs_running_ = parse_single_value(p + 14, end);
+    } else if (has_prefix(p, end, "procs_blocked ", 14)) {
+      procs_blocked_ = parse_single_value(p + 14, end);
+    } else if (has_prefix(p, end, "softirq ", 8)) {
+      softirq_ = parse_single_value(p + 8, end);
+    }
+  }
+  per_cpu_num_fields_ = cpu_ids_.empty() ? 0 : per_cpu_num_fields;
+}
+
+uint64_t ProcStat::aggregate_total() const noexcept {
+  return std::accumulate(aggregate_.begin(), aggregate_.begin() + aggregate_num_fields_,
+                         uint64_t{0});
+}
+
+bool CoreUtilization::update(const ProcStat& proc_stat) noexcept {
+  auto n = proc_stat.num_cpus();
+  if (!proc_stat.valid() || n == 0) {
+    return false;
+  }
+
+  busy_.resize(n);
+  total_.resize(n);
+  const auto* user = proc_stat.per_cpu(CpuField::user).data();
+  const auto* nice = proc_stat.per_cpu(CpuField::nice).data();
+  const auto* system = proc_stat.per_cpu(CpuField::system).data();
+  const auto* idle = proc_stat.per_cpu(CpuField::idle).data();
+  const auto* iowait = proc_stat.per_cpu(CpuField::iowait).data();
+  const auto* irq = proc_stat.per_cpu(CpuField::irq).data();
+  const auto* softirq = proc_stat.per_cpu(CpuField::softirq).data();
+  const auto* steal = proc_stat.per_cpu(CpuField::steal).data();
+  const auto* guest = proc_stat.per_cpu(CpuField::guest).data();
+  const auto* guest_nice = proc_stat.per_cpu(CpuField::guest_nice).data();
+  // same definition of busy as sys.cpu.coreUtilization: everything but idle
+  // (guest time is already accounted for in user and nice)
+  for (size_t i = 0; i < n; ++i) {
+    busy_[i] = user[i] + nice[i] + system[i] + iowait[i] + irq[i] + softirq[i] + steal[i];
+    total_[i] = busy_[i] + idle[i] + guest[i] + guest_nice[i];
+  }
+
+  // cpus came online or went offline, start over
+  if (cpu_ids_ != proc_stat.cpu_ids()) {
+    cpu_ids_ = proc_stat.cpu_ids();
+    prev_busy_.swap(busy_);
+    prev_total_.swap(total_);
+    utilization_.clear();
+    return false;
+  }
+
+  utilization_.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    // iowait is not guaranteed to be monotonic, so the deltas are computed as signed values
+    auto delta_busy = static_cast<double>(static_cast<int64_t>(busy_[i] - prev_busy_[i]));
+    auto delta_total = static_cast<double>(static_cast<int64_t>(total_[i] - prev_total_[i]));
+    auto pct = delta_total > 0 ? 100.0 * delta_busy / delta_total : 0.0;
+    utilization_[i] = std::min(std::max(pct, 0.0), 100.0);
+  }
+  prev_busy_.swap(busy_);
+  prev_total_.swap(total_);
+  return true;
+}
+
+double CoreUtilization::max_utilization() const noexcept {
+  double result = 0.0;
+  for (auto pct : utilization_) {
+    result = std::max(result, pct);
+  }
+  return result;
+}
+
+size_t CoreUtilization::cores_above(double threshold) const noexcept {
+  size_t result = 0;
+  for (auto pct : utilization_) {
+    result += pct > threshold ? 1 : 0;
+  }
+  return result;
+}
+
+}  // namespace atlasagent
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace atlasagent {
+
+// Columns of a cpu line in /proc/stat, in the order the kernel writes them
+enum class CpuField : size_t {
+  user,
+  nice,
+  system,
+  idle,
+  iowait,
+  irq,
+  softirq,
+  steal,
+  guest,
+  guest_nice
+};
+static constexpr size_t kCpuFields = 10;
+
+using cpu_fields_t = std::array<uint64_t, kCpuFields>;
+
+/// A parsed view of /proc/stat. It is refreshed once per tick by its owner and then shared by
+/// every collector interested in cpu times or process counts, so the file is read and parsed
+/// only once regardless of how many consumers there are.
+///
+/// Per-cpu values are stored as one contiguous array per column (structure of arrays), indexed
+/// by the position of the cpu line in the file. cpu_ids() maps a position to the cpu number.
+class ProcStat {
+ public:
+  explicit ProcStat(std::string path_prefix = "/proc") noexcept
+      : path_prefix_(std::move(path_prefix)) {}
+
+  // read and parse {path_prefix}/stat. Returns false if the file could not be read,
+  // in which case the previous values are discarded
+  bool refresh() noexcept;
+  void set_prefix(std::string new_prefix) noexcept { path_prefix_ = std::move(new_prefix); }
+
+  // parse the contents of a /proc/stat file. Exposed for testing
+  void parse(const char* begin, const char* end) noexcept;
+
+  [[nodiscard]] bool valid() const noexcept { return valid_; }
+  // incremented every time the snapshot is refreshed successfully
+  [[nodiscard]] uint64_t generation() const noexcept { return generation_; }
+
+  // the aggregate 'cpu' line, and the number of columns present in it
+  [[nodiscard]] const cpu_fields_t& aggregate() const noexcept { return aggregate_; }
+  [[nodiscard]] size_t aggregate_num_fields() const noexcept { return aggregate_num_fields_; }
+  // sum of all the columns in the aggregate line
+  [[nodiscard]] uint64_t aggregate_total() const noexcept;
+
+  [[nodiscard]] size_t num_cpus() const noexcept { return cpu_ids_.size(); }
+  [[nodiscard]] const std::vector<int>& cpu_ids() const noexcept { return cpu_ids_; }
+  [[nodiscard]] const std::vector<uint64_t>& per_cpu(CpuField field) const noexcept {
+    return per_cpu_[static_cast<size_t>(field)];
+  }
+  // minimum number of columns present in the per-cpu lines
+  [[nodiscard]] size_t per_cpu_num_fields() const noexcept { return per_cpu_num_fields_; }
+
+  // the following return -1 if the value was not present in the file
+  [[nodiscard]] int64_t ctxt() const noexcept { return ctxt_; }
+  [[nodiscard]] int64_t intr() const noexcept { return intr_; }
+  [[nodiscard]] int64_t softirq() const noexcept { return softirq_; }
+  [[nodiscard]] int64_t processes() const noexcept { return processes_; }
+  [[nodiscard]] int64_t procs_running() const noexcept { return procs_running_; }
+  [[nodiscard]] int64_t procs_blocked() const noexcept { return procs_blocked_; }
+
+ private:
+  std::string path_prefix_;
+  std::vector<char> buf_;
+  bool valid_{false};
+  uint64_t generation_{0};
+
+  cpu_fields_t aggregate_{};
+  size_t aggregate_num_fields_{0};
+  std::vector<int> cpu_ids_;
+  std::array<std::vector<uint64_t>, kCpuFields> per_cpu_;
+  size_t per_cpu_num_fields_{0};
+
+  int64_t ctxt_{-1};
+  int64_t intr_{-1};
+  int64_t softirq_{-1};
+  int64_t processes_{-1};
+  int64_t procs_running_{-1};
+  int64_t procs_blocked_{-1};
+
+  void reset() noexcept;
+};
+
+/// Per-core utilization between two consecutive ProcStat snapshots. Previous busy and total
+/// ticks are kept in contiguous arrays indexed like ProcStat::cpu_ids(), so computing the
+/// deltas is a straight loop over arrays that the compiler can vectorize.
+class CoreUtilization {
+ public:
+  // compute the utilization of each core since the previous update. Returns false when there
+  // is no previous sample to compare against, including after the set of cpus changed
+  bool update(const ProcStat& proc_stat) noexcept;
+
+  // utilization percentage per core, valid after update returned true
+  [[nodiscard]] const std::vector<double>& utilization() const noexcept { return utilization_; }
+  [[nodiscard]] double max_utilization() const noexcept;
+  [[nodiscard]] size_t cores_above(double threshold) const noexcept;
+
+ private:
+  std::vector<int> cpu_ids_;
+  std::vector<uint64_t> busy_;
+  std::vector<uint64_t> total_;
+  std::vector<uint64_t> prev_busy_;
+  std::vector<uint64_t> prev_total_;
+  std::vector<double> utilization_;
+};
+
+}  // namespace atlasagent
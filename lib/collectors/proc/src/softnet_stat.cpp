@@ -0,0 +1,125 @@
+#include "softnet_stat.h"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace atlasagent {
+
+namespace {
+// position of each SoftnetField in a row
+constexpr size_t kSoftnetColumns[kSoftnetFields] = {0, 1, 2, 9};
+constexpr size_t kMaxColumn = 9;
+
+inline int hex_digit(char c) noexcept {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  auto lower = static_cast<char>(c | 0x20);
+  if (lower >= 'a' && lower <= 'f') {
+    return lower - 'a' + 10;
+  }
+  return -1;
+}
+
+// parse a hex number, returns nullptr if no digits were found
+inline const char* parse_hex(const char* p, const char* end, uint64_t* value) noexcept {
+  while (p < end && *p == ' ') {
+    ++p;
+  }
+  uint64_t n = 0;
+  auto start = p;
+  for (int d; p < end && (d = hex_digit(*p)) >= 0; ++p) {
+    n = (n << 4) | static_cast<uint64_t>(d);
+  }
+  if (p == start) {
+    return nullptr;
+  }
+  *value = n;
+  return p;
+}
+}  // namespace
+
+void SoftnetStat::set_prefix(std::string new_prefix) noexcept {
+  path_prefix_ = std::move(new_prefix);
+  // force the file to be opened again
+  fd_.reset();
+  open_failed_ = false;
+}
+
+bool SoftnetStat::refresh() noexcept {
+  if (fd_ < 0) {
+    if (open_failed_) {
+      return false;
+    }
+    auto file_name = fmt::format("{}/net/softnet_stat", path_prefix_);
+    fd_.open(file_name.c_str());
+    if (fd_ < 0) {
+      // do not keep trying (and logging) every second
+      open_failed_ = true;
+      return false;
+    }
+  }
+
+  auto len = pread_all(fd_, &buf_);
+  if (len < 0) {
+    Logger()->warn("Unable to read {}/net/softnet_stat: {}", path_prefix_, strerror(errno));
+    return false;
+  }
+  parse(buf_.data(), buf_.data() + len);
+  return true;
+}
+
+void SoftnetStat::parse(const char* begin, const char* end) noexcept {
+  auto prev_cpus = cur_[0].size();
+  for (size_t i = 0; i < kSoftnetFields; ++i) {
+    prev_[i].swap(cur_[i]);
+    cur_[i].clear();
+  }
+
+  std::array<uint64_t, kMaxColumn + 1> row{};
+  for (auto p = begin; p < end;) {
+    auto nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+    auto line_end = nl == nullptr ? end : nl;
+    size_t n = 0;
+    for (auto q = p; n <= kMaxColumn; ++n) {
+      q = parse_hex(q, line_end, &row[n]);
+      if (q == nullptr) {
+        break;
+      }
+    }
+    if (n > 0) {
+      // received_rps is not present on very old kernels
+      std::fill(row.begin() + static_cast<std::ptrdiff_t>(n), row.end(), 0);
+      for (size_t i = 0; i < kSoftnetFields; ++i) {
+        cur_[i].push_back(row[kSoftnetColumns[i]]);
+      }
+    }
+    p = line_end + 1;
+  }
+
+  // the previous sample is only comparable if it has the same rows
+  has_prev_ = prev_cpus > 0 && prev_cpus == cur_[0].size();
+}
+
+uint64_t SoftnetStat::total(SoftnetField field) const noexcept {
+  const auto& column = cur_[static_cast<size_t>(field)];
+  return std::accumulate(column.begin(), column.end(), uint64_t{0});
+}
+
+int64_t SoftnetStat::max_delta(SoftnetField field) const noexcept {
+  if (!has_prev_) {
+    return -1;
+  }
+  const auto& cur = cur_[static_cast<size_t>(field)];
+  const auto& prev = prev_[static_cast<size_t>(field)];
+  int64_t result = 0;
+  for (size_t i = 0; i < cur.size(); ++i) {
+    // the counters are 32 bits wide in the kernel and wrap around
+    auto delta = static_cast<int64_t>(static_cast<uint32_t>(cur[i] - prev[i]));
+    result = std::max(result, delta);
+  }
+  return result;
+}
+
+}  // namespace atlasagent
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <lib/files/src/files.h>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace atlasagent {
+
+// Columns of /proc/net/softnet_stat we track
+enum class SoftnetField : size_t { processed, dropped, time_squeeze, received_rps };
+static constexpr size_t kSoftnetFields = 4;
+
+/// Per-cpu packet processing statistics from /proc/net/softnet_stat. The file has one row of
+/// fixed width hex numbers per online cpu. It is kept open and re-read from the start on every
+/// refresh, since it is sampled every second.
+///
+/// Values are stored as one array per column, together with the previous sample, so the
+/// busiest cpu can be found with a single pass.
+class SoftnetStat {
+ public:
+  explicit SoftnetStat(std::string path_prefix = "/proc") noexcept
+      : path_prefix_{std::move(path_prefix)} {}
+
+  // read and parse the file. Returns false if it could not be read
+  bool refresh() noexcept;
+  void set_prefix(std::string new_prefix) noexcept;
+
+  // parse the contents of a softnet_stat file. Exposed for testing
+  void parse(const char* begin, const char* end) noexcept;
+
+  [[nodiscard]] size_t num_cpus() const noexcept { return cur_[0].size(); }
+  // sum of a column across all cpus
+  [[nodiscard]] uint64_t total(SoftnetField field) const noexcept;
+  // largest increase of a column on a single cpu since the previous sample, or -1 if there is
+  // no previous sample or the set of cpus changed
+  [[nodiscard]] int64_t max_delta(SoftnetField field) const noexcept;
+
+ private:
+  std::string path_prefix_;
+  UnixFile fd_{-1};
+  bool open_failed_{false};
+  std::vector<char> buf_;
+  bool has_prev_{false};
+  std::array<std::vector<uint64_t>, kSoftnetFields> cur_;
+  std::array<std::vector<uint64_t>, kSoftnetFields> prev_;
+};
+
+}  // namespace atlasagent
@@ -46,6 +46,88 @@ TEST(Proc, ParseNetwork) {
   EXPECT_TRUE(map.empty());  // checked all values
 }
 
+TEST(Proc, SoftnetStats) {
+  Registry registry;
+  spectator::Tags extra{{"nf.test", "extra"}};
+  Proc proc{&registry, extra, "testdata/resources/proc"};
+
+  proc.softnet_stats();
+  EXPECT_TRUE(my_measurements(&registry).empty());
+
+  proc.set_prefix("testdata/resources/proc2");
+  proc.softnet_stats();
+  const auto& ms = my_measurements(&registry);
+  auto map = measurements_to_map(ms, "");
+  expect_value(&map, "net.softnet.processed|count", 6000);
+  expect_value(&map, "net.softnet.dropped|count", 2);
+  expect_value(&map, "net.softnet.timeSqueeze|count", 2);
+  expect_value(&map, "net.softnet.receivedRps|count", 5);
+  expect_value(&map, "net.softnet.perCpuMax|max|processed", 5000);
+  expect_value(&map, "net.softnet.perCpuMax|max|dropped", 2);
+  expect_value(&map, "net.softnet.perCpuMax|max|timeSqueeze", 2);
+  expect_value(&map, "net.softnet.perCpuMax|max|receivedRps", 4);
+  EXPECT_TRUE(map.empty());
+}
+
+TEST(Proc, SoftnetParse) {
+  atlasagent::SoftnetStat softnet;
+  using atlasagent::SoftnetField;
+
+  // old kernels only had 10 columns, and the counters wrap around at 32 bits
+  const char first[] =
+      "ffffffff 00000001 0000000a 00000000 00000000 00000000 00000000 00000000 00000000 "
+      "000000FF\n";
+  softnet.parse(first, first + sizeof first - 1);
+  EXPECT_EQ(1, softnet.num_cpus());
+  EXPECT_EQ(0xffffffff, softnet.total(SoftnetField::processed));
+  EXPECT_EQ(255, softnet.total(SoftnetField::received_rps));
+  EXPECT_EQ(-1, softnet.max_delta(SoftnetField::processed));
+
+  const char second[] =
+      "00000009 00000001 0000000a 00000000 00000000 00000000 00000000 00000000 00000000 "
+      "000000FF\n";
+  softnet.parse(second, second + sizeof second - 1);
+  EXPECT_EQ(10, softnet.max_delta(SoftnetField::processed));
+  EXPECT_EQ(0, softnet.max_delta(SoftnetField::dropped));
+}
+
+TEST(Proc, InterruptStats) {
+  Registry registry;
+  spectator::Tags extra{{"nf.test", "extra"}};
+  Proc proc{&registry, extra, "testdata/resources/proc"};
+
+  proc.interrupt_stats();
+  proc.softirq_stats();
+  EXPECT_TRUE(my_measurements(&registry).empty());
+
+  proc.set_prefix("testdata/resources/proc2");
+  proc.interrupt_stats();
+  proc.softirq_stats();
+  const auto& ms = my_measurements(&registry);
+  auto map = measurements_to_map(ms, "");
+  expect_value(&map, "sys.interrupts|count|device", 1000);
+  expect_value(&map, "sys.interrupts|count|NMI", 4);
+  expect_value(&map, "sys.interrupts|count|LOC", 4000);
+  expect_value(&map, "sys.interrupts|count|ERR", 2);
+  expect_value(&map, "sys.interrupts|count|MIS", 1);
+  expect_value(&map, "sys.interrupts.perCpuMax|gauge|device", 800);
+  expect_value(&map, "sys.interrupts.imbalance|gauge|device", 3.2);
+
+  expect_value(&map, "sys.softirqs|count|HI", 1);
+  expect_value(&map, "sys.softirqs|count|TIMER", 400);
+  expect_value(&map, "sys.softirqs|count|NET_TX", 4);
+  expect_value(&map, "sys.softirqs|count|NET_RX", 1200);
+  expect_value(&map, "sys.softirqs.perCpuMax|gauge|HI", 1);
+  expect_value(&map, "sys.softirqs.perCpuMax|gauge|TIMER", 100);
+  expect_value(&map, "sys.softirqs.perCpuMax|gauge|NET_TX", 1);
+  expect_value(&map, "sys.softirqs.perCpuMax|gauge|NET_RX", 900);
+  expect_value(&map, "sys.softirqs.imbalance|gauge|HI", 4);
+  expect_value(&map, "sys.softirqs.imbalance|gauge|TIMER", 1);
+  expect_value(&map, "sys.softirqs.imbalance|gauge|NET_TX", 1);
+  expect_value(&map, "sys.softirqs.imbalance|gauge|NET_RX", 3);
+  EXPECT_TRUE(map.empty());
+}
+
 TEST(Proc, ParseSnmp) {
   Registry registry;
   spectator::Tags extra{{"nf.test", "extra"}};
@@ -105,6 +187,8 @@ TEST(Proc, ParseSnmp) {
   expect_value(&values, "net.udp.datagrams|count|in|v4|extra", 10000);
   expect_value(&values, "net.udp.datagrams|count|out|v4|extra", 1000);
   expect_value(&values, "net.udp.errors|count|inErrors|v4|extra", 1);
+  expect_value(&values, "net.udp.errors|count|rcvbufErrors|v4|extra", 1);
+  expect_value(&values, "net.udp.errors|count|sndbufErrors|v4|extra", 1);
 
   expect_value(&values, "net.ip.discards|count|in|v6|extra", 1.0);
   expect_value(&values, "net.ip.discards|count|out|v6|extra", 2.0);
@@ -172,6 +256,102 @@ TEST(Proc, CpuStats) {
   EXPECT_EQ(17, ms2.size());
 }
 
+TEST(Proc, IndependentInstances) {
+  Registry registry;
+  spectator::Tags extra{{"nf.test", "extra"}};
+  Proc proc{&registry, extra, "testdata/resources/proc"};
+  proc.cpu_stats();
+
+  // a second instance starts without any history, regardless of what the first one has seen
+  Registry other_registry;
+  Proc other{&other_registry, extra, "testdata/resources/proc2"};
+  other.cpu_stats();
+  EXPECT_EQ(1, my_measurements(&other_registry).size());
+
+  proc.set_prefix("testdata/resources/proc2");
+  proc.cpu_stats();
+  EXPECT_EQ(11, my_measurements(&registry).size());
+}
+
+TEST(Proc, StatSnapshot) {
+  using atlasagent::CpuField;
+  atlasagent::ProcStat proc_stat{"testdata/resources/proc"};
+  ASSERT_TRUE(proc_stat.refresh());
+  EXPECT_EQ(1, proc_stat.generation());
+  EXPECT_EQ(10, proc_stat.aggregate_num_fields());
+  EXPECT_EQ(888323, proc_stat.aggregate()[static_cast<size_t>(CpuField::user)]);
+  EXPECT_EQ(19198842, proc_stat.aggregate()[static_cast<size_t>(CpuField::idle)]);
+  EXPECT_EQ(8986, proc_stat.aggregate()[static_cast<size_t>(CpuField::steal)]);
+  EXPECT_EQ(888323 + 1687 + 28308 + 19198842 + 3236 + 6908 + 8986, proc_stat.aggregate_total());
+
+  EXPECT_EQ(2, proc_stat.num_cpus());
+  EXPECT_EQ(std::vector<int>({0, 1}), proc_stat.cpu_ids());
+  EXPECT_EQ(2, proc_stat.per_cpu(CpuField::user).size());
+  EXPECT_EQ(10, proc_stat.per_cpu_num_fields());
+
+  EXPECT_EQ(202156947, proc_stat.intr());
+  EXPECT_EQ(290595647, proc_stat.ctxt());
+  EXPECT_EQ(60947998, proc_stat.softirq());
+  EXPECT_EQ(67395, proc_stat.processes());
+  EXPECT_EQ(2, proc_stat.procs_running());
+  EXPECT_EQ(1, proc_stat.procs_blocked());
+
+  // older kernels do not report steal/guest columns nor process counts
+  const char old_stat[] = "cpu  10 20 30 40 50 60 70\ncpu0 10 20 30 40 50 60 70\n";
+  proc_stat.parse(old_stat, old_stat + sizeof old_stat - 1);
+  EXPECT_TRUE(proc_stat.valid());
+  EXPECT_EQ(7, proc_stat.aggregate_num_fields());
+  EXPECT_EQ(280, proc_stat.aggregate_total());
+  EXPECT_EQ(1, proc_stat.num_cpus());
+  EXPECT_EQ(7, proc_stat.per_cpu_num_fields());
+  EXPECT_EQ(-1, proc_stat.processes());
+
+  proc_stat.set_prefix("testdata/resources/does-not-exist");
+  EXPECT_FALSE(proc_stat.refresh());
+  EXPECT_FALSE(proc_stat.valid());
+}
+
+TEST(Proc, CoreUtilization) {
+  atlasagent::ProcStat proc_stat;
+  atlasagent::CoreUtilization core_utilization;
+
+  const char first[] =
+      "cpu  400 0 0 400 0 0 0 0 0 0\n"
+      "cpu0 100 0 0 100 0 0 0 0 0 0\n"
+      "cpu1 100 0 0 100 0 0 0 0 0 0\n"
+      "cpu2 100 0 0 100 0 0 0 0 0 0\n";
+  proc_stat.parse(first, first + sizeof first - 1);
+  EXPECT_FALSE(core_utilization.update(proc_stat));
+
+  // cpu0 fully busy, cpu1 95% busy (iowait and steal count as busy), cpu2 idle
+  const char second[] =
+      "cpu  600 0 0 600 0 0 0 0 0 0\n"
+      "cpu0 200 0 0 100 0 0 0 0 0 0\n"
+      "cpu1 150 0 0 105 40 0 0 5 0 0\n"
+      "cpu2 100 0 0 200 0 0 0 0 0 0\n";
+  proc_stat.parse(second, second + sizeof second - 1);
+  ASSERT_TRUE(core_utilization.update(proc_stat));
+  const auto& utilization = core_utilization.utilization();
+  ASSERT_EQ(3, utilization.size());
+  EXPECT_DOUBLE_EQ(100.0, utilization[0]);
+  EXPECT_DOUBLE_EQ(95.0, utilization[1]);
+  EXPECT_DOUBLE_EQ(0.0, utilization[2]);
+  EXPECT_DOUBLE_EQ(100.0, core_utilization.max_utilization());
+  EXPECT_EQ(2, core_utilization.cores_above(90.0));
+
+  // a cpu going offline resets the history
+  const char third[] =
+      "cpu  600 0 0 600 0 0 0 0 0 0\n"
+      "cpu0 300 0 0 100 0 0 0 0 0 0\n"
+      "cpu2 100 0 0 300 0 0 0 0 0 0\n";
+  proc_stat.parse(third, third + sizeof third - 1);
+  EXPECT_FALSE(core_utilization.update(proc_stat));
+  proc_stat.parse(third, third + sizeof third - 1);
+  ASSERT_TRUE(core_utilization.update(proc_stat));
+  EXPECT_EQ(2, core_utilization.utilization().size());
+  EXPECT_EQ(0, core_utilization.cores_above(90.0));
+}
+
 TEST(Proc, UptimeStats) {
   Registry registry;
   spectator::Tags extra{{"nf.test", "extra"}};
@@ -245,9 +425,44 @@ TEST(Proc, ParseNetstat) {
   expect_value(&values, "net.ip.ectPackets|count|capable|v4|extra", 180.0);
   expect_value(&values, "net.ip.ectPackets|count|notCapable|v4|extra", 60.0);
   expect_value(&values, "net.ip.congestedPackets|count|v4|extra", 30);
+  expect_value(&values, "net.tcp.errors|count|listenOverflows|extra", 3);
+  expect_value(&values, "net.tcp.errors|count|listenDrops|extra", 4);
+  expect_value(&values, "net.tcp.errors|count|timeouts|extra", 5);
+  expect_value(&values, "net.tcp.errors|count|backlogDrops|extra", 2);
+  expect_value(&values, "net.tcp.errors|count|pruneCalled|extra", 1);
   EXPECT_TRUE(values.empty());
 }
 
+TEST(Proc, NetTable) {
+  using atlasagent::ProcNetTable;
+  static constexpr atlasagent::NetColumn kColumns[] = {
+      {"Tcp", "MaxConn"}, {"Tcp", "OutRsts"}, {"TcpExt", "TCPRcvQDrop"}, {"Udp", "InErrors"}};
+  ProcNetTable table{kColumns};
+
+  const char contents[] =
+      "Tcp: RtoAlgorithm MaxConn InErrs OutRsts\n"
+      "Tcp: 1 -1 10 84370\n"
+      "TcpExt: PruneCalled TCPRcvQDrop\n"
+      "TcpExt: 1 42\n";
+  table.parse(contents, contents + sizeof contents - 1);
+  EXPECT_EQ(-1, table.value(0));
+  EXPECT_EQ(84370, table.value(1));
+  EXPECT_EQ(42, table.value(2));
+  EXPECT_FALSE(table.has(3));
+
+  // a kernel adding and reordering columns is picked up from the header
+  const char newer[] =
+      "Tcp: RtoAlgorithm OutRsts MaxConn InErrs InCsumErrors\n"
+      "Tcp: 1 84371 -1 10 0\n"
+      "Udp: InDatagrams InErrors\n"
+      "Udp: 10 3\n";
+  table.parse(newer, newer + sizeof newer - 1);
+  EXPECT_EQ(-1, table.value(0));
+  EXPECT_EQ(84371, table.value(1));
+  EXPECT_FALSE(table.has(2));
+  EXPECT_EQ(3, table.value(3));
+}
+
 TEST(Proc, ParseSocketStats) {
   Registry registry;
   spectator::Tags extra{{"nf.test", "extra"}};
@@ -1,14 +1,17 @@
 #include "service_monitor.h"
 #include <lib/util/src/util.h>
+#include <algorithm>
 
 template class ServiceMonitor<atlasagent::TaggingRegistry>;
 
 // The constructor takes a registry, a vector of regex patterns, and a maximum number of services to monitor.
 // If the maximum number of services is not equal to the default value, it logs a message indicating the custom value.
 template <typename Reg>
-ServiceMonitor<Reg>::ServiceMonitor(Reg* registry, std::vector<std::regex> config, unsigned int max_services)
+ServiceMonitor<Reg>::ServiceMonitor(Reg* registry, const std::vector<std::string>& config, unsigned int max_services,
+                                    const atlasagent::ProcStat* procStat)
     : registry_{registry},
-      config_{std::move(config)},
+      matcher_{config},
+      procStat_{procStat},
       maxMonitoredServices{max_services == ServiceMonitorConstants::DefaultMonitoredServices ? ServiceMonitorConstants::DefaultMonitoredServices : max_services} {
   if (this->maxMonitoredServices != ServiceMonitorConstants::DefaultMonitoredServices) {
     atlasagent::Logger()->info("Custom max monitored services value set: {} (default is {})",
@@ -33,49 +36,112 @@ bool ServiceMonitor<Reg>::init_monitored_services() try {
     return false;
   }
 
+  // Read & set the clock ticks per second to compare the cgroup cpu usage with /proc/stat
+  this->clockTicks = sysconf(_SC_CLK_TCK);
+  if (this->clockTicks <= 0) {
+    atlasagent::Logger()->error("Error getting clock ticks per second");
+    return false;
+  }
+
+  if (this->discover_services() == false) {
+    return false;
+  }
+
+  // Units were retrieved. initSuccess is now true because monitoredServices now initialized
+  // with pattern matched services.
+  this->initSuccess = true;
+  if (this->monitoredServices_.empty() == true) {
+    atlasagent::Logger()->error(
+        "User Error: Monitor Service config provided but no services matched pattern");
+  }
+  return true;
+} catch (const std::exception& e) {
+  atlasagent::Logger()->error("Exception: {} in init_monitored_services", e.what());
+  return false;
+}
+
+// Match the units that were not listed by the previous discovery against the config, and add the
+// ones that match to monitoredServices_ as long as we are beneath the maxMonitoredServices threshold
+template <class Reg>
+bool ServiceMonitor<Reg>::discover_services() {
   // Get all the systemd units on the system
-  auto all_units = list_all_units();
+  auto all_units = systemd_.list_all_units();
   if (all_units.has_value() == false) {
     atlasagent::Logger()->error("Error gathering all units from Systemd");
     return false;
   }
 
-  // Iterate through all the units and check if the unit name matches any of the regex patterns in the config
-  // If it does, add the unit name to the monitoredServices_ as long as we are beneath the maxMonitoredServices threshold
+  auto numMonitored = this->monitoredServices_.size();
+  std::unordered_set<std::string> units{};
+  units.reserve(all_units.value().size());
   for (const auto& unit : all_units.value()) {
     const auto& unit_name = std::get<0>(unit);
+    units.insert(unit_name);
+    if (knownUnits_.find(unit_name) != knownUnits_.end() || matcher_.matches(unit_name) == false) {
+      continue;
+    }
 
-    bool matched = std::any_of(
-        config_.begin(), config_.end(),
-        [&unit_name](const std::regex& regex) { return std::regex_search(unit_name, regex); });
-
-    if (matched == false) {
+    // A monitored unit that systemd unloaded for a while
+    if (std::find(monitoredServices_.begin(), monitoredServices_.end(), unit_name) != monitoredServices_.end()) {
       continue;
     }
 
     if (monitoredServices_.size() >= maxMonitoredServices) {
-      atlasagent::Logger()->info(
-          "Reached maximum number of monitored services ({}). Ignoring service {} and remaining "
-          "services.",
-          maxMonitoredServices, unit_name);
-      break;
+      atlasagent::Logger()->info("Reached maximum number of monitored services ({}). Ignoring service {}.",
+                                 maxMonitoredServices, unit_name);
+      continue;
     }
 
     monitoredServices_.emplace_back(unit_name);
     atlasagent::Logger()->info("Added service {} to monitoring list ({}/{})", unit_name,
                                monitoredServices_.size(), this->maxMonitoredServices);
   }
+  knownUnits_ = std::move(units);
+  this->updatesSinceDiscovery_ = 0;
 
-  // Units were retrieved. initSuccess is now true because monitoredServices now initialized
-  // with pattern matched services.
-  this->initSuccess = true;
-  if (this->monitoredServices_.empty() == true) {
-    atlasagent::Logger()->error(
-        "User Error: Monitor Service config provided but no services matched pattern");
+  // Track the state of the monitored services from the systemd signals, so changes between two
+  // updates are not missed. Without the signals the properties are read on every update.
+  // The subscription also signals new units, which triggers the next discovery.
+  if (this->initSuccess == false || monitoredServices_.size() != numMonitored) {
+    systemd_.watch(monitoredServices_);
   }
   return true;
-} catch (const std::exception& e) {
-  atlasagent::Logger()->error("Exception: {} in init_monitored_services", e.what());
+}
+
+// Read the cgroup files of a running service. Returns false if the cgroup is not available, for
+// example with cgroup v1 or when memory accounting is disabled for the unit.
+template <class Reg>
+bool ServiceMonitor<Reg>::read_cgroup(const ServiceProperties& service, ServiceCgroup* cgroup) {
+  if (service.controlGroup.empty()) {
+    return false;
+  }
+  if (cgroup->path != service.controlGroup) {
+    cgroup->path = service.controlGroup;
+    cgroup->dir.reset();
+    cgroup->prevUsageUsec = -1;
+  }
+
+  // A restart removes the cgroup and creates it again, so the directory is opened again once
+  // reading from the old one fails
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (cgroup->dir < 0) {
+      auto path = fmt::format("{}{}", ServiceMonitorConstants::CgroupRoot, cgroup->path);
+      cgroup->dir.reset(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+      if (cgroup->dir < 0) {
+        return false;
+      }
+    }
+    this->cgroupReader_.set_dir(cgroup->dir);
+    this->cgroupReader_.refresh_memory_usage();
+    if (this->cgroupReader_.memory().current >= 0) {
+      this->cgroupReader_.refresh_cpu_stat();
+      this->cgroupReader_.refresh_pids();
+      this->cgroupReader_.set_dir(-1);
+      return true;
+    }
+    cgroup->dir.reset();
+  }
+  this->cgroupReader_.set_dir(-1);
   return false;
 }
 
@@ -89,8 +155,11 @@ bool ServiceMonitor<Reg>::update_metrics() try {
   // log the error and continue.
   std::vector<ServiceProperties> servicesStates{};
   servicesStates.reserve(monitoredServices_.size());
+  // after a D-Bus error the signals are lost until the next subscription. Without one every
+  // service is read with GetAll
+  systemd_.ensure_subscribed();
   for (const auto& service : monitoredServices_) {
-    auto serviceState = get_service_properties(service);
+    auto serviceState = systemd_.get_service_properties(service);
 
     if (serviceState.has_value() == false) {
       atlasagent::Logger()->error("Failed to get {} properties", service);
@@ -109,11 +178,15 @@ bool ServiceMonitor<Reg>::update_metrics() try {
   // Some services may fail to return properties, but this isn’t a full failure.
   // We will still update metrics for the services we were able to get the properties for. 
   
-  // Get the new process times for the services and the new CPU time
-  // If we fail to get the new CPU time, we will not be able to calculate the CPU usage for the 
-  // current iteration and the next iteration
-  auto newProcessTimes = create_pid_map(servicesStates);
-  auto newCpuTime = get_total_cpu_time();
+  // Get the new CPU time. If we fail to get it, we will not be able to calculate the CPU usage
+  // for the current iteration and the next iteration
+  std::optional<unsigned long long> newCpuTime;
+  if (this->procStat_ != nullptr && this->procStat_->valid()) {
+    newCpuTime = this->procStat_->aggregate_total();
+  } else {
+    newCpuTime = get_total_cpu_time();
+  }
+  std::unordered_map<unsigned int, ProcessTimes> newProcessTimes{};
   
   // Iterate throught the services and update the metrics for each service
   for (const auto& service : servicesStates) {
@@ -121,6 +194,14 @@ bool ServiceMonitor<Reg>::update_metrics() try {
     const auto newServiceState = fmt::format("{}.{}", service.activeState, service.subState);
     detail::gaugeServiceState(this->registry_, ServiceMonitorConstants::ServiceStatusName, service.name.c_str(), newServiceState.c_str())->Set(1);
 
+    // States the service went through since the last update, a restart shows up here even when
+    // the service is running again by the time of the update
+    for (const auto& [state, count] : systemd_.take_transitions(service.name)) {
+      detail::counterServiceState(this->registry_, ServiceMonitorConstants::StateTransitionsName,
+                                  service.name.c_str(), state.c_str())
+          ->Add(count);
+    }
+
     // If the service is not active and running, we do not want to send metrics that depend on /proc/[pid]
     // The systemd service variable 'main pid' remains set even if a process/service is not running.
     if (service.activeState != ServiceMonitorUtilConstants::Active || service.subState != ServiceMonitorUtilConstants::Running) {
@@ -128,8 +209,52 @@ bool ServiceMonitor<Reg>::update_metrics() try {
       continue;
     }
 
-    auto serviceRSS = get_rss(service.mainPid);
+    // The number of fds is only available for the main process
     auto serviceFds = get_number_fds(service.mainPid);
+    if (serviceFds.has_value()) {
+      detail::gauge(this->registry_, ServiceMonitorConstants::FdsName, service.name.c_str())
+          ->Set(serviceFds.value());
+    } else {
+      success = false;
+      atlasagent::Logger()->error("Failed to get the number of fds for {}", service.name);
+    }
+
+    // The cgroup of the service accounts for all of its processes, not only the main one
+    auto& cgroup = this->serviceCgroups_[service.name];
+    if (this->read_cgroup(service, &cgroup)) {
+      const auto& memory = this->cgroupReader_.memory();
+      detail::gauge(this->registry_, ServiceMonitorConstants::RssName, service.name.c_str())
+          ->Set(memory.anon + memory.file_mapped);
+      detail::gauge(this->registry_, ServiceMonitorConstants::MemoryName, service.name.c_str())
+          ->Set(memory.current);
+      auto pids = this->cgroupReader_.pids_current();
+      if (pids >= 0) {
+        detail::gauge(this->registry_, ServiceMonitorConstants::ProcessesName, service.name.c_str())
+            ->Set(pids);
+      }
+
+      // The usage starts again from 0 when the service restarts in a new cgroup
+      auto usageUsec = this->cgroupReader_.cpu().usage_usec;
+      if (newCpuTime.has_value() && this->currentCpuTime != 0 && cgroup.prevUsageUsec >= 0 &&
+          usageUsec >= cgroup.prevUsageUsec) {
+        detail::gauge(this->registry_, ServiceMonitorConstants::CpuUsageName, service.name.c_str())
+            ->Set(calculate_cgroup_cpu_usage(this->currentCpuTime, newCpuTime.value(),
+                                             cgroup.prevUsageUsec, usageUsec, this->clockTicks,
+                                             this->numCpuCores));
+      }
+      cgroup.prevUsageUsec = usageUsec;
+      continue;
+    }
+
+    // Without a cgroup (cgroup v1, or no memory accounting) only the main process is accounted for
+    auto pidStat = get_proc_pid_stat(service.mainPid);
+    std::optional<unsigned long> serviceRSS;
+    std::optional<ProcessTimes> processTimes;
+    if (pidStat.has_value()) {
+      serviceRSS = pidStat.value().rss;
+      processTimes = pidStat.value().times;
+      newProcessTimes[service.mainPid] = pidStat.value().times;
+    }
 
     // Only calculate the cpu usage for a service if we have the new cpu time, the processes previous time,
     // and the new processes time. There is no need to check that the old cpu time (this->currentCpuTime) is not 0.
@@ -138,18 +263,17 @@ bool ServiceMonitor<Reg>::update_metrics() try {
     // each others pids. We could fix this by also tracking the service name in the process time map.
     std::optional<double> cpuUsage{std::nullopt};
     if (newCpuTime.has_value() && currentProcessTimes.find(service.mainPid) != currentProcessTimes.end() &&
-        newProcessTimes.find(service.mainPid) != newProcessTimes.end()) {
-      auto newProcessTime = newProcessTimes[service.mainPid];
+        processTimes.has_value()) {
       auto oldProcessTime = currentProcessTimes[service.mainPid];
       cpuUsage.emplace(calculate_cpu_usage(currentCpuTime, newCpuTime.value(), oldProcessTime,
-                                            newProcessTime, this->numCpuCores));
+                                            processTimes.value(), this->numCpuCores));
     }
 
-    // If we failed to get the RSS, FDs, or CPU usage for a service, log the error and set success to false
+    // If we failed to get the RSS or CPU usage for a service, log the error and set success to false
     // We check currentProcessTimes to see if we have the old process time for a service b/c we dont want to unnecessarily log
     // erros when calculating cpu usage. Cpu usage requires two 60 second iterations in order to calculate. Without this check 
     // we would unecessarily log errors during the first iteration on startup, or when a new process is started for the first time. 
-    if (serviceRSS.has_value() == false || serviceFds.has_value() == false || 
+    if (serviceRSS.has_value() == false ||
     (currentProcessTimes.find(service.mainPid) != currentProcessTimes.end() && cpuUsage.has_value() == false)) {
       success = false;
       atlasagent::Logger()->error("Failed to get metric(s) for {}", service.name);
@@ -158,10 +282,6 @@ bool ServiceMonitor<Reg>::update_metrics() try {
       detail::gauge(this->registry_, ServiceMonitorConstants::RssName, service.name.c_str())
           ->Set(serviceRSS.value() * this->pageSize);
     }
-    if (serviceFds.has_value()) {
-      detail::gauge(this->registry_, ServiceMonitorConstants::FdsName, service.name.c_str())
-          ->Set(serviceFds.value());
-    }
     if (cpuUsage.has_value()) {
       detail::gauge(this->registry_, ServiceMonitorConstants::CpuUsageName, service.name.c_str())
           ->Set(cpuUsage.value());
@@ -192,8 +312,16 @@ bool ServiceMonitor<Reg>::gather_metrics() {
   // To begin sending metrics, we must first determine the core count, page size, and determine all the systemd 
   // services that match our config. Once init_monitored_services() completes successfully, we can start 
   // sending metrics to spectatord. If we fail to determine these values, we will continue to retry until success.
-  if (this->initSuccess == false && this->init_monitored_services() == false) {
-    return false;
+  if (this->initSuccess == false) {
+    if (this->init_monitored_services() == false) {
+      return false;
+    }
+  } else if (this->monitoredServices_.size() < this->maxMonitoredServices &&
+             (systemd_.take_units_added() ||
+              ++this->updatesSinceDiscovery_ >= ServiceMonitorConstants::RediscoveryUpdates)) {
+    // Services started after the previous discovery might match the config. If listing the units
+    // fails we keep monitoring the current services and try again later.
+    this->discover_services();
   }
 
   // TODO: We successfully initialized but none of the services on the system matched any of
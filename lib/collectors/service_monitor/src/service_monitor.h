@@ -2,7 +2,11 @@
 
 #include <lib/tagging/src/tagging_registry.h>
 #include <lib/spectator/registry.h>
+#include <lib/collectors/cgroup/src/cgroup_snapshot.h>
+#include <lib/collectors/proc/src/proc_stat.h>
+#include <lib/files/src/files.h>
 #include "service_monitor_utils.h"
+#include <unordered_set>
 
 struct ServiceMonitorConstants {
   static constexpr auto DefaultMonitoredServices{10};
@@ -11,7 +15,13 @@ struct ServiceMonitorConstants {
   static constexpr auto RssName{"systemd.service.rss"};
   static constexpr auto FdsName{"systemd.service.fds"};
   static constexpr auto CpuUsageName{"systemd.service.cpuUsage"};
+  static constexpr auto MemoryName{"systemd.service.memory"};
+  static constexpr auto ProcessesName{"systemd.service.processes"};
+  static constexpr auto CgroupRoot{"/sys/fs/cgroup"};
   static constexpr auto ServiceStatusName{"systemd.service.status"};
+  // units are listed again after this many updates, in case a UnitNew signal was missed
+  static constexpr auto RediscoveryUpdates{10};
+  static constexpr auto StateTransitionsName{"systemd.service.stateTransitions"};
 };
 
 namespace detail {
@@ -27,12 +37,22 @@ inline auto gaugeServiceState(Reg* registry, const std::string_view name, const
   tags.add("state", state);
   return registry->GetGaugeTTL(name, ServiceMonitorConstants::GaugeTTLSeconds, tags);
 }
+
+template <typename Reg>
+inline auto counterServiceState(Reg* registry, const std::string_view name, const std::string_view serviceName, const std::string_view state) {
+  auto tags = spectator::Tags{{"service.name", fmt::format("{}", serviceName)}};
+  tags.add("state", state);
+  return registry->GetCounter(name, tags);
+}
 }  // namespace detail
 
 template <typename Reg = atlasagent::TaggingRegistry>
 class ServiceMonitor {
  public:
-  ServiceMonitor(Reg* registry, std::vector<std::regex> config, unsigned int max_services);
+  // If procStat is provided, the total cpu time is taken from that snapshot, which is expected to be
+  // refreshed by its owner before gather_metrics is called. Otherwise /proc/stat is read directly.
+  ServiceMonitor(Reg* registry, const std::vector<std::string>& config, unsigned int max_services,
+                 const atlasagent::ProcStat* procStat = nullptr);
   ~ServiceMonitor(){};
 
   // Abide by the C++ rule of 5
@@ -43,16 +63,33 @@ class ServiceMonitor {
   bool gather_metrics();
 
  private:
+  struct ServiceCgroup {
+    // the ControlGroup property of the unit
+    std::string path;
+    atlasagent::UnixFile dir{-1};
+    int64_t prevUsageUsec{-1};
+  };
+
   bool init_monitored_services();
+  bool discover_services();
   bool update_metrics();
+  bool read_cgroup(const ServiceProperties& service, ServiceCgroup* cgroup);
 
   Reg* registry_;
-  std::vector<std::regex> config_;
+  UnitMatcher matcher_;
+  const atlasagent::ProcStat* procStat_;
+  SystemdConnection systemd_;
   unsigned int maxMonitoredServices{};
   unsigned long long currentCpuTime{0};
   std::unordered_map<unsigned int, ProcessTimes> currentProcessTimes{};
   unsigned int numCpuCores{};
   long pageSize{};
+  long clockTicks{};
+  std::unordered_map<std::string, ServiceCgroup> serviceCgroups_{};
+  atlasagent::CgroupSnapshot cgroupReader_{};
   bool initSuccess{false};
   std::vector<std::string> monitoredServices_{};
+  // units listed by the previous discovery, which have already been matched
+  std::unordered_set<std::string> knownUnits_{};
+  unsigned int updatesSinceDiscovery_{0};
 };
\ No newline at end of file
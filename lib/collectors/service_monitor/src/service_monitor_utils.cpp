@@ -1,30 +1,233 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <dirent.h>
+#include <fcntl.h>
 #include <filesystem>
+#include <string_view>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
 
 #include <absl/strings/str_split.h>
+#include <fmt/format.h>
 #include "service_monitor_utils.h"
+#include <lib/files/src/files.h>
 #include <lib/util/src/util.h>
 
-// The function returns a vector of Unit structs, which contain information about each unit.
-std::optional<std::vector<Unit>> list_all_units() try {
-  // Create system bus connection
-  auto connection = sdbus::createSystemBusConnection();
+void UnitState::update(const std::map<std::string, sdbus::Variant>& properties,
+                       const std::vector<std::string>& invalidated) {
+  ++generation;
+  auto active = activeState;
+  auto sub = subState;
+  if (auto it = properties.find(DBusConstants::PropertyActiveState); it != properties.end()) {
+    active = it->second.get<std::string>();
+  }
+  if (auto it = properties.find(DBusConstants::PropertySubState); it != properties.end()) {
+    sub = it->second.get<std::string>();
+  }
+  if (auto it = properties.find(DBusConstants::PropertyMainPID); it != properties.end()) {
+    mainPid = it->second.get<uint32_t>();
+  }
+  if (auto it = properties.find(DBusConstants::PropertyControlGroup); it != properties.end()) {
+    controlGroup = it->second.get<std::string>();
+  }
+  for (const auto& name : invalidated) {
+    if (name == DBusConstants::PropertyActiveState || name == DBusConstants::PropertySubState ||
+        name == DBusConstants::PropertyMainPID) {
+      stale = true;
+    }
+  }
 
-  // Create the proxy
-  auto proxy = sdbus::createProxy(*connection, sdbus::ServiceName{DBusConstants::Service},
+  // the first values are not a transition
+  if (!activeState.empty() && (active != activeState || sub != subState)) {
+    ++transitions[fmt::format("{}.{}", active, sub)];
+  }
+  activeState = std::move(active);
+  subState = std::move(sub);
+}
+
+SystemdConnection::~SystemdConnection() { reset(); }
+
+// Create the system bus connection and the manager proxy if needed
+sdbus::IProxy& SystemdConnection::manager() {
+  if (connection_ == nullptr) {
+    connection_ = sdbus::createSystemBusConnection();
+  }
+  if (manager_ == nullptr) {
+    manager_ = sdbus::createProxy(*connection_, sdbus::ServiceName{DBusConstants::Service},
                                   sdbus::ObjectPath{DBusConstants::Path});
+  }
+  return *manager_;
+}
 
-  // Create method call message
-  auto methodCall = proxy->createMethodCall(sdbus::InterfaceName{DBusConstants::Interface},
-                                            sdbus::MethodName{DBusConstants::MethodListUnits});
-  
+// Get the proxy for the unit, looking up its object path using Manager.GetUnit the first time
+sdbus::IProxy& SystemdConnection::unit(const std::string& serviceName) {
+  auto it = units_.find(serviceName);
+  if (it != units_.end()) {
+    return *it->second;
+  }
+
+  sdbus::ObjectPath unitObjectPath;
+  try {
+    manager()
+        .callMethod(DBusConstants::MethodGetUnit)
+        .onInterface(DBusConstants::Interface)
+        .withArguments(serviceName)
+        .storeResultsTo(unitObjectPath);
+  } catch (const sdbus::Error& e) {
+    // a unit that is not loaded is expected, anything else means systemd can't be reached
+    if (e.getName() != DBusConstants::ErrorNoSuchUnit) {
+      reset();
+    }
+    throw;
+  }
+
+  auto proxy =
+      sdbus::createProxy(*connection_, sdbus::ServiceName{DBusConstants::Service}, unitObjectPath);
+  if (std::find(watched_.begin(), watched_.end(), serviceName) != watched_.end()) {
+    // called from the bus thread
+    proxy->uponSignal(sdbus::SignalName{DBusConstants::SignalPropertiesChanged})
+        .onInterface(sdbus::InterfaceName{DBusConstants::PropertiesInterface})
+        .call([this, serviceName](const std::string& /*interface*/,
+                                  const std::map<std::string, sdbus::Variant>& changed,
+                                  const std::vector<std::string>& invalidated) {
+          std::lock_guard<std::mutex> lock{mutex_};
+          auto it = states_.find(serviceName);
+          if (it == states_.end()) {
+            return;
+          }
+          try {
+            it->second.update(changed, invalidated);
+          } catch (const std::exception& e) {
+            atlasagent::Logger()->warn("Unable to apply property changes for {}: {}", serviceName,
+                                       e.what());
+            it->second.stale = true;
+          }
+        });
+  }
+  return *units_.emplace(serviceName, std::move(proxy)).first->second;
+}
+
+// Subscribe to the signals of the watched units, and start processing them on the bus thread
+bool SystemdConnection::subscribe() try {
+  auto& managerProxy = manager();
+  managerProxy.callMethod(DBusConstants::MethodSubscribe).onInterface(DBusConstants::Interface);
+  // a unit that is loaded again might be in a different state
+  managerProxy.uponSignal(sdbus::SignalName{DBusConstants::SignalUnitNew})
+      .onInterface(sdbus::InterfaceName{DBusConstants::Interface})
+      .call([this](const std::string& id, const sdbus::ObjectPath& /*unit*/) {
+        mark_stale(id);
+        unitsAdded_ = true;
+      });
+  managerProxy.uponSignal(sdbus::SignalName{DBusConstants::SignalUnitRemoved})
+      .onInterface(sdbus::InterfaceName{DBusConstants::Interface})
+      .call([this](const std::string& id, const sdbus::ObjectPath& /*unit*/) { mark_stale(id); });
+
+  for (const auto& name : watched_) {
+    units_.erase(name);
+    try {
+      unit(name);
+    } catch (const sdbus::Error& e) {
+      // a unit that is not loaded is picked up once UnitNew marks it as stale
+      if (connection_ == nullptr) {
+        throw;
+      }
+      atlasagent::Logger()->info("Unit {} is not loaded: {}", name, e.getMessage());
+    }
+  }
+
+  connection_->enterEventLoopAsync();
+  subscribed_ = true;
+  return true;
+} catch (const sdbus::Error& e) {
+  atlasagent::Logger()->error("Unable to subscribe to systemd signals: {} with message: {}",
+                              e.getName(), e.getMessage());
+  reset();
+  return false;
+}
+
+bool SystemdConnection::ensure_subscribed() {
+  if (watched_.empty() || subscribed_) {
+    return subscribed_;
+  }
+  return subscribe();
+}
+
+void SystemdConnection::mark_stale(const std::string& serviceName) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  auto it = states_.find(serviceName);
+  if (it != states_.end()) {
+    it->second.stale = true;
+  }
+}
+
+// Drop the connection and every proxy, they are created again on the next call
+void SystemdConnection::reset() {
+  if (subscribed_) {
+    connection_->leaveEventLoop();
+    subscribed_ = false;
+  }
+  units_.clear();
+  manager_.reset();
+  connection_.reset();
+
+  // signals might be missed until the next subscription
+  std::lock_guard<std::mutex> lock{mutex_};
+  for (auto& entry : states_) {
+    entry.second.stale = true;
+  }
+}
+
+void SystemdConnection::watch(std::vector<std::string> serviceNames) {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    std::unordered_map<std::string, UnitState> states;
+    for (const auto& name : serviceNames) {
+      auto it = states_.find(name);
+      states.emplace(name, it != states_.end() ? std::move(it->second) : UnitState{});
+    }
+    states_ = std::move(states);
+  }
+  watched_ = std::move(serviceNames);
+
+  // the unit proxies are created again, with the signal handlers for the watched ones
+  units_.clear();
+  if (subscribed_) {
+    for (const auto& name : watched_) {
+      try {
+        unit(name);
+      } catch (const sdbus::Error& e) {
+        atlasagent::Logger()->info("Unit {} is not loaded: {}", name, e.getMessage());
+      }
+    }
+  } else {
+    subscribe();
+  }
+}
+
+std::unordered_map<std::string, uint64_t> SystemdConnection::take_transitions(
+    const std::string& serviceName) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  auto it = states_.find(serviceName);
+  if (it == states_.end()) {
+    return {};
+  }
+  return std::exchange(it->second.transitions, {});
+}
+
+// The function returns a vector of Unit structs, which contain information about each unit.
+std::optional<std::vector<Unit>> SystemdConnection::list_all_units() try {
   // Store all the results from the method MethodListUnits into a vector of Unit structs
   std::vector<Unit> units{};
-  proxy->callMethod(sdbus::MethodName{DBusConstants::MethodListUnits})
+  manager()
+      .callMethod(sdbus::MethodName{DBusConstants::MethodListUnits})
       .onInterface(sdbus::InterfaceName{DBusConstants::Interface})
       .storeResultsTo(units);
   return units;
 } catch (const sdbus::Error& e) {
   atlasagent::Logger()->error("D-Bus Exception: {} with message: {}", e.getName(), e.getMessage());
+  reset();
   return std::nullopt;
 } catch (const std::exception& e) {
   atlasagent::Logger()->error("list_all_units exception: {}", e.what());
@@ -32,60 +235,228 @@ std::optional<std::vector<Unit>> list_all_units() try {
 }
 
 // The function returns a ServiceProperties struct containing the properties of the service.
-std::optional<ServiceProperties> get_service_properties(const std::string& serviceName) try {
-  // Connect to the system bus
-  auto connection = sdbus::createSystemBusConnection();
-
-  // First get the unit object path using Manager.GetUnit method
-  sdbus::ObjectPath unitObjectPath;
-  auto managerProxy = sdbus::createProxy(*connection, sdbus::ServiceName{DBusConstants::Service},
-                                         sdbus::ObjectPath{DBusConstants::Path});
-
-  // Get the proper object path for the unit
-  managerProxy->callMethod(DBusConstants::MethodGetUnit)
-      .onInterface(DBusConstants::Interface)
-      .withArguments(serviceName)
-      .storeResultsTo(unitObjectPath);
-
-  // Create a proxy to the service object with the correct path
-  auto proxy =
-      sdbus::createProxy(*connection, sdbus::ServiceName{DBusConstants::Service}, unitObjectPath);
-
-  // Get MainPID property
-  sdbus::Variant mainPidVariant;
-  proxy->callMethod(DBusConstants::MethodGet)
-      .onInterface(DBusConstants::PropertiesInterface)
-      .withArguments(DBusConstants::ServiceInterface, DBusConstants::PropertyMainPID)
-      .storeResultsTo(mainPidVariant);
-
-  // Get ActiveState property
-  sdbus::Variant activeStateVariant;
-  proxy->callMethod(DBusConstants::MethodGet)
-      .onInterface(DBusConstants::PropertiesInterface)
-      .withArguments(DBusConstants::UnitInterface, DBusConstants::PropertyActiveState)
-      .storeResultsTo(activeStateVariant);
+std::optional<ServiceProperties> SystemdConnection::get_service_properties(
+    const std::string& serviceName) try {
+  std::optional<uint64_t> generation;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = states_.find(serviceName);
+    if (it != states_.end()) {
+      auto& state = it->second;
+      // the cgroup of a unit that was started since it was last read is not known yet
+      if (!state.stale && (state.activeState != ServiceMonitorUtilConstants::Active ||
+                           !state.controlGroup.empty())) {
+        return ServiceProperties{serviceName, state.activeState, state.subState, state.mainPid,
+                                 state.controlGroup};
+      }
+      // a signal that comes in while GetAll is in flight sets it again or bumps the generation
+      state.stale = false;
+      generation = state.generation;
+    }
+  }
 
-  // Get SubState property
-  sdbus::Variant subStateVariant;
-  proxy->callMethod(DBusConstants::MethodGet)
+  // MainPID is on the Service interface while ActiveState and SubState are on the Unit interface,
+  // get them all in one round trip
+  std::map<std::string, sdbus::Variant> properties;
+  unit(serviceName)
+      .callMethod(DBusConstants::MethodGetAll)
       .onInterface(DBusConstants::PropertiesInterface)
-      .withArguments(DBusConstants::UnitInterface, DBusConstants::PropertySubState)
-      .storeResultsTo(subStateVariant);
+      .withArguments(std::string{DBusConstants::AllInterfaces})
+      .storeResultsTo(properties);
+
+  auto mainPid = properties.find(DBusConstants::PropertyMainPID);
+  auto activeState = properties.find(DBusConstants::PropertyActiveState);
+  auto subState = properties.find(DBusConstants::PropertySubState);
+  if (mainPid == properties.end() || activeState == properties.end() ||
+      subState == properties.end()) {
+    atlasagent::Logger()->error("Missing service properties for {}", serviceName);
+    mark_stale(serviceName);
+    return std::nullopt;
+  }
 
-  uint32_t mainPid = mainPidVariant.get<uint32_t>();
-  std::string activeState = activeStateVariant.get<std::string>();
-  std::string subState = subStateVariant.get<std::string>();
+  if (generation) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = states_.find(serviceName);
+    if (it != states_.end()) {
+      auto& state = it->second;
+      if (!state.stale && state.generation == *generation) {
+        state.update(properties);
+      } else {
+        // the reply might be older than what the signals reported, read it again next time
+        state.stale = true;
+      }
+    }
+  }
 
-  return ServiceProperties{serviceName, activeState, subState, mainPid};
+  auto controlGroup = properties.find(DBusConstants::PropertyControlGroup);
+  return ServiceProperties{serviceName, activeState->second.get<std::string>(),
+                           subState->second.get<std::string>(), mainPid->second.get<uint32_t>(),
+                           controlGroup == properties.end()
+                               ? std::string{}
+                               : controlGroup->second.get<std::string>()};
 } catch (const sdbus::Error& e) {
   atlasagent::Logger()->error("D-Bus Exception: {} with message: {}", e.getName(), e.getMessage());
+  // the unit might have been unloaded, look up its object path again next time
+  units_.erase(serviceName);
+  mark_stale(serviceName);
   return std::nullopt;
 } catch (const std::exception& e) {
   atlasagent::Logger()->error("get_service_properties exception: {}", e.what());
+  mark_stale(serviceName);
   return std::nullopt;
 }
 
-std::optional<std::vector<std::regex>> parse_regex_config_file(const char* configFilePath) try {
+namespace {
+// A pattern without regex operators, other than escaped punctuation and the ^ and $ anchors
+bool parse_literal(const std::string& pattern, std::string* text, bool* anchorBegin,
+                   bool* anchorEnd) {
+  text->clear();
+  *anchorBegin = !pattern.empty() && pattern.front() == '^';
+  *anchorEnd = false;
+  for (size_t i = *anchorBegin ? 1 : 0; i < pattern.size(); ++i) {
+    auto c = pattern[i];
+    if (c == '\\') {
+      // \d, \w, \b and the like are not literals
+      if (i + 1 == pattern.size() || std::isalnum(static_cast<unsigned char>(pattern[i + 1]))) {
+        return false;
+      }
+      text->push_back(pattern[++i]);
+    } else if (c == '$' && i + 1 == pattern.size()) {
+      *anchorEnd = true;
+    } else if (std::string_view{".[]{}()*+?|^$"}.find(c) != std::string_view::npos) {
+      return false;
+    } else {
+      text->push_back(c);
+    }
+  }
+  return true;
+}
+
+// index just past the group or bracket expression that starts at i
+size_t skip_nested(const std::string& pattern, size_t i) {
+  auto depth = 0;
+  auto inBracket = false;
+  for (; i < pattern.size(); ++i) {
+    auto c = pattern[i];
+    if (c == '\\') {
+      ++i;
+    } else if (inBracket) {
+      inBracket = c != ']';
+    } else if (c == '[') {
+      inBracket = true;
+    } else if (c == '(') {
+      ++depth;
+    } else if (c == ')') {
+      --depth;
+    }
+    if (depth == 0 && !inBracket) {
+      return i + 1;
+    }
+  }
+  return pattern.size();
+}
+
+// The runs of literal characters outside of groups that any match of the pattern must contain.
+// Returns an empty vector when there is an alternation at the top level, since then no run is
+// required
+std::vector<std::string> required_literals(const std::string& pattern) {
+  std::vector<std::string> result;
+  std::string run;
+  auto endRun = [&]() {
+    if (!run.empty()) {
+      result.emplace_back(std::move(run));
+      run.clear();
+    }
+  };
+  for (size_t i = 0; i < pattern.size();) {
+    auto c = pattern[i];
+    if (c == '|') {
+      return {};
+    } else if (c == '\\') {
+      auto next = i + 1 < pattern.size() ? pattern[i + 1] : '\0';
+      if (std::isalnum(static_cast<unsigned char>(next)) || next == '\0') {
+        endRun();
+      } else {
+        run.push_back(next);
+      }
+      i += 2;
+    } else if (c == '(' || c == '[') {
+      endRun();
+      i = skip_nested(pattern, i);
+    } else if (c == '?' || c == '*' || c == '+' || c == '{') {
+      // the previous character might not be there
+      if (!run.empty()) {
+        run.pop_back();
+      }
+      endRun();
+      auto close = c == '{' ? pattern.find('}', i) : i;
+      i = close == std::string::npos ? pattern.size() : close + 1;
+    } else if (c == '.' || c == '^' || c == '$') {
+      endRun();
+      ++i;
+    } else {
+      run.push_back(c);
+      ++i;
+    }
+  }
+  endRun();
+  return result;
+}
+}  // namespace
+
+UnitMatcher::UnitMatcher(const std::vector<std::string>& patterns) {
+  std::string alternation;
+  for (const auto& pattern : patterns) {
+    Literal literal;
+    if (parse_literal(pattern, &literal.text, &literal.anchorBegin, &literal.anchorEnd)) {
+      literals_.emplace_back(std::move(literal));
+      continue;
+    }
+    if (!alternation.empty()) {
+      alternation.push_back('|');
+    }
+    alternation.append("(?:").append(pattern).push_back(')');
+    auto& required = required_.emplace_back(required_literals(pattern));
+    alwaysSearch_ = alwaysSearch_ || required.empty();
+  }
+  if (!alternation.empty()) {
+    regex_.emplace(alternation);
+  }
+}
+
+bool UnitMatcher::matches(const std::string& unitName) const {
+  std::string_view name{unitName};
+  for (const auto& literal : literals_) {
+    const auto& text = literal.text;
+    if (literal.anchorBegin && literal.anchorEnd) {
+      if (name == text) {
+        return true;
+      }
+    } else if (literal.anchorBegin) {
+      if (name.substr(0, text.size()) == text) {
+        return true;
+      }
+    } else if (literal.anchorEnd) {
+      if (name.size() >= text.size() && name.substr(name.size() - text.size()) == text) {
+        return true;
+      }
+    } else if (name.find(text) != std::string_view::npos) {
+      return true;
+    }
+  }
+  if (!regex_.has_value()) {
+    return false;
+  }
+  auto candidate = alwaysSearch_ ||
+                   std::any_of(required_.begin(), required_.end(), [name](const auto& required) {
+                     return std::all_of(required.begin(), required.end(), [name](const auto& text) {
+                       return name.find(text) != std::string_view::npos;
+                     });
+                   });
+  return candidate && std::regex_search(unitName, *regex_);
+}
+
+std::optional<std::vector<std::string>> parse_regex_config_file(const char* configFilePath) try {
   // Read the all the regex patterns in the config file
   std::optional<std::vector<std::string>> stringPatterns = atlasagent::read_file(configFilePath);
   if (stringPatterns.has_value() == false) {
@@ -101,12 +472,14 @@ std::optional<std::vector<std::regex>> parse_regex_config_file(const char* confi
 
   // Read all the lines in the file and if the line is a valid regex pattern, add it to regexPatterns
   // If any of the regex patterns are invalid, log the error and return nullopt
-  std::vector<std::regex> regexPatterns{};
+  std::vector<std::string> regexPatterns{};
   for (const auto& regex_pattern : stringPatterns.value()) {
     if (regex_pattern.empty()) {
       continue;
     }
     try {
+      // the patterns are compiled by UnitMatcher, only check them here
+      std::regex{regex_pattern};
       regexPatterns.emplace_back(regex_pattern);
     } catch (const std::regex_error& e) {
       atlasagent::Logger()->error("Exception: {}, for regex:{}, in config file {}", e.what(),
@@ -120,14 +493,14 @@ std::optional<std::vector<std::regex>> parse_regex_config_file(const char* confi
   return std::nullopt;
 }
 
-std::optional<std::vector<std::regex>> parse_service_monitor_config_directory(const char* directoryPath) try {
+std::optional<std::vector<std::string>> parse_service_monitor_config_directory(const char* directoryPath) try {
   if (std::filesystem::exists(directoryPath) == false || std::filesystem::is_directory(directoryPath) == false) {
     atlasagent::Logger()->error("Invalid service monitor config directory {}", directoryPath);
     return std::nullopt;
   }
 
   std::regex configFileExtPattern(ServiceMonitorUtilConstants::ConfigFileExtPattern);
-  std::vector<std::regex> allRegexPatterns{};
+  std::vector<std::string> allRegexPatterns{};
 
   // Iterate through all files in the config directory, but do not process them if they do not match the service 
   // monitoring config regex pattern ".systemd-unit"
@@ -157,62 +530,67 @@ std::optional<std::vector<std::regex>> parse_service_monitor_config_directory(co
   return std::nullopt;
 }
 
-std::optional<std::vector<std::string>> get_proc_fields(const unsigned int &pid) {
-  std::filesystem::path procPath = std::filesystem::path(ServiceMonitorUtilConstants::ProcPath) /
-                                   std::to_string(pid) / ServiceMonitorUtilConstants::StatPath;
-  auto pidStats = atlasagent::read_file(procPath.string().c_str());
-  return pidStats;
-}
-
-std::optional<ProcessTimes> parse_process_times(const std::vector<std::string>& pidStats) try {
-  auto statLine = pidStats.at(0);
-  std::vector<std::string> statTokens = absl::StrSplit(statLine, ' ', absl::SkipWhitespace());
-
-  // Check if we have enough tokens before accessing them
-  if (statTokens.size() <= ServiceMonitorUtilConstants::STimeIndex) {
-    atlasagent::Logger()->error("Not enough tokens in proc stat file. Expected at least {}, got {}",
-                                ServiceMonitorUtilConstants::STimeIndex + 1, statTokens.size());
+std::optional<ProcPidStat> parse_proc_pid_stat(std::string_view stat) {
+  // The command name is in parentheses and can itself contain spaces and parentheses, so the
+  // fields are counted from the last ')'
+  auto commEnd = stat.rfind(')');
+  if (commEnd == std::string_view::npos) {
+    atlasagent::Logger()->error("Unable to find the command name in proc stat file");
     return std::nullopt;
   }
 
-  unsigned long uTime = std::stoul(statTokens[ServiceMonitorUtilConstants::UTimeIndex]);
-  unsigned long sTime = std::stoul(statTokens[ServiceMonitorUtilConstants::STimeIndex]);
-  return ProcessTimes{uTime, sTime};
-} catch (const std::exception& e) {
-  atlasagent::Logger()->error("Exception: {} in parse_process_times", e.what());
-  return std::nullopt;
-}
+  ProcPidStat pidStat{};
+  unsigned int index = 0;
+  for (auto pos = commEnd + 1; index <= ServiceMonitorUtilConstants::RssIndex; ++index) {
+    while (pos < stat.size() && stat[pos] == ' ') {
+      ++pos;
+    }
+    if (pos >= stat.size()) {
+      break;
+    }
+    auto end = std::min(stat.find(' ', pos), stat.size());
+    unsigned long* value = nullptr;
+    if (index == ServiceMonitorUtilConstants::UTimeIndex) {
+      value = &pidStat.times.uTime;
+    } else if (index == ServiceMonitorUtilConstants::STimeIndex) {
+      value = &pidStat.times.sTime;
+    } else if (index == ServiceMonitorUtilConstants::RssIndex) {
+      value = &pidStat.rss;
+    }
+    if (value != nullptr &&
+        std::from_chars(stat.data() + pos, stat.data() + end, *value).ec != std::errc{}) {
+      atlasagent::Logger()->error("Invalid field {} in proc stat file", index);
+      return std::nullopt;
+    }
+    pos = end;
+  }
 
-std::optional<ProcessTimes> get_process_times(const unsigned int &pid) {
-  auto pidStats = get_proc_fields(pid);
-  if (pidStats.has_value() == false) {
+  // Check if we found enough fields
+  if (index <= ServiceMonitorUtilConstants::RssIndex) {
+    atlasagent::Logger()->error("Not enough fields in proc stat file. Expected at least {}, got {}",
+                                ServiceMonitorUtilConstants::RssIndex + 1, index);
     return std::nullopt;
   }
-  return parse_process_times(pidStats.value());
+  return pidStat;
 }
 
-std::optional<unsigned long> parse_rss(const std::vector<std::string>& pidStats) try {
-  auto statLine = pidStats.at(0);
-  std::vector<std::string> statTokens = absl::StrSplit(statLine, ' ', absl::SkipWhitespace());
-  // Check if we have enough tokens before accessing them
-  if (statTokens.size() <= ServiceMonitorUtilConstants::RssIndex) {
-    atlasagent::Logger()->error("Not enough tokens in proc stat file. Expected at least {}, got {}",
-                                ServiceMonitorUtilConstants::RssIndex + 1, statTokens.size());
+std::optional<ProcPidStat> get_proc_pid_stat(const unsigned int& pid) {
+  char path[64];
+  snprintf(path, sizeof path, "%s/%u/%s", ServiceMonitorUtilConstants::ProcPath, pid,
+           ServiceMonitorUtilConstants::StatPath);
+  atlasagent::UnixFile fd{path};
+  if (fd < 0) {
     return std::nullopt;
   }
 
-  return std::stoul(statTokens[ServiceMonitorUtilConstants::RssIndex]);
-} catch (const std::exception& e) {
-  atlasagent::Logger()->error("Exception: {} in parse_rss", e.what());
-  return std::nullopt;
-}
-
-std::optional<unsigned long> get_rss(const unsigned int &pid) {
-  auto pidStats = get_proc_fields(pid);
-  if (pidStats.has_value() == false) {
+  // The file is a single line, which the kernel returns in one read
+  char buf[4096];
+  auto len = read(fd, buf, sizeof buf);
+  if (len <= 0) {
+    atlasagent::Logger()->error("Error reading {}: {}", path, strerror(errno));
     return std::nullopt;
   }
-  return parse_rss(pidStats.value());
+  return parse_proc_pid_stat(std::string_view{buf, static_cast<size_t>(len)});
 }
 
 unsigned long long parse_cpu_time(const std::vector<std::string>& cpuStats) {
@@ -238,22 +616,50 @@ std::optional<unsigned long long> get_total_cpu_time() {
   return parse_cpu_time(cpuStats.value());
 }
 
-std::optional<unsigned int> get_number_fds(const unsigned int& pid) try {
-  auto path = std::filesystem::path(ServiceMonitorUtilConstants::ProcPath) / std::to_string(pid) /
-              ServiceMonitorUtilConstants::FdPath;
+std::optional<unsigned int> get_number_fds(const unsigned int& pid) {
+  char path[64];
+  snprintf(path, sizeof path, "%s/%u/%s", ServiceMonitorUtilConstants::ProcPath, pid,
+           ServiceMonitorUtilConstants::FdPath);
+  atlasagent::UnixFile fd{open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+  if (fd < 0) {
+    atlasagent::Logger()->error("Unable to open {}: {}", path, strerror(errno));
+    return std::nullopt;
+  }
 
-  int fd_count = 0;
-  for (const auto& entry : std::filesystem::directory_iterator(path)) {
-    // Only count symbolic links, which represent open file descriptors
-    if (entry.is_symlink()) {
-      ++fd_count;
+  // Read the entries with getdents64 instead of readdir and a stat per entry, since a service can
+  // have hundreds of thousands of open sockets. Every descriptor is a symbolic link
+  alignas(struct dirent64) char buf[32768];
+  unsigned int fdCount = 0;
+  for (;;) {
+    auto len = syscall(SYS_getdents64, static_cast<int>(fd), buf, sizeof buf);
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+    if (len < 0) {
+      atlasagent::Logger()->error("Unable to read {}: {}", path, strerror(errno));
+      return std::nullopt;
+    }
+    if (len == 0) {
+      break;
+    }
+    for (long offset = 0; offset < len;) {
+      auto entry = reinterpret_cast<const struct dirent64*>(buf + offset);
+      if (entry->d_type == DT_LNK) {
+        ++fdCount;
+      }
+      offset += entry->d_reclen;
     }
   }
-  return fd_count;
+  return fdCount;
+}
 
-} catch (const std::exception& e) {
-  atlasagent::Logger()->error("get_number_fds execption: {} ", e.what());
-  return std::nullopt;
+double calculate_cgroup_cpu_usage(unsigned long long oldCpuTime, unsigned long long newCpuTime,
+                                  int64_t oldUsageUsec, int64_t newUsageUsec, long clockTicks,
+                                  unsigned int numCores) {
+  // /proc/stat is in clock ticks, cpu.stat in microseconds
+  double usageTicks = static_cast<double>(newUsageUsec - oldUsageUsec) * clockTicks / 1e6;
+  unsigned long long cpuTimeDelta = newCpuTime - oldCpuTime;
+  return (100.0 * usageTicks / cpuTimeDelta) * numCores;
 }
 
 double calculate_cpu_usage(const unsigned long long &oldCpuTime, const unsigned long long &newCpuTime,
@@ -299,29 +705,3 @@ std::optional<unsigned int> get_cpu_cores() {
 
   return parse_cores(possible.value()[0]);
 }
-
-
-/* Iterate through the services and get the main PID and process times for each service
-Store the results in a map where the key is the PID and the value is the ProcessTimes struct
-If any of the process times cannot be retrieved, log the error and continue to the next service
-Return the map of PIDs and process times */
-std::unordered_map<unsigned int, ProcessTimes> create_pid_map(const std::vector<ServiceProperties>& services) try {
-  std::unordered_map<unsigned int, ProcessTimes> pidMap{};
-  for (const auto& service : services) {
-    if (service.activeState != ServiceMonitorUtilConstants::Active || service.subState != ServiceMonitorUtilConstants::Running) {
-      atlasagent::Logger()->debug("Service {} is not active and running, not gathering process time", service.name);
-      continue;
-    }
-    auto pid = service.mainPid;
-    auto processTimes = get_process_times(pid);
-    if (processTimes.has_value() == false) {
-      atlasagent::Logger()->error("Error getting {} process times", service.name);
-      continue;
-    }
-    pidMap[pid] = processTimes.value();
-  }
-  return pidMap;
-} catch (const std::exception& e) {
-  atlasagent::Logger()->error("Exception: {} in create_pid_map", e.what());
-  return {};
-}
\ No newline at end of file
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <regex>
 #include <sdbus-c++/sdbus-c++.h>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -20,16 +25,27 @@ struct DBusConstants {
   // Manager interface constants
   static constexpr auto Interface = "org.freedesktop.systemd1.Manager";
   static constexpr auto MethodListUnits = "ListUnits";
+  static constexpr auto ErrorNoSuchUnit = "org.freedesktop.systemd1.NoSuchUnit";
   static constexpr auto MethodGetUnit = "GetUnit";
+  // systemd only emits unit signals while at least one client is subscribed
+  static constexpr auto MethodSubscribe = "Subscribe";
+  static constexpr auto SignalUnitNew = "UnitNew";
+  static constexpr auto SignalUnitRemoved = "UnitRemoved";
 
   // Properties interface constants
   static constexpr auto PropertiesInterface = "org.freedesktop.DBus.Properties";
   static constexpr auto MethodGet = "Get";
+  static constexpr auto MethodGetAll = "GetAll";
+  // sd-bus returns the properties of every interface of the object for an empty interface
+  static constexpr auto AllInterfaces = "";
+  static constexpr auto SignalPropertiesChanged = "PropertiesChanged";
 
   // Unit interface constants
   static constexpr auto UnitInterface = "org.freedesktop.systemd1.Unit";
   static constexpr auto PropertyActiveState = "ActiveState";
   static constexpr auto PropertySubState = "SubState";
+  // not sent with PropertiesChanged, but it does not change while the unit is running
+  static constexpr auto PropertyControlGroup = "ControlGroup";
 
   // Service interface constants
   static constexpr auto ServiceInterface = "org.freedesktop.systemd1.Service";
@@ -37,9 +53,10 @@ struct DBusConstants {
 };
 
 struct ServiceMonitorUtilConstants {
-  static constexpr auto UTimeIndex{13};
-  static constexpr auto STimeIndex{14};
-  static constexpr auto RssIndex{23};
+  // Indexes of the /proc/<pid>/stat fields after the command name, which start with the state
+  static constexpr unsigned int UTimeIndex{11};
+  static constexpr unsigned int STimeIndex{12};
+  static constexpr unsigned int RssIndex{21};
   static constexpr auto ProcStatPath{"/proc/stat"};
   static constexpr auto CpuInfoPath{"/sys/devices/system/cpu/possible"};
   static constexpr auto AggregateCpuIndex{0};
@@ -58,28 +75,131 @@ struct ProcessTimes {
   unsigned long sTime{};
 };
 
+// The fields of /proc/<pid>/stat used for the service metrics
+struct ProcPidStat {
+  ProcessTimes times{};
+  // in pages
+  unsigned long rss{};
+};
+
 struct ServiceProperties {
   std::string name;
   std::string activeState;
   std::string subState;
   unsigned int mainPid;
+  // path of the unit cgroup relative to the cgroup root, empty while the unit is not running
+  std::string controlGroup;
 };
 
-// DBus Functions
-std::optional<std::vector<Unit>> list_all_units();
-std::optional<ServiceProperties> get_service_properties(const std::string& serviceName);
+// The last known state of a watched unit
+struct UnitState {
+  std::string activeState;
+  std::string subState;
+  uint32_t mainPid{0};
+  std::string controlGroup;
+  // systemd did not send the new values, so they have to be read again
+  bool stale{true};
+  // incremented on every update, a GetAll reply is only applied if no signal came in meanwhile
+  uint64_t generation{0};
+  // number of times the unit entered each <ActiveState>.<SubState> since they were last taken
+  std::unordered_map<std::string, uint64_t> transitions;
+
+  // apply the values of a GetAll reply or a PropertiesChanged signal
+  void update(const std::map<std::string, sdbus::Variant>& properties,
+              const std::vector<std::string>& invalidated = {});
+};
+
+// A long lived connection to systemd on the system bus. The object path of each unit is looked up
+// once and its proxy is kept, so getting the properties of a service is a single GetAll call.
+// After a D-Bus error the affected proxies are dropped and created again on the next call.
+//
+// Once watch is called the connection runs its own thread, which applies the PropertiesChanged
+// signals of the watched units to their UnitState. Getting their properties is then a memory read,
+// and changes between two reads are counted as transitions instead of being missed.
+class SystemdConnection {
+ public:
+  SystemdConnection() = default;
+  SystemdConnection(const SystemdConnection&) = delete;
+  SystemdConnection& operator=(const SystemdConnection&) = delete;
+  ~SystemdConnection();
+
+  std::optional<std::vector<Unit>> list_all_units();
+  std::optional<ServiceProperties> get_service_properties(const std::string& serviceName);
+
+  // track the state of these units from the signals sent by systemd
+  void watch(std::vector<std::string> serviceNames);
+  // the transitions of a watched unit since the previous call
+  std::unordered_map<std::string, uint64_t> take_transitions(const std::string& serviceName);
+  // whether systemd loaded new units since the previous call, once subscribed by watch
+  bool take_units_added() { return unitsAdded_.exchange(false); }
+  // subscribe again if the connection was reset since watch, meant to be called once per
+  // collection. Returns false if the watched units are not being tracked
+  bool ensure_subscribed();
+
+ private:
+  sdbus::IProxy& manager();
+  sdbus::IProxy& unit(const std::string& serviceName);
+  bool subscribe();
+  void mark_stale(const std::string& serviceName);
+  void reset();
+
+  std::unique_ptr<sdbus::IConnection> connection_;
+  std::unique_ptr<sdbus::IProxy> manager_;
+  std::unordered_map<std::string, std::unique_ptr<sdbus::IProxy>> units_;
+
+  std::vector<std::string> watched_;
+  // the bus thread is processing the signals
+  bool subscribed_{false};
+  // guards states_, which is updated by the bus thread
+  std::mutex mutex_;
+  std::unordered_map<std::string, UnitState> states_;
+  std::atomic<bool> unitsAdded_{false};
+};
+
+// Matches unit names against the patterns of the service monitor configs. Most patterns are a unit
+// name or prefix, so the ones without regex operators are compared as strings. The others are
+// combined into a single std::regex, which is only searched when the unit name contains all the
+// literal parts one of those patterns requires (for example "nginx" and "service" for
+// "nginx.service").
+class UnitMatcher {
+ public:
+  explicit UnitMatcher(const std::vector<std::string>& patterns);
+  [[nodiscard]] bool matches(const std::string& unitName) const;
+
+  [[nodiscard]] size_t num_literals() const noexcept { return literals_.size(); }
+  [[nodiscard]] size_t num_regexes() const noexcept { return required_.size(); }
+  // whether unit names can skip the regex based on the required literals
+  [[nodiscard]] bool prefiltered() const noexcept { return regex_.has_value() && !alwaysSearch_; }
+
+ private:
+  struct Literal {
+    std::string text;
+    bool anchorBegin;
+    bool anchorEnd;
+  };
+  std::vector<Literal> literals_;
+  // all the non-literal patterns as one alternation
+  std::optional<std::regex> regex_;
+  // the literals each of those patterns requires, empty when nothing is known to be required
+  std::vector<std::vector<std::string>> required_;
+  // some pattern requires no literal, so the prefilter can't rule anything out
+  bool alwaysSearch_{false};
+};
 
 // Config Parsing Functions
-std::optional<std::vector<std::regex>> parse_service_monitor_config_directory(
+std::optional<std::vector<std::string>> parse_service_monitor_config_directory(
     const char* directoryPath);
 
 // Metrics Functions
-std::optional<unsigned long> get_rss(const unsigned int &pid);
+std::optional<ProcPidStat> parse_proc_pid_stat(std::string_view stat);
+std::optional<ProcPidStat> get_proc_pid_stat(const unsigned int &pid);
 std::optional<unsigned long long> get_total_cpu_time();
 std::optional<unsigned int> get_number_fds(const unsigned int &pid);
 double calculate_cpu_usage(const unsigned long long &oldCpuTime, const unsigned long long &newCpuTime,
                            const ProcessTimes &oldProcessTime, const ProcessTimes &newProcessTime,
                            const unsigned int &numCores);
+// Same as calculate_cpu_usage, for the usage_usec of a cgroup cpu.stat
+double calculate_cgroup_cpu_usage(unsigned long long oldCpuTime, unsigned long long newCpuTime,
+                                  int64_t oldUsageUsec, int64_t newUsageUsec, long clockTicks,
+                                  unsigned int numCores);
 std::optional<unsigned int> get_cpu_cores();
-std::unordered_map<unsigned int, ProcessTimes> create_pid_map(
-    const std::vector<ServiceProperties>& services);
\ No newline at end of file
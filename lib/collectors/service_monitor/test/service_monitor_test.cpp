@@ -37,9 +37,124 @@ TEST(ServiceMonitorTest, ParseProcPidStat) {
   auto filepath{"testdata/resources2/service_monitor/valid-proc-pid-stat-info.txt"};
   auto fileContents = atlasagent::read_file(filepath);
   EXPECT_NE(std::nullopt, fileContents);
-  auto processTimes = parse_process_times(fileContents.value());
-  auto rss = parse_rss(fileContents.value());
-  EXPECT_EQ(5, processTimes.value().uTime);
-  EXPECT_EQ(6, processTimes.value().sTime);
-  EXPECT_EQ(2933, rss);
+  auto pidStat = parse_proc_pid_stat(fileContents.value()[0]);
+  ASSERT_NE(std::nullopt, pidStat);
+  EXPECT_EQ(5, pidStat.value().times.uTime);
+  EXPECT_EQ(6, pidStat.value().times.sTime);
+  EXPECT_EQ(2933, pidStat.value().rss);
+}
+
+TEST(ServiceMonitorTest, ParseProcPidStatCommand) {
+  // the command name can contain spaces and parentheses
+  auto pidStat = parse_proc_pid_stat(
+      "7 (a) b (c)) S 1 7 7 0 -1 4194560 1431 63 58 0 7 8 0 0 20 0 1 0 171 21966848 42 0\n");
+  ASSERT_NE(std::nullopt, pidStat);
+  EXPECT_EQ(7, pidStat.value().times.uTime);
+  EXPECT_EQ(8, pidStat.value().times.sTime);
+  EXPECT_EQ(42, pidStat.value().rss);
+
+  EXPECT_EQ(std::nullopt, parse_proc_pid_stat("7 (a) S 1 7 7"));
+  EXPECT_EQ(std::nullopt, parse_proc_pid_stat("7 a S 1 7 7"));
+}
+
+TEST(ServiceMonitorTest, NumberFds) {
+  auto before = get_number_fds(getpid());
+  ASSERT_NE(std::nullopt, before);
+  std::vector<atlasagent::UnixFile> files;
+  for (int i = 0; i < 100; ++i) {
+    files.emplace_back(open("/dev/null", O_RDONLY | O_CLOEXEC));
+  }
+  EXPECT_EQ(before.value() + 100, get_number_fds(getpid()));
+}
+
+TEST(ServiceMonitorTest, UnitStateTransitions) {
+  UnitState state;
+  state.update({{"ActiveState", sdbus::Variant{std::string{"active"}}},
+                {"SubState", sdbus::Variant{std::string{"running"}}},
+                {"MainPID", sdbus::Variant{uint32_t{100}}}});
+  EXPECT_EQ("active", state.activeState);
+  EXPECT_EQ("running", state.subState);
+  EXPECT_EQ(100, state.mainPid);
+  EXPECT_TRUE(state.transitions.empty());
+
+  // a restart between two updates
+  state.stale = false;
+  state.update({{"ActiveState", sdbus::Variant{std::string{"deactivating"}}},
+                {"SubState", sdbus::Variant{std::string{"stop-sigterm"}}}});
+  state.update({{"ActiveState", sdbus::Variant{std::string{"activating"}}},
+                {"SubState", sdbus::Variant{std::string{"start"}}},
+                {"MainPID", sdbus::Variant{uint32_t{0}}}});
+  state.update({{"ActiveState", sdbus::Variant{std::string{"active"}}},
+                {"SubState", sdbus::Variant{std::string{"running"}}},
+                {"MainPID", sdbus::Variant{uint32_t{200}}}});
+  // unrelated properties are not a transition
+  state.update({{"StatusText", sdbus::Variant{std::string{"ready"}}}});
+
+  EXPECT_EQ(200, state.mainPid);
+  EXPECT_FALSE(state.stale);
+  // every update counts, so a GetAll reply can tell whether a signal came in meanwhile
+  EXPECT_EQ(5u, state.generation);
+  std::unordered_map<std::string, uint64_t> expected{
+      {"deactivating.stop-sigterm", 1}, {"activating.start", 1}, {"active.running", 1}};
+  EXPECT_EQ(expected, state.transitions);
+
+  state.update({}, {"SubState"});
+  EXPECT_TRUE(state.stale);
+}
+
+TEST(ServiceMonitorTest, UnitMatcher) {
+  UnitMatcher matcher{{"^nginx", "\\.scope$", "^sshd\\.service$", "docker", "cat|dog", "^worker@\\d+"}};
+  EXPECT_EQ(4, matcher.num_literals());
+  EXPECT_EQ(2, matcher.num_regexes());
+
+  EXPECT_TRUE(matcher.matches("nginx.service"));
+  EXPECT_FALSE(matcher.matches("my-nginx.service"));
+  EXPECT_TRUE(matcher.matches("session-1.scope"));
+  EXPECT_TRUE(matcher.matches("sshd.service"));
+  EXPECT_FALSE(matcher.matches("sshd-keygen.service"));
+  EXPECT_TRUE(matcher.matches("run-docker-runtime.mount"));
+  EXPECT_TRUE(matcher.matches("hotdog.service"));
+  EXPECT_TRUE(matcher.matches("worker@12.service"));
+  EXPECT_FALSE(matcher.matches("worker@a.service"));
+  EXPECT_FALSE(matcher.matches("cron.service"));
+}
+
+TEST(ServiceMonitorTest, UnitMatcherPrefilter) {
+  UnitMatcher matcher{{"nginx.service", "^api-v2?.service$", "^user@\\d+.service$"}};
+  EXPECT_EQ(0, matcher.num_literals());
+  EXPECT_EQ(3, matcher.num_regexes());
+  EXPECT_TRUE(matcher.prefiltered());
+
+  EXPECT_TRUE(matcher.matches("nginx.service"));
+  EXPECT_TRUE(matcher.matches("nginx-service"));
+  EXPECT_FALSE(matcher.matches("nginxservice"));
+  EXPECT_FALSE(matcher.matches("cron.service"));
+  // the optional character is not required by the prefilter
+  EXPECT_TRUE(matcher.matches("api-v.service"));
+  EXPECT_TRUE(matcher.matches("api-v2.service"));
+  EXPECT_FALSE(matcher.matches("api-v3.service"));
+  EXPECT_TRUE(matcher.matches("user@1000.service"));
+  EXPECT_FALSE(matcher.matches("user@.service"));
+
+  // an alternation requires no literal, so everything has to be searched
+  UnitMatcher alternation{{"nginx.service", "cat|dog"}};
+  EXPECT_FALSE(alternation.prefiltered());
+  EXPECT_TRUE(alternation.matches("hotdog.service"));
+  EXPECT_TRUE(alternation.matches("nginx.service"));
+  EXPECT_FALSE(alternation.matches("cron.service"));
+}
+
+TEST(ServiceMonitorTest, UnitMatcherConfig) {
+  auto config = parse_service_monitor_config_directory("testdata/resources2/service_monitor/regex_directory");
+  ASSERT_NE(std::nullopt, config);
+  UnitMatcher matcher{config.value()};
+  EXPECT_EQ(config.value().size(), matcher.num_literals() + matcher.num_regexes());
+  EXPECT_TRUE(matcher.matches("abc"));
+  EXPECT_TRUE(matcher.matches("hello"));
+}
+
+TEST(ServiceMonitorTest, CgroupCpuUsage) {
+  // 60 seconds on 4 cores at 100 ticks per second, with 30 seconds of cpu time used by the service
+  auto cpuUsage = calculate_cgroup_cpu_usage(1000, 25000, 2000000, 32000000, 100, 4);
+  EXPECT_DOUBLE_EQ(50.0, cpuUsage);
 }
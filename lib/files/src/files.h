@@ -1,7 +1,10 @@
 #pragma once
 
 #include <lib/logger/src/logger.h>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
+#include <vector>
 #include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -53,13 +56,23 @@ class UnixFile {
     }
   }
 
-  ~UnixFile() {
+  // close the file, if open, and take ownership of fd
+  void reset(int fd = -1) noexcept {
     if (fd_ >= 0) {
       close(fd_);
-      fd_ = -1;
     }
+    fd_ = fd;
   }
 
+  // give up ownership of the descriptor
+  int release() noexcept {
+    auto fd = fd_;
+    fd_ = -1;
+    return fd;
+  }
+
+  ~UnixFile() { reset(); }
+
   operator int() const { return fd_; }
 
  private:
@@ -73,6 +86,13 @@ class DirHandle {
       Logger()->warn("Unable to opendir {}: {}", name, strerror(errno));
     }
   }
+
+  // takes ownership of fd, which is closed even if it could not be opened as a directory
+  explicit DirHandle(int fd) noexcept : dh_{fd >= 0 ? fdopendir(fd) : nullptr} {
+    if (dh_ == nullptr && fd >= 0) {
+      close(fd);
+    }
+  }
   DirHandle(const DirHandle&) = delete;
   ~DirHandle() {
     if (dh_ != nullptr) {
@@ -85,4 +105,45 @@ class DirHandle {
  private:
   DIR* dh_;
 };
+
+namespace detail {
+// the loop shared by read_all and pread_all. With at_offset, reads with pread from offset 0
+inline ssize_t read_loop(int fd, std::vector<char>* buf, bool at_offset) noexcept {
+  if (buf->empty()) {
+    buf->resize(4096);
+  }
+  size_t len = 0;
+  for (;;) {
+    if (len == buf->size()) {
+      buf->resize(buf->size() * 2);
+    }
+    auto n = at_offset ? ::pread(fd, buf->data() + len, buf->size() - len, static_cast<off_t>(len))
+                       : ::read(fd, buf->data() + len, buf->size() - len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (n == 0) {
+      break;
+    }
+    len += static_cast<size_t>(n);
+  }
+  return static_cast<ssize_t>(len);
+}
+}  // namespace detail
+
+// read everything left in fd into buf, growing it as needed. The buffer is only ever grown so
+// callers can keep it around and avoid allocating on every read. Returns the number of bytes
+// read, or -1 on error
+inline ssize_t read_all(int fd, std::vector<char>* buf) noexcept {
+  return detail::read_loop(fd, buf, false);
+}
+
+// same as read_all but always starts at offset 0 without moving the file offset, so a file
+// kept open can be read again on every sample. Files in procfs regenerate their contents
+inline ssize_t pread_all(int fd, std::vector<char>* buf) noexcept {
+  return detail::read_loop(fd, buf, true);
+}
 }  // namespace atlasagent
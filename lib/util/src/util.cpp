@@ -2,6 +2,7 @@
 #include <lib/logger/src/logger.h>
 #include <absl/strings/str_split.h>
 #include <cinttypes>
+#include <cstring>
 #include <filesystem>
 #include <sstream>
 #include <unistd.h>
@@ -241,6 +242,15 @@ spectator::Tags parse_tags(const char* s) {
   return tags;
 }
 
+bool env_flag_enabled(const char* var, const char* what) {
+  auto value = std::getenv(var);
+  if (value != nullptr && std::strcmp(value, "true") == 0) {
+    Logger()->info("{} enabled using the env variable {}", what, var);
+    return true;
+  }
+  return false;
+}
+
 bool is_service_running(const char* serviceName) {
   std::string command =
       std::string(UtilConstants::ServiceActiveCmd) + " " + std::string(serviceName);
@@ -50,6 +50,10 @@ inline spectator::IdPtr id_for(const char* name, const char* iface, const char*
   return spectator::Id::of(name, tags);
 }
 
+// whether an opt-in feature was enabled by setting the env variable var to true. Logs what was
+// enabled
+bool env_flag_enabled(const char* var, const char* what);
+
 bool is_service_running(const char* serviceName);
 
 bool is_file_present(const char* fileName);
@@ -72,6 +72,16 @@ TEST(Utils, ParseTags) {
   EXPECT_EQ(tags.at("key2"), "value2");
 }
 
+TEST(Utils, EnvFlagEnabled) {
+  unsetenv("ATLAS_TEST_FLAG");
+  EXPECT_FALSE(atlasagent::env_flag_enabled("ATLAS_TEST_FLAG", "Test flag"));
+  setenv("ATLAS_TEST_FLAG", "1", 1);
+  EXPECT_FALSE(atlasagent::env_flag_enabled("ATLAS_TEST_FLAG", "Test flag"));
+  setenv("ATLAS_TEST_FLAG", "true", 1);
+  EXPECT_TRUE(atlasagent::env_flag_enabled("ATLAS_TEST_FLAG", "Test flag"));
+  unsetenv("ATLAS_TEST_FLAG");
+}
+
 TEST(Utils, ParseTagsEmpty) {
   auto tags = atlasagent::parse_tags("");
   EXPECT_EQ(tags.size(), 0);